@@ -0,0 +1,112 @@
+#include <Arduino.h>
+#include <stdio.h>
+#include <time.h>
+
+unsigned long millis() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+#ifndef HAVE_STRLCPY
+size_t strlcpy(char *destination, const char *source, size_t size) {
+  size_t length = strlen(source);
+  if (size > 0) {
+    size_t copied = length < size - 1 ? length : size - 1;
+    memcpy(destination, source, copied);
+    destination[copied] = '\0';
+  }
+  return length;
+}
+#endif
+
+Stream::Stream() {
+  input = NULL;
+  inputLength = 0;
+  inputIndex = 0;
+}
+
+// The data must stay valid until it is read
+void Stream::setInput(const char *data, size_t length) {
+  input = data;
+  inputLength = length;
+  inputIndex = 0;
+}
+
+int Stream::available() {
+  return inputLength - inputIndex;
+}
+
+int Stream::read() {
+  return inputIndex < inputLength ? (uint8_t) input[inputIndex++] : -1;
+}
+
+int Stream::peek() {
+  return inputIndex < inputLength ? (uint8_t) input[inputIndex] : -1;
+}
+
+size_t Stream::readBytes(char *buffer, size_t length) {
+  size_t count = inputLength - inputIndex < length ? inputLength - inputIndex : length;
+  memcpy(buffer, input + inputIndex, count);
+  inputIndex += count;
+  return count;
+}
+
+size_t Stream::print(char c) {
+  output += c;
+  return 1;
+}
+
+size_t Stream::print(unsigned char b) {
+  return print((unsigned int) b);
+}
+
+size_t Stream::print(int i) {
+  return print((long) i);
+}
+
+size_t Stream::print(unsigned int i) {
+  return print((unsigned long) i);
+}
+
+size_t Stream::print(long l) {
+  char buffer[24];
+  snprintf(buffer, sizeof(buffer), "%ld", l);
+  return print(buffer);
+}
+
+size_t Stream::print(unsigned long l) {
+  char buffer[24];
+  snprintf(buffer, sizeof(buffer), "%lu", l);
+  return print(buffer);
+}
+
+size_t Stream::print(double d, int digits) {
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), "%.*f", digits, d);
+  return print(buffer);
+}
+
+size_t Stream::print(const char *s) {
+  size_t length = strlen(s);
+  output.append(s, length);
+  return length;
+}
+
+size_t Stream::println() {
+  output += "\r\n";
+  return 2;
+}
+
+size_t Stream::write(uint8_t b) {
+  output += (char) b;
+  return 1;
+}
+
+size_t Stream::write(const uint8_t *bytes, size_t length) {
+  output.append((const char *) bytes, length);
+  return length;
+}
+
+void Stream::flush() {
+}
@@ -0,0 +1,53 @@
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <string>
+
+// Just enough of the Arduino core to run the firmware CmdMessenger on the
+// host. The Stream reads from a memory buffer and collects the sent bytes.
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
+unsigned long millis();
+
+#if !defined(__GLIBC__) || __GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 38)
+#define HAVE_STRLCPY
+#else
+size_t strlcpy(char *destination, const char *source, size_t size);
+#endif
+
+class Stream {
+public:
+  Stream();
+  void setInput(const char *data, size_t length);
+  int available();
+  int read();
+  int peek();
+  size_t readBytes(char *buffer, size_t length);
+  size_t print(char c);
+  size_t print(unsigned char b);
+  size_t print(int i);
+  size_t print(unsigned int i);
+  size_t print(long l);
+  size_t print(unsigned long l);
+  size_t print(double d, int digits = 2);
+  size_t print(const char *s);
+  size_t println();
+  size_t write(uint8_t b);
+  size_t write(const uint8_t *bytes, size_t length);
+  void flush();
+  std::string output;
+
+private:
+  const char *input;
+  size_t inputLength;
+  size_t inputIndex;
+};
+
+#endif // ARDUINO_H
@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <string>
+#include <CmdMessenger.h>
+#include <messages.h>
+
+// Throughput of the firmware CmdMessenger parser on the host. The commands
+// of every case are encoded with the CmdMessenger send functions, so the
+// escaping and the binary frames are exactly what a device receives. The
+// encoded bytes are then parsed and dispatched until the duration is over.
+
+static const size_t CASE_BYTES = 16 * 1024;
+
+static Stream sent;
+static Stream received;
+static CmdMessenger sender(sent);
+static CmdMessenger messenger(received);
+static bool typedRead;
+static unsigned long handled;
+static unsigned long unhandled;
+
+static double now() {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+static void onIntegers2() {
+  if (typedRead) {
+    int a, b;
+    if (messenger.read(a, b) == 0) {
+      ++handled;
+    }
+  } else {
+    messenger.readIntArg();
+    messenger.readIntArg();
+    if (messenger.isArgOk()) {
+      ++handled;
+    }
+  }
+}
+
+static void onIntegers4() {
+  if (typedRead) {
+    uint8_t mode, red, green, blue;
+    if (messenger.read(mode, red, green, blue) == 0) {
+      ++handled;
+    }
+  } else {
+    messenger.readIntArg();
+    messenger.readIntArg();
+    messenger.readIntArg();
+    messenger.readIntArg();
+    if (messenger.isArgOk()) {
+      ++handled;
+    }
+  }
+}
+
+// Floats can only be read with read()
+static void onSensorState() {
+  int sensor;
+  float value;
+  if (messenger.read(sensor, value) == 0) {
+    ++handled;
+  }
+}
+
+static void onStrings() {
+  if (typedRead) {
+    char *id, *type, *name, *description;
+    if (messenger.read(id, type, name, description) == 0) {
+      ++handled;
+    }
+  } else {
+    for (int i = 0; i < 4; ++i) {
+      messenger.readStringArg();
+    }
+    if (messenger.isArgOk()) {
+      ++handled;
+    }
+  }
+}
+
+static void onPing() {
+  ++handled;
+}
+
+static void onUnknown() {
+  ++unhandled;
+}
+
+typedef MessengerDispatch<
+  MessengerHandler<MSG_SWITCH_WRITE, onIntegers2>,
+  MessengerHandler<MSG_SWITCH_STATE, onIntegers2>,
+  MessengerHandler<MSG_PWM_WRITE, onIntegers2>,
+  MessengerHandler<MSG_RGB_WRITE, onIntegers4>,
+  MessengerHandler<MSG_SENSOR_STATE, onSensorState>,
+  MessengerHandler<MSG_REGISTER_REQUEST, onStrings>,
+  MessengerHandler<MSG_PING, onPing> > BenchHandlers;
+
+// Server writes and device answers as the switch, dimmer and sensor devices
+// exchange them
+static int encodeTypical() {
+  sender.sendCmdStart(MSG_SWITCH_WRITE);
+  sender.sendCmdArg(0);
+  sender.sendCmdArg(WRITE_TOGGLE);
+  sender.sendCmdEnd();
+  sender.sendCmdStart(MSG_SWITCH_STATE);
+  sender.sendCmdArg(0);
+  sender.sendCmdArg(1);
+  sender.sendCmdEnd();
+  sender.sendCmdStart(MSG_PWM_WRITE);
+  sender.sendCmdArg(WRITE_ABSOLUTE);
+  sender.sendCmdArg(512);
+  sender.sendCmdEnd();
+  sender.sendCmdStart(MSG_RGB_WRITE);
+  sender.sendCmdArg(WRITE_ABSOLUTE);
+  sender.sendCmdArg(255);
+  sender.sendCmdArg(128);
+  sender.sendCmdArg(0);
+  sender.sendCmdEnd();
+  sender.sendCmdStart(MSG_SENSOR_STATE);
+  sender.sendCmdArg(SENSOR_TEMPERATURE);
+  sender.sendCmdArg(21.5f);
+  sender.sendCmdEnd();
+  sender.sendCmd(MSG_PING);
+  return 6;
+}
+
+// Strings that consist of separators and escape characters only, as long
+// as they fit into the command buffer
+static int encodeEscaped() {
+  char value[8];
+  const char *special = ",;/";
+  for (int i = 0; i < 7; ++i) {
+    value[i] = special[i % 3];
+  }
+  value[7] = '\0';
+  sender.sendCmdStart(MSG_REGISTER_REQUEST);
+  for (int i = 0; i < 4; ++i) {
+    sender.sendCmdEscArg(value);
+  }
+  sender.sendCmdEnd();
+  return 1;
+}
+
+// A registration request like the real one is longer than the command buffer,
+// it is silently dropped
+static int encodeOversized() {
+  sender.sendCmdStart(MSG_REGISTER_REQUEST);
+  sender.sendCmdArg("8d3c3f3e-3ac8-4b8a-9b8b-4a1c2c9e9a51");
+  sender.sendCmdArg("Switch");
+  sender.sendCmdArg("Kitchen Lights");
+  sender.sendCmdArg("Caretaker Switch Device");
+  sender.sendCmdEnd();
+  return 1;
+}
+
+struct BenchCase {
+  const char *name;
+  int (*encode)();
+  bool binaryFrames;
+  bool typedRead;
+};
+
+static void run(const BenchCase &benchCase, double duration) {
+  sent.output.clear();
+  sender.sendBinaryFrames(benchCase.binaryFrames);
+  unsigned long commands = 0;
+  while (sent.output.length() < CASE_BYTES) {
+    commands += (*benchCase.encode)();
+  }
+  std::string data = sent.output;
+  typedRead = benchCase.typedRead;
+  handled = 0;
+  unhandled = 0;
+  unsigned long rounds = 0;
+  double start = now();
+  double elapsed;
+  do {
+    received.setInput(data.c_str(), data.length());
+    messenger.feedinSerialData();
+    ++rounds;
+    elapsed = now() - start;
+  } while (elapsed < duration);
+  double commandsPerSecond = commands * rounds / elapsed;
+  printf("%-22s %8.1f %14.0f %10.1f %9.1f%% %9.1f%%\n", benchCase.name, (double) data.length() / commands,
+    commandsPerSecond, data.length() * rounds / elapsed / 1e6, 100.0 * handled / (commands * rounds),
+    100.0 * unhandled / (commands * rounds));
+}
+
+int main(int argc, char *argv[]) {
+  double duration = argc > 1 ? atof(argv[1]) : 1.0;
+  if (duration <= 0) {
+    printf("Usage: %s [SECONDS_PER_CASE]\n", argv[0]);
+    return 1;
+  }
+  messenger.attach(BenchHandlers::dispatch);
+  messenger.attach(onUnknown);
+  static const BenchCase cases[] = {
+    {"typical text", encodeTypical, false, false},
+    {"typical text read()", encodeTypical, false, true},
+    {"typical frames", encodeTypical, true, false},
+    {"typical frames read()", encodeTypical, true, true},
+    {"escaped strings", encodeEscaped, false, false},
+    {"escaped strings read()", encodeEscaped, false, true},
+    {"oversized text", encodeOversized, false, false},
+  };
+  printf("%-22s %8s %14s %10s %10s %10s\n", "case", "bytes/cmd", "commands/s", "MB/s", "handled", "unknown");
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+    run(cases[i], duration);
+  }
+  return 0;
+}
@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <CmdMessenger.h>
+#include <messages.h>
+
+// libFuzzer target for the firmware CmdMessenger parser. The first byte of
+// the input selects the format of the answers and if the arguments are read
+// with read(), the rest is received. Every command reads its arguments with
+// the reader selected by its id and echoes them, so the argument readers,
+// the unescaping, the escaping and the frame encoding see the fuzzed data.
+//
+// Built with -DFUZZ_MAIN, the target runs the files given on the command line
+// or random commands without libFuzzer.
+
+static Stream stream;
+static CmdMessenger *messenger;
+static bool typedRead;
+
+static void echoString(const char *value) {
+  if (value == NULL) {
+    return;
+  }
+  char copy[MESSENGERBUFFERSIZE];
+  strlcpy(copy, value, sizeof(copy));
+  messenger->sendCmdEscArg(copy);
+  messenger->sendCmdfArg((char *) "%s", copy);
+}
+
+static void readTyped(uint8_t msgId) {
+  switch (msgId % 4) {
+    case 0: {
+      int a = 0;
+      long b = 0;
+      uint8_t c = 0;
+      messenger->read(a, b, c);
+      messenger->sendCmdArg(a);
+      messenger->sendCmdArg(b);
+      messenger->sendCmdArg(c);
+      break;
+    }
+    case 1: {
+      unsigned int a = 0;
+      unsigned long b = 0;
+      bool c = false;
+      messenger->read(a, b, c);
+      messenger->sendCmdArg(a);
+      messenger->sendCmdArg(b);
+      messenger->sendCmdArg(c);
+      break;
+    }
+    case 2: {
+      char a = 0;
+      float b = 0;
+      double c = 0;
+      messenger->read(a, b, c);
+      messenger->sendCmdArg(a);
+      messenger->sendCmdArg(b);
+      messenger->sendCmdArg(c);
+      break;
+    }
+    default: {
+      char *a = NULL, *b = NULL;
+      messenger->read(a, b);
+      echoString(a);
+      echoString(b);
+      break;
+    }
+  }
+}
+
+static void readClassic(uint8_t msgId) {
+  char copy[16];
+  switch (msgId % 6) {
+    case 0:
+      messenger->sendCmdArg(messenger->readIntArg());
+      messenger->sendCmdArg(messenger->readLongArg());
+      break;
+    case 1:
+      messenger->sendCmdArg(messenger->readBoolArg());
+      messenger->sendCmdArg(messenger->readCharArg());
+      break;
+    case 2:
+      echoString(messenger->readStringArg());
+      echoString(messenger->readStringArg());
+      break;
+    case 3:
+      messenger->copyStringArg(copy, sizeof(copy));
+      echoString(copy);
+      break;
+    case 4:
+      messenger->sendCmdArg(messenger->compareStringArg((char *) "Switch"));
+      break;
+    default:
+      messenger->sendCmdBinArg(messenger->readBinArg<float>());
+      messenger->sendCmdBinArg(messenger->readBinArg<int>());
+      break;
+  }
+}
+
+static bool onCommand(uint8_t msgId) {
+  messenger->sendCmdStart(msgId);
+  if (typedRead) {
+    readTyped(msgId);
+  } else {
+    readClassic(msgId);
+  }
+  messenger->sendCmdEnd();
+  return true;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  if (size == 0) {
+    return 0;
+  }
+  CmdMessenger fuzzedMessenger(stream);
+  messenger = &fuzzedMessenger;
+  messenger->attach(onCommand);
+  messenger->setAckCommands(MSG_RELIABLE, MSG_ACK);
+  messenger->sendBinaryFrames((data[0] & 1) != 0);
+  typedRead = (data[0] & 2) != 0;
+  // Copied, so that reads beyond the input are detected
+  std::vector<char> input(data + 1, data + size);
+  stream.setInput(input.data(), input.size());
+  messenger->feedinSerialData();
+  stream.output.clear();
+  return 0;
+}
+
+#ifdef FUZZ_MAIN
+static uint8_t crc8(uint8_t crc, uint8_t data) {
+  crc ^= data;
+  for (int i = 0; i < 8; ++i) {
+    crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+  }
+  return crc;
+}
+
+static void appendFrameByte(std::string &input, uint8_t b) {
+  if (b >= 0xC0 && b <= 0xC2) {
+    input += (char) 0xC2;
+    b ^= 0x20;
+  }
+  input += (char) b;
+}
+
+// Random payloads with a valid CRC, so that the frame parser doesn't only see
+// CRC errors. Some are too long for the command buffer.
+static void appendRandomFrame(std::string &input) {
+  size_t length = 1 + rand() % (rand() % 8 == 0 ? 80 : 16);
+  uint8_t crc = crc8(0, 0xC0);
+  input += (char) 0xC0;
+  for (size_t i = 0; i < length; ++i) {
+    uint8_t b = (rand() & 1) ? rand() % 8 : rand();
+    crc = crc8(crc, b);
+    appendFrameByte(input, b);
+  }
+  appendFrameByte(input, crc);
+  input += (char) 0xC1;
+}
+
+static std::string randomInput() {
+  static const char alphabet[] = "0123456789,,;;//-.\r\n\xc0\xc1\xc2\xff";
+  std::string input(1, (char) (rand() & 3));
+  size_t length = rand() % 200;
+  for (size_t i = 0; i < length; ++i) {
+    if (rand() % 16 == 0) {
+      appendRandomFrame(input);
+    } else {
+      input += (rand() & 3) == 0 ? (char) rand() : alphabet[rand() % (sizeof(alphabet) - 1)];
+    }
+  }
+  return input;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc > 1) {
+    for (int i = 1; i < argc; ++i) {
+      FILE *file = fopen(argv[i], "rb");
+      if (file == NULL) {
+        perror(argv[i]);
+        return 1;
+      }
+      std::string input;
+      char buffer[4096];
+      size_t length;
+      while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        input.append(buffer, length);
+      }
+      fclose(file);
+      LLVMFuzzerTestOneInput((const uint8_t *) input.data(), input.length());
+    }
+    printf("Ran %d inputs\n", argc - 1);
+    return 0;
+  }
+  const int runs = 1000000;
+  srand(1);
+  for (int i = 0; i < runs; ++i) {
+    std::string input = randomInput();
+    LLVMFuzzerTestOneInput((const uint8_t *) input.data(), input.length());
+  }
+  printf("Ran %d random inputs\n", runs);
+  return 0;
+}
+#endif
@@ -0,0 +1,267 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <CmdMessenger.h>
+#include <Simulator.h>
+
+// Compares the separator scanning of the simulator CmdMessenger with its byte
+// by byte parser. With --verify, random datagrams are fed to a messenger in
+// each mode and the dispatched commands, their arguments and the error
+// counters must match. Otherwise the throughput of both modes is measured on
+// datagrams with typical text commands, several per datagram like the
+// simulator sends them in a transaction.
+
+static const size_t CASE_BYTES = 16 * 1024;
+static const int ROUNDS = 10;
+
+static const char *input;
+static size_t inputLength;
+static size_t inputIndex;
+
+static void setInput(const std::string &data) {
+  input = data.data();
+  inputLength = data.length();
+  inputIndex = 0;
+}
+
+// The simulator Stream, reading from the input instead of the server
+int Stream::available() {
+  return inputLength - inputIndex;
+}
+
+int Stream::read() {
+  return inputIndex < inputLength ? (uint8_t) input[inputIndex++] : -1;
+}
+
+size_t Stream::readBytes(char *bytes, size_t length) {
+  size_t count = inputLength - inputIndex < length ? inputLength - inputIndex : length;
+  memcpy(bytes, input + inputIndex, count);
+  inputIndex += count;
+  return count;
+}
+
+size_t Stream::peekBytes(const char **bytes) {
+  *bytes = input + inputIndex;
+  return inputLength - inputIndex;
+}
+
+// Every fed input is one datagram
+bool Stream::consume(size_t length) {
+  inputIndex += length;
+  return inputIndex == inputLength;
+}
+
+size_t Stream::print(char c) {
+  buffer += c;
+  return 1;
+}
+
+size_t Stream::print(int i) {
+  std::string s = std::to_string(i);
+  buffer += s;
+  return s.length();
+}
+
+size_t Stream::print(const char *s) {
+  buffer += s;
+  return strlen(s);
+}
+
+size_t Stream::write(uint8_t b) {
+  buffer += (char) b;
+  return 1;
+}
+
+size_t Stream::write(const uint8_t *bytes, size_t length) {
+  buffer.append((const char *) bytes, length);
+  return length;
+}
+
+size_t Stream::println() {
+  buffer.clear();
+  return 1;
+}
+
+unsigned long millis() {
+  return 0;
+}
+
+static Stream stream;
+static CmdMessenger fastMessenger(stream);
+static CmdMessenger scalarMessenger(stream);
+static CmdMessenger *messenger;
+static bool recording;
+static std::string dispatched;
+static unsigned long handled;
+
+static double now() {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+// Reads the arguments with read() (in place scanning) or with the classic
+// readers (split_r()), depending on the command id
+static bool onCommand(uint8_t msgId) {
+  ++handled;
+  if (recording) {
+    dispatched += std::to_string(msgId);
+  }
+  if (msgId % 2 == 0) {
+    char *arg;
+    while (messenger->read(arg) == 0) {
+      if (recording) {
+        dispatched += ',';
+        dispatched += arg;
+      }
+    }
+  } else {
+    char *arg;
+    while ((arg = messenger->readStringArg()) != NULL) {
+      if (recording) {
+        dispatched += '|';
+        dispatched += arg;
+      }
+    }
+  }
+  if (recording) {
+    dispatched += ";\n";
+  }
+  return true;
+}
+
+static void feed(CmdMessenger &target, const std::string &datagram) {
+  messenger = &target;
+  setInput(datagram);
+  target.feedinSerialData();
+}
+
+static std::string randomDatagram() {
+  static const char alphabet[] = "0123456789abc,,,;;;///\r\n\xc0\xff";
+  std::string datagram;
+  size_t length = rand() % 160;
+  for (size_t i = 0; i < length; ++i) {
+    if (rand() % 8 == 0) {
+      // Long plain runs, so that the vector loop and the buffer overflow are hit
+      datagram.append(rand() % 40, 'a' + rand() % 26);
+    } else {
+      datagram += (rand() & 7) == 0 ? (char) rand() : alphabet[rand() % (sizeof(alphabet) - 1)];
+    }
+  }
+  return datagram;
+}
+
+static int verify(int runs) {
+  BenchMetrics &metrics = Simulator::getInstance()->getMetrics();
+  recording = true;
+  srand(1);
+  for (int i = 0; i < runs; ++i) {
+    std::string datagram = randomDatagram();
+    dispatched.clear();
+    unsigned long parseErrors = metrics.parseErrors.value;
+    unsigned long bufferResets = metrics.bufferResets.value;
+    feed(fastMessenger, datagram);
+    std::string fastDispatched = dispatched;
+    unsigned long fastParseErrors = metrics.parseErrors.value - parseErrors;
+    unsigned long fastBufferResets = metrics.bufferResets.value - bufferResets;
+    dispatched.clear();
+    parseErrors = metrics.parseErrors.value;
+    bufferResets = metrics.bufferResets.value;
+    feed(scalarMessenger, datagram);
+    if (dispatched != fastDispatched || metrics.parseErrors.value - parseErrors != fastParseErrors ||
+        metrics.bufferResets.value - bufferResets != fastBufferResets) {
+      printf("Mismatch in datagram %d:\n%s\nfast:\n%sscalar:\n%s", i, datagram.c_str(), fastDispatched.c_str(),
+        dispatched.c_str());
+      return 1;
+    }
+  }
+  printf("%d random datagrams parsed the same with both scans\n", runs);
+  return 0;
+}
+
+static std::string typicalStates() {
+  return "6,0,1;6,1,0;6,2,1;6,3,1;6,4,0;6,5,1;6,6,0;6,7,1;12,255;9,255,128,0;";
+}
+
+static std::string registrations() {
+  return "1,8d3c3f3e-3ac8-4b8a,Switch,Kitchen Lights,Switch;"
+    "1,1f6b2a4c-9d0e-4e1f,Switch8,Hall,8 port switch;";
+}
+
+static std::string escapedStrings() {
+  return "1,a/,b/;c,d//e/,f,Living Room/, East;2,x/;y/;z,//,/,,end;";
+}
+
+static std::string longArguments() {
+  return "13,temperature-sensor-living-room,brightness-sensor-hall;"
+    "14,aaaaaaaaaaaaaaaaaaaaaaaaaaaaaa,bbbbbbbbbbbbbbbbbbbbbbbbbbbbbb;";
+}
+
+struct BenchCase {
+  const char *name;
+  std::string (*datagram)();
+};
+
+static double measure(CmdMessenger &target, const std::string &data, unsigned long commands, double duration) {
+  messenger = &target;
+  unsigned long rounds = 0;
+  double start = now();
+  double elapsed;
+  do {
+    setInput(data);
+    target.feedinSerialData();
+    ++rounds;
+    elapsed = now() - start;
+  } while (elapsed < duration);
+  return commands * rounds / elapsed;
+}
+
+// Alternates between the modes and keeps the best rate of each, so that
+// frequency changes and other load affect both alike
+static void run(const BenchCase &benchCase, double duration) {
+  std::string datagram = (*benchCase.datagram)();
+  std::string data;
+  while (data.length() < CASE_BYTES) {
+    data += datagram;
+  }
+  handled = 0;
+  feed(scalarMessenger, data);
+  unsigned long commands = handled;
+  double scalar = 0;
+  double fast = 0;
+  for (int i = 0; i < ROUNDS; ++i) {
+    double rate = measure(scalarMessenger, data, commands, duration / ROUNDS / 2);
+    scalar = rate > scalar ? rate : scalar;
+    rate = measure(fastMessenger, data, commands, duration / ROUNDS / 2);
+    fast = rate > fast ? rate : fast;
+  }
+  printf("%-18s %9.1f %14.0f %14.0f %8.2fx\n", benchCase.name, (double) data.length() / commands, scalar, fast,
+    fast / scalar);
+}
+
+int main(int argc, char *argv[]) {
+  fastMessenger.attach(onCommand);
+  scalarMessenger.attach(onCommand);
+  scalarMessenger.setFastScan(false);
+  if (argc > 1 && strcmp(argv[1], "--verify") == 0) {
+    return verify(argc > 2 ? atoi(argv[2]) : 1000000);
+  }
+  double duration = argc > 1 ? atof(argv[1]) : 1.0;
+  if (duration <= 0) {
+    printf("Usage: %s [SECONDS_PER_CASE | --verify [DATAGRAMS]]\n", argv[0]);
+    return 1;
+  }
+  static const BenchCase cases[] = {
+    {"typical states", typicalStates},
+    {"registrations", registrations},
+    {"escaped strings", escapedStrings},
+    {"long arguments", longArguments},
+  };
+  printf("%-18s %9s %14s %14s %9s\n", "case", "bytes/cmd", "scalar cmd/s", "fast cmd/s", "speedup");
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+    run(cases[i], duration);
+  }
+  return 0;
+}
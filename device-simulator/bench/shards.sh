@@ -0,0 +1,33 @@
+#!/bin/bash
+# Measures how the registration time and the write throughput of simhost scale
+# with the number of shards (threads). Needs the built simhost and simserver,
+# the device state is kept in shared memory so that Redis is not measured.
+#
+# Usage: shards.sh [DEVICES [RATE [SECONDS [THREADS...]]]]
+#   e.g. ./shards.sh 2000 20000 10 1 2 4 8
+
+SIMHOST=${SIMHOST:-../host/simhost}
+SIMSERVER=${SIMSERVER:-../server/simserver}
+DEVICES=${1:-1000}
+RATE=${2:-10000}
+SECONDS_PER_RUN=${3:-5}
+[ $# -ge 3 ] && shift 3 || set --
+THREADS=${@:-1 2 4 8}
+SERVER_PORT=4100
+DEVICE_PORT=4200
+
+printf "%-8s %10s %14s %12s %8s\n" "threads" "devices" "registered s" "answered/s" "lost"
+for threads in $THREADS; do
+  $SIMSERVER -p $SERVER_PORT -d $((SECONDS_PER_RUN + 1)) switch:$RATE > server.log 2>&1 &
+  server=$!
+  sleep 0.3
+  timeout -s INT $((SECONDS_PER_RUN + 1)) $SIMHOST -p $DEVICE_PORT -s localhost:$SERVER_PORT \
+    -S shm:/caretaker-shards -j $threads switch:$DEVICES > host.log 2>&1
+  wait $server
+  registered=$(sed -n 's/.*All [0-9]* devices registered with the server \([0-9.]*\) s.*/\1/p' host.log)
+  answered=$(sed -n 's/^Total: .* \([0-9]*\) answered, \([0-9]*\) lost.*/\1 \2/p' server.log)
+  set -- $answered
+  printf "%-8s %10s %14s %12s %8s\n" $threads $DEVICES "${registered:--}" \
+    $(( ${1:-0} / (SECONDS_PER_RUN + 1) )) ${2:--}
+done
+rm -f server.log host.log
@@ -0,0 +1,33 @@
+#ifndef SIMULATOR_H
+#define SIMULATOR_H
+
+// Just the metrics of the simulator, so that the simulator CmdMessenger can
+// be benchmarked without libevent and hiredis. The counters are compared
+// between the scan modes.
+
+struct BenchCounter {
+  BenchCounter() : value(0) {}
+  void add(unsigned long n) { value += n; }
+  unsigned long value;
+};
+
+struct BenchMetrics {
+  BenchCounter parseErrors;
+  BenchCounter bufferResets;
+  BenchCounter ackRetries;
+  BenchCounter ackFailures;
+};
+
+class Simulator {
+public:
+  static Simulator *getInstance() {
+    static Simulator instance;
+    return &instance;
+  }
+  BenchMetrics &getMetrics() { return metrics; }
+
+private:
+  BenchMetrics metrics;
+};
+
+#endif // SIMULATOR_H
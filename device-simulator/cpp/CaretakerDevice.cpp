@@ -1,48 +1,110 @@
 #include <CaretakerDevice.h>
 #include <Simulator.h>
 
-static Stream stream;
-static CmdMessenger messenger(stream);
-static unsigned long register_with_server_timeout = 0;
-static bool isOperational = false;
-static DeviceDescriptor *device;
 const int REGISTER_TIMEOUT_MS = 5 * 1000;
 void onServerRegisterResponse();
+void onBinaryMode();
+void onReliableMode();
+
+typedef MessengerDispatch<
+  MessengerHandler<MSG_REGISTER_RESPONSE, onServerRegisterResponse>,
+  MessengerHandler<MSG_BINARY_MODE, onBinaryMode>,
+  MessengerHandler<MSG_RELIABLE_MODE, onReliableMode> > BaseMessageHandlers;
+
+DeviceContext::DeviceContext() : messenger(stream) {
+  registerWithServerTimeout = 0;
+  isOperational = false;
+  device = NULL;
+}
+
+static DeviceContext &context() {
+  return *Simulator::getInstance()->getDeviceContext();
+}
+
+CmdMessenger *currentMessenger() {
+  return &context().messenger;
+}
+
+static bool dispatchMessage(uint8_t msgId) {
+  DeviceDescriptor *device = context().device;
+  return BaseMessageHandlers::dispatch(msgId) || (device->dispatchMessage && (*device->dispatchMessage)(msgId));
+}
 
 void deviceInit(DeviceDescriptor& descriptor) {
-  device = &descriptor;
-  descriptor.messenger = &messenger;
+  // The descriptor is a firmware global of the thread that ran setup(), the
+  // device may move to another thread later
+  DeviceContext &ctx = context();
+  ctx.descriptor = descriptor;
+  ctx.device = &ctx.descriptor;
   if (descriptor.registerMessageHandlers) {
     (*descriptor.registerMessageHandlers)();
   }
-  messenger.printLfCr(true);
-  messenger.attach(MSG_REGISTER_RESPONSE, onServerRegisterResponse);
+  ctx.messenger.printLfCr(true);
+  ctx.messenger.setTransactionSize(Simulator::getInstance()->getMtu());
+  ctx.messenger.attach(dispatchMessage);
 }
 
+// The commands sent until the simulator ends the loop() iteration share
+// datagrams
 void deviceUpdate() {
-  messenger.feedinSerialData();
-  if (! isOperational) {
-    if (Simulator::getInstance()->getCurrentMillis() > register_with_server_timeout) {
-      Simulator::getInstance()->log("Sending registration request to server");
-      messenger.sendCmdStart(MSG_REGISTER_REQUEST);
-      messenger.sendCmdArg(Simulator::getInstance()->getDeviceId().c_str());
-      messenger.sendCmdArg(device->type);
-      messenger.sendCmdArg(Simulator::getInstance()->getDeviceName().c_str());
-      messenger.sendCmdArg(device->description);
-      if (device->sendServerRegisterParams) {
-        (*device->sendServerRegisterParams)();
+  DeviceContext &ctx = context();
+  ctx.messenger.beginTransaction();
+  ctx.messenger.feedinSerialData();
+  if (! ctx.isOperational) {
+    if (Simulator::getInstance()->getCurrentMillis() > ctx.registerWithServerTimeout) {
+      Simulator::getInstance()->log(LOG_DEBUG, "Sending registration request to server");
+      Simulator::getInstance()->getMetrics().registrationAttempts.add(1);
+      ctx.messenger.sendBinaryFrames(false);
+      ctx.messenger.setAckCommands(0, 0);
+      RegisterRequestMsg request;
+      request.id = Simulator::getInstance()->getDeviceId().c_str();
+      request.type = ctx.device->type;
+      request.name = Simulator::getInstance()->getDeviceName().c_str();
+      request.description = ctx.device->description;
+      request.start(ctx.messenger);
+      if (ctx.device->sendServerRegisterParams) {
+        (*ctx.device->sendServerRegisterParams)();
       }
-      messenger.sendCmdEnd();
-      register_with_server_timeout = Simulator::getInstance()->getCurrentMillis() + REGISTER_TIMEOUT_MS;
+      ctx.messenger.sendCmdEnd();
+      ctx.registerWithServerTimeout = Simulator::getInstance()->getCurrentMillis() + REGISTER_TIMEOUT_MS;
     }
   }
 }
 
 bool deviceIsOperational() {
-  return isOperational;
+  return context().isOperational;
 }
 
 void onServerRegisterResponse() {
   Simulator::getInstance()->log("Received registration response from server");
-  isOperational = true;
+  Simulator::getInstance()->deviceRegistered();
+  context().isOperational = true;
+}
+
+// The answer is still sent in the previous format
+void onBinaryMode() {
+  CmdMessenger &messenger = context().messenger;
+  BinaryModeMsg mode;
+  if (mode.read(messenger) != 0) {
+    return;
+  }
+  Simulator::getInstance()->log(LOG_DEBUG, "Server switched to %s", mode.enable ? "binary frames" : "text commands");
+  mode.send(messenger);
+  messenger.sendBinaryFrames(mode.enable);
+}
+
+// The states are sent plain until the server enables reliable states
+void onReliableMode() {
+  CmdMessenger &messenger = context().messenger;
+  ReliableModeMsg mode;
+  if (mode.read(messenger) != 0) {
+    return;
+  }
+  Simulator::getInstance()->log(LOG_DEBUG, "Server %s reliable states", mode.enable ? "enabled" : "disabled");
+  mode.send(messenger);
+  if (mode.enable) {
+    messenger.setAckCommands(MSG_RELIABLE, MSG_ACK);
+  } else {
+    messenger.setAckCommands(0, 0);
+  }
 }
@@ -3,6 +3,21 @@
 
 #include <CmdMessenger.h>
 #include <../../caretaker-device/src/messages.h>
+#include <../../caretaker-device/src/protocol.h>
+
+// The mutable globals of the firmware exist once per shard thread, the
+// simulator swaps them between the devices of a type on the same thread
+#define FIRMWARE_GLOBAL thread_local
+
+CmdMessenger *currentMessenger();
+
+// Stands in for the messenger pointer of the descriptor, it always refers to
+// the messenger of the device that currently runs on this thread
+struct DeviceMessenger {
+  DeviceMessenger &operator=(CmdMessenger *messenger) { return *this; }
+  CmdMessenger *operator->() const { return currentMessenger(); }
+  CmdMessenger &operator*() const { return *currentMessenger(); }
+};
 
 typedef struct _DeviceDescriptor {
   const char* type;
@@ -10,11 +25,22 @@ typedef struct _DeviceDescriptor {
   int ledPin;
   int buttonPin;
   void (*registerMessageHandlers)();
+  bool (*dispatchMessage)(uint8_t msgId);
   void (*sendServerRegisterParams)();
   void (*operationalCallback)();
-  CmdMessenger* messenger;
+  DeviceMessenger messenger;
 } DeviceDescriptor;
 
+struct DeviceContext {
+  DeviceContext();
+  Stream stream;
+  CmdMessenger messenger;
+  unsigned long registerWithServerTimeout;
+  bool isOperational;
+  DeviceDescriptor descriptor;
+  DeviceDescriptor *device;
+};
+
 void deviceInit(DeviceDescriptor& descriptor);
 void deviceUpdate();
 bool deviceIsOperational();
@@ -39,10 +39,13 @@
 extern "C" {
 #include <stdlib.h>
 #include <stdarg.h>
+#include <limits.h>
 #include <string.h>
 }
 #include <stdio.h>
 #include "CmdMessenger.h"
+#include <Simulator.h>
+#include <DelimiterScan.h>
 
 #define min(a,b) (((a)<(b))?(a):(b))
 #define max(a,b) (((a)>(b))?(a):(b))
@@ -76,10 +79,29 @@ void CmdMessenger::init(Stream &ccomms, const char fld_separator, const char cmd
     reset();
 
     default_callback  = NULL;
+    dispatch_function = NULL;
+#if MAXCALLBACKS > 0
     for (int i = 0; i < MAXCALLBACKS; i++)
         callbackList[i] = NULL;
+#endif
 
     pauseProcessing   = false;
+    binaryFrames      = false;
+    frameReceived     = false;
+    frameState        = kNoFrame;
+    transaction       = false;
+    transactionSize   = TRANSACTION_SIZE;
+    transactionBytes  = 0;
+    largestCommand    = 0;
+    reliableCommandId = 0;
+    ackCommandId      = 0;
+    lastReceivedSequence = 0;
+    receivedSequences = 0;
+    nextSequence      = 0;
+    retryingAck       = -1;
+    fastScan          = true;
+    for (uint8_t i = 0; i < MAXPENDINGACKS; i++)
+        pendingAcks[i].retry = NULL;
 }
 
 /**
@@ -101,6 +123,32 @@ void CmdMessenger::printLfCr(bool addNewLine)
     print_newlines = addNewLine;
 }
 
+/**
+ * Selects if commands are sent as binary frames or as text
+ */
+void CmdMessenger::sendBinaryFrames(bool enable)
+{
+    binaryFrames = enable;
+}
+
+/**
+ * Selects if the separators of long text commands and arguments are searched
+ * several bytes at once (default) or always byte by byte, both find the same
+ * commands and arguments
+ */
+void CmdMessenger::setFastScan(bool enable)
+{
+    fastScan = enable;
+}
+
+/**
+ * Returns if commands are sent as binary frames
+ */
+bool CmdMessenger::isSendingBinaryFrames()
+{
+    return binaryFrames;
+}
+
 /**
  * Attaches an default function for commands that are not explicitly attached
  */
@@ -109,6 +157,16 @@ void CmdMessenger::attach(messengerCallbackFunction newFunction)
     default_callback = newFunction;
 }
 
+/**
+ * Attaches a dispatch function, e.g. from MessengerDispatch, that is tried
+ * before the functions attached to command IDs
+ */
+void CmdMessenger::attach(messengerDispatchFunction newFunction)
+{
+    dispatch_function = newFunction;
+}
+
+#if MAXCALLBACKS > 0
 /**
  * Attaches a function to a command ID
  */
@@ -117,6 +175,7 @@ void CmdMessenger::attach(byte msgId, messengerCallbackFunction newFunction)
     if (msgId >= 0 && msgId < MAXCALLBACKS)
         callbackList[msgId] = newFunction;
 }
+#endif
 
 // **** Command processing ****
 
@@ -125,18 +184,25 @@ void CmdMessenger::attach(byte msgId, messengerCallbackFunction newFunction)
  */
 void CmdMessenger::feedinSerialData()
 {
+    checkPendingAcks();
     while ( !pauseProcessing && comms->available() )
 	{
-		// The Stream class has a readBytes() function that reads many bytes at once. On Teensy 2.0 and 3.0, readBytes() is optimized.
-		// Benchmarks about the incredible difference it makes: http://www.pjrc.com/teensy/benchmark_usb_serial_receive.html
-
-		size_t bytesAvailable = min(comms->available(),MAXSTREAMBUFFERSIZE);
-		comms->readBytes(streamBuffer, bytesAvailable);
+		// The simulator Stream hands out the received bytes in place, so they are
+		// processed without copying them into the stream buffer first.
+		const char *bytes;
+		size_t bytesAvailable = comms->peekBytes(&bytes);
 
-		// Process the bytes in the stream buffer, and handles dispatches callbacks, if commands are received
+		// Process the received bytes, and handles dispatches callbacks, if commands are received
 		for (size_t byteNo = 0; byteNo < bytesAvailable ; byteNo++)
 		{
-		    int messageState = processLine(streamBuffer[byteNo]);
+		    // Inside a long text command, the bytes up to the next separator or
+		    // escape character are appended at once
+		    if (fastScan && bufferIndex >= FAST_SCAN_MIN && frameState == kNoFrame && CmdlastChar != escape_character) {
+		        byteNo += appendPlainBytes(bytes + byteNo, bytesAvailable - byteNo);
+		        if (byteNo == bytesAvailable)
+		            break;
+		    }
+		    int messageState = processLine(bytes[byteNo]);
 
 			// If waiting for acknowledge command
 			if ( messageState == kEndOfMessage )
@@ -144,15 +210,62 @@ void CmdMessenger::feedinSerialData()
 				handleMessage();
 			}
 		}
+		if (comms->consume(bytesAvailable))
+		    endOfDatagram();
 	}
 }
 
+/**
+ * A command doesn't continue in the next datagram, the rest of a command that was
+ * cut off is dropped so that it doesn't run into the first command of the next one
+ */
+void CmdMessenger::endOfDatagram()
+{
+    if (bufferIndex == 0 && frameState == kNoFrame && CmdlastChar != escape_character)
+        return;
+    Simulator::getInstance()->getMetrics().parseErrors.add(1);
+    frameState  = kNoFrame;
+    CmdlastChar = '\0';
+    reset();
+}
+
+/**
+ * Updates a CRC-8 with the polynomial 0x07
+ */
+static uint8_t crc8(uint8_t crc, uint8_t data)
+{
+    crc ^= data;
+    for (uint8_t i = 0; i < 8; i++) {
+        crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+    }
+    return crc;
+}
+
 /**
  * Processes bytes and determines message state
  */
 uint8_t CmdMessenger::processLine(char serialChar)
 {
     messageState = kProccesingMessage;
+    if (frameState != kNoFrame) {
+        return processFrame(serialChar);
+    }
+    // A binary frame can only start where a text command starts, line breaks
+    // between text commands are skipped
+    if (bufferIndex == 0 && CmdlastChar != escape_character) {
+        if ((uint8_t) serialChar >= BINARY_FRAME_START) {
+            if ((uint8_t) serialChar == BINARY_FRAME_START) {
+                frameCrc = crc8(0, serialChar);
+                frameState = kFramePayload;
+            } else {
+                Simulator::getInstance()->getMetrics().parseErrors.add(1);
+            }
+            return messageState;
+        }
+        if (serialChar == '\r' || serialChar == '\n') {
+            return messageState;
+        }
+    }
     //char serialChar = (char)serialByte;
     bool escaped = isEscaped(&serialChar,escape_character,&CmdlastChar);
     //if (serialByte > 0 || escaped) {
@@ -160,6 +273,7 @@ uint8_t CmdMessenger::processLine(char serialChar)
             commandBuffer[bufferIndex]=0;
             if(bufferIndex > 0) {
                 messageState = kEndOfMessage;
+                frameReceived = false;
                 current = commandBuffer;
                 CmdlastChar='\0';
             }
@@ -167,23 +281,118 @@ uint8_t CmdMessenger::processLine(char serialChar)
         } else {
             commandBuffer[bufferIndex]=serialChar;
             bufferIndex++;
-            if (bufferIndex >= bufferLastIndex) reset();
+            if (bufferIndex >= bufferLastIndex) {
+                Simulator::getInstance()->getMetrics().bufferResets.add(1);
+                reset();
+            }
         }
     //}
     return messageState;
 }
 
+/**
+ * Appends the bytes before the next command separator or escape character to
+ * the command buffer, like processLine() does byte by byte. Stops after a
+ * buffer overflow, so that processLine() sees the start of the next command.
+ * Returns the number of appended bytes
+ */
+size_t CmdMessenger::appendPlainBytes(const char *bytes, size_t length)
+{
+    size_t plain = findDelimiter(bytes, length, command_separator, escape_character, escape_character);
+    if (plain == 0)
+        return 0;
+    size_t room = bufferLastIndex - bufferIndex;
+    size_t count = plain < room ? plain : room;
+    memcpy(commandBuffer + bufferIndex, bytes, count);
+    bufferIndex += count;
+    CmdlastChar = bytes[count - 1];
+    messageState = kProccesingMessage;
+    if (bufferIndex >= bufferLastIndex) {
+        Simulator::getInstance()->getMetrics().bufferResets.add(1);
+        reset();
+    }
+    return count;
+}
+
+/**
+ * Processes a byte of a binary frame and determines message state
+ */
+uint8_t CmdMessenger::processFrame(uint8_t serialByte)
+{
+    if (serialByte == BINARY_FRAME_START) {
+        // The end of the previous frame got lost
+        Simulator::getInstance()->getMetrics().parseErrors.add(1);
+        reset();
+        frameCrc = crc8(0, serialByte);
+        frameState = kFramePayload;
+        return messageState;
+    }
+    if (serialByte == BINARY_FRAME_END) {
+        // The CRC of the payload followed by its CRC is 0
+        uint8_t length = bufferIndex - 1;
+        bool valid = frameState == kFramePayload && bufferIndex > 1 && frameCrc == 0;
+        if (!valid && frameState != kFrameOverflow) {
+            Simulator::getInstance()->getMetrics().parseErrors.add(1);
+        }
+        frameState = kNoFrame;
+        reset();
+        if (valid) {
+            messageState = kEndOfMessage;
+            frameReceived = true;
+            current = commandBuffer;
+            last = commandBuffer + length;
+        }
+        return messageState;
+    }
+    if (frameState == kFrameOverflow) {
+        return messageState;
+    }
+    if (serialByte == BINARY_FRAME_ESCAPE) {
+        frameState = kFrameEscape;
+        return messageState;
+    }
+    if (frameState == kFrameEscape) {
+        serialByte ^= 0x20;
+        frameState = kFramePayload;
+    }
+    if (bufferIndex == bufferLength) {
+        Simulator::getInstance()->getMetrics().bufferResets.add(1);
+        frameState = kFrameOverflow;
+        return messageState;
+    }
+    commandBuffer[bufferIndex++] = serialByte;
+    frameCrc = crc8(frameCrc, serialByte);
+    return messageState;
+}
+
 /**
  * Dispatches attached callbacks based on command
  */
 void CmdMessenger::handleMessage()
 {
     lastCommandId = readIntArg();
+    if (ArgOk && reliableCommandId != 0) {
+        if (lastCommandId == ackCommandId) {
+            receiveAck();
+            return;
+        }
+        if (lastCommandId == reliableCommandId && !unwrapReliable())
+            return;
+    }
     // if command attached, we will call it
-    if (lastCommandId >= 0 && lastCommandId < MAXCALLBACKS && ArgOk && callbackList[lastCommandId] != NULL)
-        (*callbackList[lastCommandId])();
-    else // If command not attached, call default callback (if attached)
-        if (default_callback!=NULL) (*default_callback)();
+    if (ArgOk) {
+        if (dispatch_function != NULL && (*dispatch_function)(lastCommandId))
+            return;
+#if MAXCALLBACKS > 0
+        if (lastCommandId < MAXCALLBACKS && callbackList[lastCommandId] != NULL) {
+            (*callbackList[lastCommandId])();
+            return;
+        }
+#endif
+    }
+    // If command not attached, call default callback (if attached)
+    Simulator::getInstance()->getMetrics().parseErrors.add(1);
+    if (default_callback!=NULL) (*default_callback)();
 }
 
 
@@ -229,6 +438,14 @@ bool CmdMessenger::CheckForAck(int AckCommand)
 bool CmdMessenger::next()
 {
     char * temppointer= NULL;
+    // The arguments of a binary frame are read in place
+    if (frameReceived) {
+        if (messageState == kProccesingMessage) {
+            return false;
+        }
+        messageState = kProcessingArguments;
+        return current < last;
+    }
     // Currently, cmd messenger only supports 1 char for the field seperator
     switch (messageState) {
     case kProccesingMessage:
@@ -279,9 +496,19 @@ uint8_t CmdMessenger::CommandID()
 void CmdMessenger::sendCmdStart(int cmdId)
 {
     if (!startCommand) {
+		if (transactionBytes > 0 && transactionBytes + largestCommand > transactionSize) {
+			sendLineEnd();
+		}
 		startCommand   = true;
 		pauseProcessing = true;
-		comms->print(cmdId);
+		commandBytes   = 0;
+		if (binaryFrames) {
+			commandBytes = comms->write(BINARY_FRAME_START);
+			sentFrameCrc = crc8(0, BINARY_FRAME_START);
+			writeFrameVarint(cmdId);
+			return;
+		}
+		commandBytes = comms->print(cmdId);
 	}
 }
 
@@ -291,7 +518,11 @@ void CmdMessenger::sendCmdStart(int cmdId)
 void CmdMessenger::sendCmdEscArg(char* arg)
 {
     if (startCommand) {
-        comms->print(field_separator);
+        if (binaryFrames) {
+            writeFrameArg(arg);
+            return;
+        }
+        commandBytes += comms->print(field_separator);
         printEsc(arg);
     }
 }
@@ -306,11 +537,15 @@ void CmdMessenger::sendCmdfArg(char *fmt, ...)
         char msg[128];
         va_list args;
         va_start (args, fmt );
-        vsnprintf(msg, 188, fmt, args);
+        vsnprintf(msg, sizeof(msg), fmt, args);
         va_end (args);
 
-        comms->print(field_separator);
-        comms->print(msg);
+        if (binaryFrames) {
+            writeFrameArg(msg);
+            return;
+        }
+        commandBytes += comms->print(field_separator);
+        commandBytes += comms->print(msg);
     }
 }
 
@@ -321,9 +556,19 @@ bool CmdMessenger::sendCmdEnd(bool reqAc, int ackCmdId, int timeout)
 {
     bool ackReply = false;
     if (startCommand) {
-        comms->print(command_separator);
-        if(print_newlines)
-            comms->println(); // should append BOTH \r\n
+        if (binaryFrames) {
+            printFrameByte(sentFrameCrc);
+            commandBytes += comms->write(BINARY_FRAME_END);
+        } else {
+            commandBytes += comms->print(command_separator);
+        }
+        if (commandBytes > largestCommand) {
+            largestCommand = commandBytes;
+        }
+        transactionBytes += commandBytes;
+        if (!transaction || reqAc) {
+            sendLineEnd();
+        }
         if (reqAc) {
             ackReply = blockedTillReply(timeout, ackCmdId);
         }
@@ -333,13 +578,304 @@ bool CmdMessenger::sendCmdEnd(bool reqAc, int ackCmdId, int timeout)
     return ackReply;
 }
 
+// **** Transactions ****
+
+/**
+ * Start a transaction. The line end after the sent commands is deferred, so
+ * that the commands sent until endTransaction() share lines (datagrams) of up
+ * to setTransactionSize() bytes. A command is only appended to a line if a
+ * command as large as the largest one of the transaction still fits
+ */
+void CmdMessenger::beginTransaction()
+{
+    if (!transaction) {
+        transaction = true;
+        largestCommand = 0;
+    }
+}
+
+/**
+ * Send the line end after the commands of the transaction so far, the
+ * transaction continues
+ */
+void CmdMessenger::flushTransaction()
+{
+    sendLineEnd();
+}
+
+/**
+ * End the transaction and send the line end after its pending commands
+ */
+void CmdMessenger::endTransaction()
+{
+    transaction = false;
+    sendLineEnd();
+}
+
+/**
+ * Set the maximum size of the commands sent between two line ends, 0 ends
+ * every command with a line end
+ */
+void CmdMessenger::setTransactionSize(uint16_t size)
+{
+    transactionSize = size;
+}
+
+/**
+ * Send the line end after the pending commands
+ */
+void CmdMessenger::sendLineEnd()
+{
+    if (transactionBytes > 0 && print_newlines) {
+        comms->println(); // should append BOTH \r\n
+    }
+    transactionBytes = 0;
+}
+
+// **** Reliable commands ****
+
+/**
+ * Enables reliable commands with the IDs of the wrapper command and the ack,
+ * both must be handled by every receiver. A reliable command ID of 0 disables
+ * them again and gives up the pending commands
+ */
+void CmdMessenger::setAckCommands(uint8_t reliableCmdId, uint8_t ackCmdId)
+{
+    reliableCommandId = reliableCmdId;
+    ackCommandId      = ackCmdId;
+    receivedSequences = 0;
+    if (reliableCmdId == 0) {
+        for (uint8_t i = 0; i < MAXPENDINGACKS; i++)
+            pendingAcks[i].retry = NULL;
+    }
+}
+
+/**
+ * Send start of a command that is sent again until the receiver acknowledges
+ * it. After timeout milliseconds without the ack, retry is called with the
+ * context to send the command again, with its current state. Called from
+ * retry, the command keeps its sequence number. Returns false if the command
+ * is sent without waiting for an ack, because reliable commands are disabled
+ * or too many of them are pending
+ */
+bool CmdMessenger::sendReliableCmdStart(int cmdId, messengerRetryFunction retry, uint8_t context, uint16_t timeout, uint8_t retries)
+{
+    if (startCommand)
+        return false;
+    int8_t index = retryingAck;
+    retryingAck = -1;
+    if (index < 0 && reliableCommandId != 0 && retry != NULL) {
+        for (uint8_t i = 0; i < MAXPENDINGACKS; i++) {
+            if (pendingAcks[i].retry == NULL) {
+                index = i;
+                pendingAcks[i].sequence = nextSequence++;
+                pendingAcks[i].retries  = retries;
+                break;
+            }
+        }
+    }
+    if (index < 0) {
+        sendCmdStart(cmdId);
+        return false;
+    }
+    PendingAck &pending = pendingAcks[index];
+    pending.retry      = retry;
+    pending.context    = context;
+    pending.timeout    = timeout;
+    pending.sentMillis = millis();
+    sendCmdStart(reliableCommandId);
+    sendCmdArg((int) pending.sequence);
+    sendCmdArg(cmdId);
+    return true;
+}
+
+/**
+ * Frees the pending ack that a received ack answers
+ */
+void CmdMessenger::receiveAck()
+{
+    uint8_t sequence = readIntArg();
+    if (!ArgOk)
+        return;
+    for (uint8_t i = 0; i < MAXPENDINGACKS; i++) {
+        if (pendingAcks[i].retry != NULL && pendingAcks[i].sequence == sequence) {
+            pendingAcks[i].retry = NULL;
+            return;
+        }
+    }
+}
+
+/**
+ * Acknowledges a received reliable command and reads the ID of the wrapped command.
+ * Returns false if the command is a retry whose first copy was already received
+ */
+bool CmdMessenger::unwrapReliable()
+{
+    uint8_t sequence = readIntArg();
+    lastCommandId = readIntArg();
+    if (!ArgOk)
+        return true;
+    sendCmdStart(ackCommandId);
+    sendCmdArg((int) sequence);
+    sendCmdEnd();
+    return firstReceipt(sequence);
+}
+
+/**
+ * Records the sequence number of a received reliable command, returns false if it was
+ * received before. Sequence numbers more than 32 behind the last one count as new
+ */
+bool CmdMessenger::firstReceipt(uint8_t sequence)
+{
+    uint8_t ahead = sequence - lastReceivedSequence;
+    if (receivedSequences == 0 || (ahead != 0 && ahead < 128)) {
+        receivedSequences = receivedSequences == 0 || ahead >= 32 ? 1 : (receivedSequences << ahead) | 1;
+        lastReceivedSequence = sequence;
+        return true;
+    }
+    uint8_t behind = lastReceivedSequence - sequence;
+    if (behind >= 32)
+        return true;
+    uint32_t bit = (uint32_t) 1 << behind;
+    if (receivedSequences & bit)
+        return false;
+    receivedSequences |= bit;
+    return true;
+}
+
+/**
+ * Calls the retry functions of the reliable commands whose ack is overdue and
+ * gives up the commands without retries left
+ */
+void CmdMessenger::checkPendingAcks()
+{
+    unsigned long now = millis();
+    for (uint8_t i = 0; i < MAXPENDINGACKS; i++) {
+        PendingAck &pending = pendingAcks[i];
+        if (pending.retry == NULL || now - pending.sentMillis < pending.timeout)
+            continue;
+        if (pending.retries == 0) {
+            Simulator::getInstance()->getMetrics().ackFailures.add(1);
+            pending.retry = NULL;
+            continue;
+        }
+        Simulator::getInstance()->getMetrics().ackRetries.add(1);
+        pending.retries--;
+        retryingAck = i;
+        (*pending.retry)(pending.context);
+        // The retry function didn't send the command again
+        if (retryingAck == i) {
+            retryingAck = -1;
+            pending.retry = NULL;
+        }
+    }
+}
+
+// **** Binary frame sending ****
+
+/**
+ * Send a payload byte of the frame being sent and add it to its CRC
+ */
+void CmdMessenger::writeFrameByte(uint8_t value)
+{
+    sentFrameCrc = crc8(sentFrameCrc, value);
+    printFrameByte(value);
+}
+
+/**
+ * Send a payload or CRC byte, escaped if it could be taken for a frame start or end
+ */
+void CmdMessenger::printFrameByte(uint8_t value)
+{
+    if (value >= BINARY_FRAME_START && value <= BINARY_FRAME_ESCAPE) {
+        commandBytes += comms->write(BINARY_FRAME_ESCAPE);
+        value ^= 0x20;
+    }
+    commandBytes += comms->write(value);
+}
+
+/**
+ * Append an integer as zigzag varint, small negative numbers stay short
+ */
+void CmdMessenger::writeFrameVarint(long value)
+{
+    unsigned long zigzag = ((unsigned long) value << 1) ^ (unsigned long) (value >> (sizeof(long) * 8 - 1));
+    while (zigzag >= 0x80) {
+        writeFrameByte((zigzag & 0x7f) | 0x80);
+        zigzag >>= 7;
+    }
+    writeFrameByte(zigzag);
+}
+
+/**
+ * Append a length byte followed by the bytes
+ */
+void CmdMessenger::writeFrameBytes(const char *bytes, uint8_t length)
+{
+    writeFrameByte(length);
+    for (uint8_t i = 0; i < length; i++) {
+        writeFrameByte(bytes[i]);
+    }
+}
+
+/**
+ * Append a float as fixed point number
+ */
+void CmdMessenger::writeFrameArg(double value)
+{
+    writeFrameVarint(value < 0 ? (long) (value * FIXED_POINT_SCALE - 0.5) : (long) (value * FIXED_POINT_SCALE + 0.5));
+}
+
 // **** Command receiving ****
 
+/**
+ * Read the next argument of a binary frame as zigzag varint
+ */
+long CmdMessenger::readFrameVarint()
+{
+    unsigned long zigzag = 0;
+    uint8_t shift = 0;
+    while (current < last && shift < sizeof(long) * 8) {
+        uint8_t value = *current++;
+        zigzag |= (unsigned long) (value & 0x7f) << shift;
+        if ((value & 0x80) == 0) {
+            ArgOk = true;
+            return (long) (zigzag >> 1) ^ -(long) (zigzag & 1);
+        }
+        shift += 7;
+    }
+    current = last;
+    ArgOk = false;
+    return 0;
+}
+
+/**
+ * Read the next argument of a binary frame as length and bytes.
+ * The bytes are moved over the length and terminated with \0 in place.
+ */
+char *CmdMessenger::readFrameBytes(uint8_t *length)
+{
+    *length = (uint8_t) *current;
+    if (*length >= last - current) {
+        current = last;
+        ArgOk = false;
+        return NULL;
+    }
+    char *bytes = current;
+    memmove(bytes, bytes + 1, *length);
+    bytes[*length] = '\0';
+    current += *length + 1;
+    ArgOk = true;
+    return bytes;
+}
+
 /**
  * Find next argument in command
  */
 int CmdMessenger::findNext(char *str, char delim)
 {
+    if (fastScan)
+        return findFieldEnd(str) - str;
     int pos = 0;
     bool escaped;
     ArglastChar = 0;
@@ -355,6 +891,43 @@ int CmdMessenger::findNext(char *str, char delim)
     return pos;
 }
 
+/**
+ * Returns the first unescaped field separator or the terminating '\0' of the
+ * text command argument that starts at field. Short arguments, like most
+ * numbers, are found faster byte by byte than with the several bytes scan
+ */
+char *CmdMessenger::findFieldEnd(char *field)
+{
+    char *scalarEnd = field + FAST_SCAN_MIN;
+    bool escaped = false;
+    while (*field != '\0' && (escaped || *field != field_separator)) {
+        if (fastScan && !escaped && field >= scalarEnd)
+            return findLongFieldEnd(field);
+        escaped = !escaped && *field == escape_character;
+        field++;
+    }
+    return field;
+}
+
+/**
+ * findFieldEnd() for the rest of a long argument, which starts with an
+ * unescaped byte
+ */
+char *CmdMessenger::findLongFieldEnd(char *field)
+{
+    // The command is terminated within the buffer, its end bounds the scan
+    char *bufferEnd = commandBuffer + bufferLength;
+    for (;;) {
+        field += findDelimiter(field, bufferEnd - field, field_separator, escape_character, '\0');
+        if (field >= bufferEnd || *field != escape_character)
+            return field;
+        // Skip the escape character and the escaped one
+        if (*++field == '\0')
+            return field;
+        field++;
+    }
+}
+
 /**
  * Read the next argument as int
  */
@@ -362,6 +935,9 @@ int CmdMessenger::readIntArg()
 {
     if (next()) {
         dumped = true;
+        if (frameReceived) {
+            return readFrameVarint();
+        }
 		ArgOk  = true;
         return atoi(current);
     }
@@ -376,6 +952,9 @@ long CmdMessenger::readLongArg()
 {
     if (next()) {
         dumped = true;
+        if (frameReceived) {
+            return readFrameVarint();
+        }
 		ArgOk  = true;
         return atol(current);
     }
@@ -399,6 +978,11 @@ char CmdMessenger::readCharArg()
 {
     if (next()) {
         dumped = true;
+        if (frameReceived) {
+            uint8_t length;
+            char *bytes = readFrameBytes(&length);
+            return bytes != NULL ? bytes[0] : 0;
+        }
 		ArgOk  = true;
         return current[0];
     }
@@ -428,11 +1012,15 @@ char* CmdMessenger::readStringArg()
 {
     if (next()) {
         dumped = true;
+        if (frameReceived) {
+            uint8_t length;
+            return readFrameBytes(&length);
+        }
 		ArgOk  = true;
         return current;
     }
 	ArgOk  = false;
-    return '\0';
+    return NULL;
 }
 
 /**
@@ -443,6 +1031,16 @@ void CmdMessenger::copyStringArg(char *string, uint8_t size)
 {
     if (next()) {
         dumped = true;
+        if (frameReceived) {
+            uint8_t length;
+            char *bytes = readFrameBytes(&length);
+            if (bytes != NULL) {
+                strlcpy(string,bytes,size);
+            } else if ( size ) {
+                string[0] = '\0';
+            }
+            return;
+        }
 		ArgOk  = true;
         strlcpy(string,current,size);
     } else {
@@ -457,6 +1055,17 @@ void CmdMessenger::copyStringArg(char *string, uint8_t size)
 uint8_t CmdMessenger::compareStringArg(char *string)
 {
     if (next()) {
+        // A binary argument is only consumed if it matches
+        if (frameReceived) {
+            uint8_t length = (uint8_t) *current;
+            if ( length < last - current && length == strlen(string) && memcmp(string,current + 1,length) == 0 ) {
+                dumped = true;
+                readFrameBytes(&length);
+                return 1;
+            }
+            ArgOk  = false;
+            return 0;
+        }
         if ( strcmp(string,current) == 0 ) {
             dumped = true;
 			ArgOk  = true;
@@ -469,6 +1078,212 @@ uint8_t CmdMessenger::compareStringArg(char *string)
 	return 0;
 }
 
+// **** Multi argument receiving ****
+
+/**
+ * Returns the next text argument, terminated in place
+ * Note that unlike split_r, empty arguments are not skipped
+ */
+char* CmdMessenger::nextField()
+{
+    char *field;
+    switch (messageState) {
+    case kProccesingMessage:
+        return NULL;
+    case kEndOfMessage:
+        field = commandBuffer;
+        messageState = kProcessingArguments;
+        break;
+    default:
+        field = last;
+    }
+    if (field == NULL || *field == '\0') {
+        ArgOk = false;
+        return NULL;
+    }
+    char *end = findFieldEnd(field);
+    if (*end != '\0') {
+        *end++ = '\0';
+    }
+    last    = end;
+    current = field;
+    dumped  = true;
+    ArgOk   = true;
+    return field;
+}
+
+/**
+ * Read the next argument as long, the whole argument must be a number
+ */
+bool CmdMessenger::readField(long &value)
+{
+    if (frameReceived) {
+        if (!next())
+            return false;
+        value = readFrameVarint();
+        return ArgOk;
+    }
+    char *digit = nextField();
+    if (digit == NULL)
+        return false;
+    bool negative = *digit == '-';
+    if (negative || *digit == '+')
+        digit++;
+    ArgOk = *digit != '\0';
+    value = 0;
+    while (*digit >= '0' && *digit <= '9')
+        value = value * 10 + (*digit++ - '0');
+    if (*digit != '\0')
+        ArgOk = false;
+    if (negative)
+        value = -value;
+    return ArgOk;
+}
+
+/**
+ * Read the next argument as int
+ */
+bool CmdMessenger::readField(int &value)
+{
+    long number;
+    if (!readField(number) || number < INT_MIN || number > INT_MAX)
+        return ArgOk = false;
+    value = number;
+    return true;
+}
+
+/**
+ * Read the next argument as unsigned int
+ */
+bool CmdMessenger::readField(unsigned int &value)
+{
+    long number;
+    if (!readField(number) || number < 0 || (unsigned long) number > UINT_MAX)
+        return ArgOk = false;
+    value = number;
+    return true;
+}
+
+/**
+ * Read the next argument as unsigned long
+ */
+bool CmdMessenger::readField(unsigned long &value)
+{
+    long number;
+    if (!readField(number) || number < 0)
+        return ArgOk = false;
+    value = number;
+    return true;
+}
+
+/**
+ * Read the next argument as byte
+ */
+bool CmdMessenger::readField(uint8_t &value)
+{
+    long number;
+    if (!readField(number) || number < 0 || number > 255)
+        return ArgOk = false;
+    value = number;
+    return true;
+}
+
+/**
+ * Read the next argument as bool
+ */
+bool CmdMessenger::readField(bool &value)
+{
+    long number;
+    if (!readField(number))
+        return false;
+    value = number != 0;
+    return true;
+}
+
+/**
+ * Read the next argument as char
+ */
+bool CmdMessenger::readField(char &value)
+{
+    char *string;
+    if (!readField(string) || string[0] == '\0')
+        return ArgOk = false;
+    value = string[0];
+    return true;
+}
+
+/**
+ * Read the next argument as double
+ */
+bool CmdMessenger::readField(double &value)
+{
+    if (frameReceived) {
+        if (!next())
+            return false;
+        value = (double) readFrameVarint() / FIXED_POINT_SCALE;
+        return ArgOk;
+    }
+    char *field = nextField();
+    if (field == NULL)
+        return false;
+    char *end;
+    value = strtod(field, &end);
+    return ArgOk = end != field && *end == '\0';
+}
+
+/**
+ * Read the next argument as float
+ */
+bool CmdMessenger::readField(float &value)
+{
+    double number;
+    if (!readField(number))
+        return false;
+    value = number;
+    return true;
+}
+
+/**
+ * Read the next argument as string
+ * Note that the String is valid until the current command is replaced
+ */
+bool CmdMessenger::readField(char *&value)
+{
+    if (frameReceived) {
+        uint8_t length;
+        if (!next())
+            return false;
+        value = readFrameBytes(&length);
+        return ArgOk;
+    }
+    value = nextField();
+    if (value == NULL)
+        return false;
+    unescape(value);
+    return true;
+}
+
+/**
+ * Read a string argument in place like readField(char *&)
+ */
+bool CmdMessenger::readField(const char *&value)
+{
+    char *field;
+    if (!readField(field))
+        return false;
+    value = field;
+    return true;
+}
+
+/**
+ * Called with the number of the argument that read() couldn't read
+ */
+uint8_t CmdMessenger::readFailed(uint8_t argNumber)
+{
+    Simulator::getInstance()->getMetrics().parseErrors.add(1);
+    return argNumber;
+}
+
 // **** Escaping tools ****
 
 /**
@@ -556,7 +1371,7 @@ void CmdMessenger::printEsc(char *str)
 void CmdMessenger::printEsc(char str)
 {
     if (str==field_separator || str==command_separator || str==escape_character || str=='\0') {
-        comms->print(escape_character);
+        commandBytes += comms->print(escape_character);
     }
-    comms->print(str);
+    commandBytes += comms->print(str);
 }
@@ -26,6 +26,7 @@
 #define CmdMessenger_h
 
 #include <inttypes.h>
+#include <string.h>
 #if ARDUINO >= 100
 #include <Arduino.h>
 #else
@@ -42,12 +43,31 @@ extern "C"
 {
   // callback functions always follow the signature: void cmd(void);
   typedef void (*messengerCallbackFunction) (void);
+  // dispatch functions call the callback of a command and return false for unknown commands
+  typedef bool (*messengerDispatchFunction) (uint8_t);
+  // retry functions send an unacknowledged reliable command again, they get its context
+  typedef void (*messengerRetryFunction) (uint8_t);
 }
 
-#define MAXCALLBACKS        50   // The maximum number of commands   (default: 50)
+#ifndef MAXCALLBACKS
+#define MAXCALLBACKS        50   // The maximum number of commands, 0 if only dispatch functions are used (default: 50)
+#endif
 #define MESSENGERBUFFERSIZE 64   // The maximum length of the buffer (default: 64)
 #define MAXSTREAMBUFFERSIZE 32   // The maximum length of the buffer (default: 32)
 #define DEFAULT_TIMEOUT     5000 // Time out on unanswered messages. (default: 5s)
+#define BINARY_FRAME_START  0xC0 // Starts a binary frame, bytes from 0xC0 on never start a text command
+#define BINARY_FRAME_END    0xC1 // Ends a binary frame
+#define BINARY_FRAME_ESCAPE 0xC2 // Followed by a frame byte from 0xC0 to 0xC2 xor 0x20
+#define FIXED_POINT_SCALE   100  // Floats are sent in binary frames as round(value * 100)
+#define FAST_SCAN_MIN       16   // Commands and arguments are scanned byte by byte up to this length
+#ifndef TRANSACTION_SIZE
+#define TRANSACTION_SIZE    128  // The maximum size of the commands sent between two line ends in a transaction
+#endif
+#ifndef MAXPENDINGACKS
+#define MAXPENDINGACKS      4    // The maximum number of reliable commands waiting for their ack (default: 4)
+#endif
+#define ACK_TIMEOUT         500  // Time after which an unacknowledged reliable command is sent again (default: 0.5s)
+#define ACK_RETRIES         3    // How often an unacknowledged reliable command is sent again (default: 3)
 
 // Message States
 enum
@@ -57,6 +77,33 @@ enum
   kProcessingArguments,			 // Message is received, arguments are being read parsed
 };
 
+// Binary frames: BINARY_FRAME_START, payload, CRC-8 (polynomial 0x07) of the start byte and
+// the payload, BINARY_FRAME_END. Payload and CRC bytes from 0xC0 to 0xC2 are escaped with
+// BINARY_FRAME_ESCAPE, so frames are written and read byte by byte without knowing their
+// length first. The payload holds the command id and the arguments without separators:
+// integers as zigzag varints, floats as fixed point varints and strings, chars and binary
+// arguments as length byte followed by the bytes. Arguments must be read with the type they
+// were sent with. Frames are received in any mode, sendBinaryFrames() selects the format of
+// the sent commands.
+
+// Reliable commands: <reliable cmd id>,<sequence number>,<cmd id>,<args>; is answered with
+// <ack cmd id>,<sequence number>; and the wrapped command is dispatched like any other.
+// The sender keeps the command in a table of pending acks that feedinSerialData() checks.
+// When the ack doesn't arrive in time, the retry function of the command is called, it
+// sends the command again with sendReliableCmdStart() and the same sequence number. The
+// command is given up after its last retry. A retried command whose first copy arrived
+// is acknowledged again but not dispatched, the receiver remembers the last 32 sequence
+// numbers.
+
+// Binary Frame States
+enum
+{
+  kNoFrame,                      // Not receiving a binary frame
+  kFramePayload,                 // Receiving the payload and the CRC
+  kFrameEscape,                  // Received BINARY_FRAME_ESCAPE, the next byte is escaped
+  kFrameOverflow,                // The frame didn't fit into the buffer, waiting for its end
+};
+
 class CmdMessenger
 {
 private:
@@ -81,13 +128,44 @@ private:
   char *last;                       // Pointer to previous buffer position
   char prevChar;                    // Previous char (needed for unescaping)
   Stream *comms;                    // Serial data stream
+  bool binaryFrames;                // Indicates if commands are sent as binary frames
+  bool frameReceived;               // Indicates if the current command was received as binary frame
+  uint8_t frameState;               // Current state of binary frame receiving
+  uint8_t frameCrc;                 // CRC of the binary frame being received
+  uint8_t sentFrameCrc;             // CRC of the binary frame being sent
+  bool fastScan;                    // Indicates if separators are searched several bytes at once
+  bool transaction;                 // Indicates if the line end after sent commands is deferred
+  uint16_t transactionSize;         // The maximum size of the commands sent between two line ends
+  uint16_t transactionBytes;        // Size of the commands sent since the last line end
+  uint16_t commandBytes;            // Size of the command being sent
+  uint16_t largestCommand;          // Size of the largest command of the transaction
+  uint8_t reliableCommandId;        // ID that wraps reliable commands, 0 if they are disabled
+  uint8_t ackCommandId;             // ID of the acks of reliable commands
+  uint8_t lastReceivedSequence;     // Highest sequence number of the received reliable commands
+  uint32_t receivedSequences;       // Bit n is set if lastReceivedSequence - n was received
+  uint8_t nextSequence;             // Sequence number of the next reliable command
+  int8_t retryingAck;               // Index of the pending ack whose retry function runs, -1 otherwise
 
   char command_separator;           // Character indicating end of command (default: ';')
   char field_separator;				// Character indicating end of argument (default: ',')
   char escape_character;		    // Character indicating escaping of special chars
 
   messengerCallbackFunction default_callback;            // default callback function
+  messengerDispatchFunction dispatch_function;           // dispatch function, tried before the callbacks
+#if MAXCALLBACKS > 0
   messengerCallbackFunction callbackList[MAXCALLBACKS];  // list of attached callback functions
+#endif
+
+  struct PendingAck
+  {
+    messengerRetryFunction retry;   // retry function, NULL if the entry is free
+    unsigned long sentMillis;       // when the command was sent the last time
+    uint16_t timeout;               // time to wait for the ack
+    uint8_t sequence;               // sequence number of the command
+    uint8_t retries;                // how often the command is still sent again
+    uint8_t context;                // passed to the retry function
+  };
+  PendingAck pendingAcks[MAXPENDINGACKS]; // reliable commands waiting for their ack
 
   // ****** Private functions ******
 
@@ -95,14 +173,24 @@ private:
 
   void init (Stream & comms, const char fld_separator, const char cmd_separator, const char esc_character);
   void reset ();
+  void endOfDatagram ();
 
   // **** Command processing ****
 
   inline uint8_t processLine (char serialChar) __attribute__((always_inline));
+  inline size_t appendPlainBytes (const char *bytes, size_t length) __attribute__((always_inline));
+  uint8_t processFrame (uint8_t serialByte);
   inline void handleMessage() __attribute__((always_inline));
   inline bool blockedTillReply (unsigned long timeout = DEFAULT_TIMEOUT, int ackCmdId = 1) __attribute__((always_inline));
   inline bool CheckForAck (int AckCommand) __attribute__((always_inline));
 
+  // **** Reliable commands ****
+
+  void receiveAck ();
+  bool unwrapReliable ();
+  bool firstReceipt (uint8_t sequence);
+  void checkPendingAcks ();
+
   // **** Command sending ****
 
   /**
@@ -119,9 +207,57 @@ private:
       }
   }
 
+  // **** Binary frame sending ****
+
+  void writeFrameByte (uint8_t value);
+  void printFrameByte (uint8_t value);
+  void writeFrameVarint (long value);
+  void writeFrameBytes (const char *bytes, uint8_t length);
+  void writeFrameArg (int value) { writeFrameVarint (value); }
+  void writeFrameArg (unsigned int value) { writeFrameVarint (value); }
+  void writeFrameArg (long value) { writeFrameVarint (value); }
+  void writeFrameArg (unsigned long value) { writeFrameVarint (value); }
+  void writeFrameArg (char value) { writeFrameBytes (&value, 1); }
+  void writeFrameArg (double value);
+  void writeFrameArg (const char *value) { writeFrameBytes (value, strlen (value)); }
+
   // **** Command receiving ****
 
   int findNext (char *str, char delim);
+  char *findFieldEnd (char *field);
+  char *findLongFieldEnd (char *field);
+  long readFrameVarint ();
+  char *readFrameBytes (uint8_t *length);
+
+  // **** Multi argument receiving ****
+
+  char *nextField ();
+  bool readField (long &value);
+  bool readField (int &value);
+  bool readField (unsigned int &value);
+  bool readField (unsigned long &value);
+  bool readField (uint8_t &value);
+  bool readField (bool &value);
+  bool readField (char &value);
+  bool readField (double &value);
+  bool readField (float &value);
+  bool readField (char *&value);
+  bool readField (const char *&value);
+  uint8_t readFailed (uint8_t argNumber);
+
+#if __cplusplus >= 201103L
+  uint8_t readFields (uint8_t argNumber)
+  {
+    return 0;
+  }
+
+  template < class T, class... Rest > uint8_t readFields (uint8_t argNumber, T &arg, Rest &... rest)
+  {
+    if (!readField (arg))
+      return readFailed (argNumber);
+    return readFields (argNumber + 1, rest...);
+  }
+#endif
 
   /**
    * Read a variable of any type in binary format
@@ -148,6 +284,10 @@ private:
   void printEsc (char *str);
   void printEsc (char str);
 
+  // **** Transactions ****
+
+  void sendLineEnd ();
+
 public:
 
   // ****** Public functions ******
@@ -159,8 +299,14 @@ public:
                 const char esc_character = '/');
 
   void printLfCr (bool addNewLine=true);
+  void sendBinaryFrames (bool enable=true);
+  bool isSendingBinaryFrames ();
+  void setFastScan (bool enable=true);
   void attach (messengerCallbackFunction newFunction);
+  void attach (messengerDispatchFunction newFunction);
+#if MAXCALLBACKS > 0
   void attach (byte msgId, messengerCallbackFunction newFunction);
+#endif
 
   // **** Command processing ****
 
@@ -211,6 +357,19 @@ public:
   void sendCmdfArg (char *fmt, ...);
   bool sendCmdEnd (bool reqAc = false, int ackCmdId = 1, int timeout = DEFAULT_TIMEOUT);
 
+  // **** Transactions ****
+
+  void beginTransaction ();
+  void flushTransaction ();
+  void endTransaction ();
+  void setTransactionSize (uint16_t size);
+
+  // **** Reliable commands ****
+
+  void setAckCommands (uint8_t reliableCmdId, uint8_t ackCmdId);
+  bool sendReliableCmdStart (int cmdId, messengerRetryFunction retry, uint8_t context = 0,
+                             uint16_t timeout = ACK_TIMEOUT, uint8_t retries = ACK_RETRIES);
+
   /**
    * Send a single argument as string
    *  Note that this will only succeed if a sendCmdStart has been issued first
@@ -219,21 +378,30 @@ public:
   {
     if (startCommand)
       {
-        comms->print (field_separator);
-        comms->print (arg);
+        if (binaryFrames) {
+          writeFrameArg (arg);
+          return;
+        }
+        commandBytes += comms->print (field_separator);
+        commandBytes += comms->print (arg);
       }
   }
 
   /**
    * Send a single argument as string with custom accuracy
    *  Note that this will only succeed if a sendCmdStart has been issued first
+   *  Binary frames always use FIXED_POINT_SCALE
    */
   template < class T > void sendCmdArg (T arg, int n)
   {
     if (startCommand)
       {
-        comms->print (field_separator);
-        comms->print (arg, n);
+        if (binaryFrames) {
+          writeFrameArg (arg);
+          return;
+        }
+        commandBytes += comms->print (field_separator);
+        commandBytes += comms->print (arg, n);
       }
   }
 
@@ -245,7 +413,11 @@ public:
   {
     if (startCommand)
       {
-        comms->print (field_separator);
+        if (binaryFrames) {
+          writeFrameBytes ((const char *) (const void *) &arg, sizeof (arg));
+          return;
+        }
+        commandBytes += comms->print (field_separator);
         writeBin (arg);
       }
   }
@@ -260,6 +432,20 @@ public:
   void copyStringArg (char *string, uint8_t size);
   uint8_t compareStringArg (char *string);
 
+#if __cplusplus >= 201103L
+  /**
+   * Read the next arguments into variables of their types, e.g.
+   *   int red, green, blue;
+   *   if (messenger.read (red, green, blue) == 0) ...
+   * Every field is parsed once in place. Returns 0 if all arguments were read,
+   * otherwise the number (starting at 1) of the first missing or malformed one
+   */
+  template < class... T > uint8_t read (T &... args)
+  {
+    return readFields (1, args...);
+  }
+#endif
+
   /**
    * Read an argument of any type in binary format
    */
@@ -268,6 +454,17 @@ public:
     if (next ())
       {
         dumped = true;
+        if (frameReceived) {
+          T value = (T)0;
+          uint8_t length;
+          char *bytes = readFrameBytes (&length);
+          if (bytes != NULL && length == sizeof (value)) {
+            memcpy (&value, bytes, sizeof (value));
+          } else {
+            ArgOk = false;
+          }
+          return value;
+        }
         return readBin < T > (current);
       }
 	  return (T)0;
@@ -285,4 +482,44 @@ public:
     return false;
   }
 };
+
+#if __cplusplus >= 201103L
+/**
+ * Maps a command id to its callback at compile time
+ */
+template < uint8_t MsgId, messengerCallbackFunction Callback > struct MessengerHandler
+{
+};
+
+/**
+ * Dispatch function for a fixed list of MessengerHandlers, e.g.
+ *   typedef MessengerDispatch< MessengerHandler<MSG_SWITCH_WRITE, switch_write>,
+ *     MessengerHandler<MSG_SWITCH_READ, switch_read> > SwitchHandlers;
+ *   messenger.attach (SwitchHandlers::dispatch);
+ * The comparisons and callback calls are inlined, the handlers need no RAM
+ */
+template < class... Handlers > struct MessengerDispatch;
+
+template <> struct MessengerDispatch <>
+{
+  static bool dispatch (uint8_t msgId)
+  {
+    return false;
+  }
+};
+
+template < uint8_t MsgId, messengerCallbackFunction Callback, class... Handlers >
+  struct MessengerDispatch < MessengerHandler < MsgId, Callback >, Handlers... >
+{
+  static bool dispatch (uint8_t msgId)
+  {
+    if (msgId == MsgId) {
+      Callback ();
+      return true;
+    }
+    return MessengerDispatch < Handlers... >::dispatch (msgId);
+  }
+};
+#endif
+
 #endif
@@ -0,0 +1,57 @@
+#ifndef DELIMITER_SCAN_H
+#define DELIMITER_SCAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Returns the index of the first byte of data that is a, b or c, or length if
+// there is none. Compares 16 bytes at once with SSE2, otherwise 8 bytes at
+// once in a 64 bit word (SWAR). The commands are at most MESSENGERBUFFERSIZE
+// bytes long, wider vectors wouldn't pay off.
+inline size_t findDelimiter(const char *data, size_t length, char a, char b, char c) {
+  size_t i = 0;
+#ifdef __SSE2__
+  const __m128i va = _mm_set1_epi8(a);
+  const __m128i vb = _mm_set1_epi8(b);
+  const __m128i vc = _mm_set1_epi8(c);
+  for (; i + 16 <= length; i += 16) {
+    __m128i chunk = _mm_loadu_si128((const __m128i *) (data + i));
+    __m128i match = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, va), _mm_cmpeq_epi8(chunk, vb)),
+      _mm_cmpeq_epi8(chunk, vc));
+    int mask = _mm_movemask_epi8(match);
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+#else
+  // A byte of x is zero where the word has the delimiter. The zero test has no
+  // false negatives, the exact position is found byte by byte below.
+  const uint64_t ones = 0x0101010101010101ULL;
+  const uint64_t highs = 0x8080808080808080ULL;
+  const uint64_t wa = ones * (uint8_t) a;
+  const uint64_t wb = ones * (uint8_t) b;
+  const uint64_t wc = ones * (uint8_t) c;
+  for (; i + 8 <= length; i += 8) {
+    uint64_t word;
+    memcpy(&word, data + i, sizeof(word));
+    uint64_t xa = word ^ wa;
+    uint64_t xb = word ^ wb;
+    uint64_t xc = word ^ wc;
+    if ((((xa - ones) & ~xa) | ((xb - ones) & ~xb) | ((xc - ones) & ~xc)) & highs) {
+      break;
+    }
+  }
+#endif
+  for (; i < length; ++i) {
+    if (data[i] == a || data[i] == b || data[i] == c) {
+      return i;
+    }
+  }
+  return length;
+}
+
+#endif // DELIMITER_SCAN_H
@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <FleetManifest.h>
+
+static std::string trim(const std::string &s) {
+  size_t first = s.find_first_not_of(" \t\r\n");
+  if (first == std::string::npos) {
+    return "";
+  }
+  return s.substr(first, s.find_last_not_of(" \t\r\n") - first + 1);
+}
+
+// Removes a comment that isn't inside a quoted value and the quotes
+static std::string parseValue(const std::string &s) {
+  std::string value = trim(s);
+  if (!value.empty() && (value[0] == '"' || value[0] == '\'')) {
+    size_t end = value.find(value[0], 1);
+    return value.substr(1, end == std::string::npos ? std::string::npos : end - 1);
+  }
+  size_t comment = value.find(" #");
+  if (comment != std::string::npos) {
+    value = trim(value.substr(0, comment));
+  }
+  return value;
+}
+
+static bool parseNumber(const std::string &s, int *number) {
+  char *end;
+  long value = strtol(s.c_str(), &end, 10);
+  if (s.empty() || *end != '\0' || value < 0 || value > 65535) {
+    return false;
+  }
+  *number = (int) value;
+  return true;
+}
+
+bool FleetManifest::load(const std::string &fileName) {
+  FILE *file = fopen(fileName.c_str(), "r");
+  if (file == NULL) {
+    error = fileName + ": " + strerror(errno);
+    return false;
+  }
+  entries.clear();
+  bool inDevices = false;
+  char buffer[1024];
+  int lineNumber = 0;
+  while (fgets(buffer, sizeof(buffer), file) != NULL) {
+    ++lineNumber;
+    std::string line = buffer;
+    std::string content = trim(line);
+    if (content.empty() || content[0] == '#' || content == "---") {
+      continue;
+    }
+    bool topLevel = line[0] != ' ' && line[0] != '\t' && line[0] != '-';
+    if (topLevel) {
+      inDevices = content == "devices:";
+      if (!inDevices) {
+        fclose(file);
+        return fail(lineNumber, "unknown section " + content);
+      }
+      continue;
+    }
+    if (!inDevices) {
+      fclose(file);
+      return fail(lineNumber, "device outside of the devices list");
+    }
+    if (content[0] == '-') {
+      entries.push_back(Entry());
+      entries.back().line = lineNumber;
+      content = trim(content.substr(1));
+      if (content.empty()) {
+        continue;
+      }
+    } else if (entries.empty()) {
+      fclose(file);
+      return fail(lineNumber, "expected a list item");
+    }
+    size_t colon = content.find(':');
+    if (colon == std::string::npos) {
+      fclose(file);
+      return fail(lineNumber, "expected KEY: VALUE");
+    }
+    if (!setValue(entries.back(), trim(content.substr(0, colon)), parseValue(content.substr(colon + 1)))) {
+      fclose(file);
+      return fail(lineNumber, error);
+    }
+  }
+  fclose(file);
+  for (size_t i = 0; i < entries.size(); ++i) {
+    if (entries[i].type.empty()) {
+      return fail(entries[i].line, "device without a type");
+    }
+  }
+  return true;
+}
+
+bool FleetManifest::setValue(Entry &entry, const std::string &key, const std::string &value) {
+  if (key == "id") {
+    entry.id = value;
+  } else if (key == "type") {
+    entry.type = value;
+  } else if (key == "name") {
+    entry.name = value;
+  } else if (key == "bind") {
+    entry.bind = value;
+  } else if (key == "count") {
+    if (!parseNumber(value, &entry.count) || entry.count == 0) {
+      error = "invalid count " + value;
+      return false;
+    }
+  } else if (key == "port") {
+    if (!parseNumber(value, &entry.port)) {
+      error = "invalid port " + value;
+      return false;
+    }
+  } else if (key == "server") {
+    size_t colon = value.find(':');
+    entry.serverHost = value.substr(0, colon);
+    if (colon != std::string::npos && !parseNumber(value.substr(colon + 1), &entry.serverPort)) {
+      error = "invalid server " + value;
+      return false;
+    }
+  } else {
+    error = "unknown key " + key;
+    return false;
+  }
+  return true;
+}
+
+bool FleetManifest::fail(int line, const std::string &message) {
+  char prefix[32];
+  snprintf(prefix, sizeof(prefix), "line %d: ", line);
+  error = prefix + message;
+  return false;
+}
+
+const std::vector<FleetManifest::Entry> &FleetManifest::getEntries() {
+  return entries;
+}
+
+const std::string &FleetManifest::getError() {
+  return error;
+}
@@ -0,0 +1,48 @@
+#ifndef FLEET_MANIFEST_H
+#define FLEET_MANIFEST_H
+
+#include <string>
+#include <vector>
+
+// List of the devices simhost brings up, read from a YAML file like:
+//
+//   devices:
+//     - type: switch
+//       count: 100
+//     - id: kitchen
+//       type: switch8
+//       name: "Kitchen Lights"
+//       port: 2500
+//       server: "10.0.0.2:2000"
+//
+// Only this subset of YAML is supported: a "devices" list of flat maps with
+// the keys id, type, name, count, bind, port and server. With a count, the id
+// and name are used as prefixes of "<id>-1" ... "<id>-<count>". Without an id
+// the devices are numbered per type like on the command line. Unset bind, port
+// and server use the command line options, ports are assigned consecutively.
+class FleetManifest {
+public:
+  struct Entry {
+    Entry() : count(1), port(0), serverPort(0), line(0) {}
+    std::string id;
+    std::string type;
+    std::string name;
+    int count;
+    std::string bind;
+    int port;
+    std::string serverHost;
+    int serverPort;
+    int line;
+  };
+  bool load(const std::string &fileName);
+  const std::vector<Entry> &getEntries();
+  const std::string &getError();
+
+private:
+  bool setValue(Entry &entry, const std::string &key, const std::string &value);
+  bool fail(int line, const std::string &message);
+  std::vector<Entry> entries;
+  std::string error;
+};
+
+#endif // FLEET_MANIFEST_H
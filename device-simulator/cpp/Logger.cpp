@@ -0,0 +1,143 @@
+#include <Logger.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+
+static const int FLUSH_INTERVAL_MS = 20;
+static const char *LEVEL_NAMES[] = {"debug", "info", "warning", "error"};
+static const char *LEVEL_LABELS[] = {"DEBUG", "INFO ", "WARN ", "ERROR"};
+
+Logger::Logger() : head(0), tail(0), dropped(0), running(true) {
+  level = LOG_INFO;
+  for (size_t i = 0; i < RING_SIZE; ++i) {
+    ring[i].sequence.store(i, std::memory_order_relaxed);
+  }
+  flusher = std::thread(&Logger::flushLoop, this);
+  atexit(onExit);
+}
+
+Logger *Logger::getInstance() {
+  static Logger *instance = new Logger();
+  return instance;
+}
+
+bool Logger::parseLevel(const char *name, LogLevel *level) {
+  for (int i = LOG_DEBUG; i <= LOG_ERROR; ++i) {
+    if (strcmp(name, LEVEL_NAMES[i]) == 0) {
+      *level = (LogLevel) i;
+      return true;
+    }
+  }
+  return false;
+}
+
+void Logger::setLevel(LogLevel level) {
+  this->level = level;
+}
+
+bool Logger::isEnabled(LogLevel level) {
+  return level >= this->level;
+}
+
+// Several threads may log at the same time. A producer claims a slot by
+// advancing the tail, the sequence number of the slot tells the flusher when
+// the message is complete and the producers when the slot is free again.
+void Logger::log(LogLevel level, const char *tag, const char *format, va_list args) {
+  if (!isEnabled(level)) {
+    return;
+  }
+  size_t t = tail.load(std::memory_order_relaxed);
+  Entry *entry;
+  for (;;) {
+    entry = &ring[t % RING_SIZE];
+    size_t sequence = entry->sequence.load(std::memory_order_acquire);
+    if (sequence == t) {
+      if (tail.compare_exchange_weak(t, t + 1, std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (sequence < t) {
+      entry = NULL;
+      break;
+    } else {
+      t = tail.load(std::memory_order_relaxed);
+    }
+  }
+  if (entry == NULL) {
+    if (level < LOG_WARNING) {
+      dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    // Warnings and errors are never dropped, they bypass the full ring
+    char line[sizeof(Entry) + 16];
+    int length = snprintf(line, sizeof(line), "%s ", LEVEL_LABELS[level]);
+    if (tag != NULL) {
+      length += snprintf(line + length, sizeof(line) - length, "[%s] ", tag);
+    }
+    vsnprintf(line + length, sizeof(line) - length - 1, format, args);
+    strcat(line, "\n");
+    write(STDOUT_FILENO, line, strlen(line));
+    return;
+  }
+  entry->level = level;
+  snprintf(entry->tag, sizeof(entry->tag), "%s", tag != NULL ? tag : "");
+  vsnprintf(entry->message, sizeof(entry->message), format, args);
+  entry->sequence.store(t + 1, std::memory_order_release);
+}
+
+// Writes the remaining messages, called on exit
+void Logger::stop() {
+  if (running.exchange(false)) {
+    flusher.join();
+    flush();
+  }
+}
+
+void Logger::onExit() {
+  getInstance()->stop();
+}
+
+void Logger::flushLoop() {
+  while (running.load()) {
+    if (flush() == 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(FLUSH_INTERVAL_MS));
+    }
+  }
+}
+
+// Formats the queued messages into the output buffer and writes them with as
+// few syscalls as possible. Returns the number of messages written.
+size_t Logger::flush() {
+  size_t h = head.load(std::memory_order_relaxed);
+  size_t start = h;
+  size_t length = 0;
+  unsigned long lost = dropped.exchange(0, std::memory_order_relaxed);
+  if (lost > 0) {
+    length += snprintf(output, sizeof(output), "%s %lu log messages dropped\n",
+      LEVEL_LABELS[LOG_WARNING], lost);
+  }
+  for (;; ++h) {
+    Entry &entry = ring[h % RING_SIZE];
+    if (entry.sequence.load(std::memory_order_acquire) != h + 1) {
+      break;
+    }
+    if (sizeof(output) - length < sizeof(Entry) + 16) {
+      write(STDOUT_FILENO, output, length);
+      length = 0;
+    }
+    if (entry.tag[0] != '\0') {
+      length += snprintf(output + length, sizeof(output) - length, "%s [%s] %s\n",
+        LEVEL_LABELS[entry.level], entry.tag, entry.message);
+    } else {
+      length += snprintf(output + length, sizeof(output) - length, "%s %s\n",
+        LEVEL_LABELS[entry.level], entry.message);
+    }
+    entry.sequence.store(h + RING_SIZE, std::memory_order_release);
+  }
+  head.store(h, std::memory_order_relaxed);
+  if (length > 0) {
+    write(STDOUT_FILENO, output, length);
+  }
+  return h - start;
+}
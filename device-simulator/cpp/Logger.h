@@ -0,0 +1,52 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <atomic>
+#include <thread>
+
+enum LogLevel {
+  LOG_DEBUG,
+  LOG_INFO,
+  LOG_WARNING,
+  LOG_ERROR
+};
+
+// Log messages are formatted into a fixed size lock-free ring by the event
+// loop threads and written to stdout in batches by a background thread, so
+// logging doesn't cost a write syscall per line. Messages below the log
+// level are not formatted at all. If the ring is full, debug and info
+// messages are dropped and counted, warnings and errors are written directly.
+class Logger {
+public:
+  static Logger *getInstance();
+  static bool parseLevel(const char *name, LogLevel *level);
+  void setLevel(LogLevel level);
+  bool isEnabled(LogLevel level);
+  void log(LogLevel level, const char *tag, const char *format, va_list args);
+  void stop();
+
+private:
+  struct Entry {
+    std::atomic<size_t> sequence;
+    LogLevel level;
+    char tag[32];
+    char message[224];
+  };
+  static const size_t RING_SIZE = 4096;
+  Logger();
+  static void onExit();
+  void flushLoop();
+  size_t flush();
+  LogLevel level;
+  Entry ring[RING_SIZE];
+  std::atomic<size_t> head;
+  std::atomic<size_t> tail;
+  std::atomic<unsigned long> dropped;
+  std::atomic<bool> running;
+  std::thread flusher;
+  char output[64 * 1024];
+};
+
+#endif // LOGGER_H
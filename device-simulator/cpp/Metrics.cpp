@@ -0,0 +1,118 @@
+#include <Metrics.h>
+#include <Simulator.h>
+#include <event2/event.h>
+#include <event2/http.h>
+#include <event2/buffer.h>
+
+const unsigned long MetricsHistogram::BOUNDS[BUCKETS] = {
+  10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 1000000
+};
+
+void MetricsHistogram::observe(unsigned long micros) {
+  int bucket = 0;
+  while (bucket < BUCKETS && micros > BOUNDS[bucket]) {
+    ++bucket;
+  }
+  counts[bucket].add(1);
+  sumMicros.add(micros);
+}
+
+// The bucket counts are stored per bucket and summed up to the cumulative
+// counts of the text format while writing
+void MetricsHistogram::write(struct evbuffer *output, const char *name, const std::string &device) {
+  unsigned long count = 0;
+  for (int i = 0; i < BUCKETS; ++i) {
+    count += counts[i].get();
+    evbuffer_add_printf(output, "%s_bucket{device=\"%s\",le=\"%g\"} %lu\n",
+      name, device.c_str(), BOUNDS[i] / 1e6, count);
+  }
+  count += counts[BUCKETS].get();
+  evbuffer_add_printf(output, "%s_bucket{device=\"%s\",le=\"+Inf\"} %lu\n", name, device.c_str(), count);
+  evbuffer_add_printf(output, "%s_sum{device=\"%s\"} %.6f\n", name, device.c_str(), sumMicros.get() / 1e6);
+  evbuffer_add_printf(output, "%s_count{device=\"%s\"} %lu\n", name, device.c_str(), count);
+}
+
+MetricsServer::MetricsServer(struct event_base *events, const std::vector<Simulator *> &devices) {
+  this->devices = devices;
+  http = evhttp_new(events);
+  evhttp_set_cb(http, "/metrics", onRequest, this);
+}
+
+bool MetricsServer::listen(const std::string &host, int port) {
+  return evhttp_bind_socket(http, host.c_str(), port) == 0;
+}
+
+void MetricsServer::onRequest(struct evhttp_request *request, void *arg) {
+  MetricsServer *self = (MetricsServer *) arg;
+  struct evbuffer *output = evbuffer_new();
+  self->writeMetrics(output);
+  evhttp_add_header(evhttp_request_get_output_headers(request), "Content-Type",
+    "text/plain; version=0.0.4");
+  evhttp_send_reply(request, HTTP_OK, "OK", output);
+  evbuffer_free(output);
+}
+
+struct CounterFamily {
+  const char *name;
+  const char *type;
+  const char *help;
+  MetricsCounter SimulatorMetrics::*counter;
+  double scale;
+};
+
+static const CounterFamily counterFamilies[] = {
+  {"caretaker_sim_loop_seconds_total", "counter", "Time spent in the firmware loop()",
+    &SimulatorMetrics::loopMicros, 1e-6},
+  {"caretaker_sim_udp_datagrams_received_total", "counter", "UDP datagrams received from the server",
+    &SimulatorMetrics::datagramsReceived, 1},
+  {"caretaker_sim_udp_datagrams_sent_total", "counter", "UDP datagrams sent to the server",
+    &SimulatorMetrics::datagramsSent, 1},
+  {"caretaker_sim_udp_datagrams_dropped_total", "counter", "UDP datagrams that were truncated or didn't fit into a buffer",
+    &SimulatorMetrics::datagramsDropped, 1},
+  {"caretaker_sim_udp_bytes_received_total", "counter", "UDP payload bytes received from the server",
+    &SimulatorMetrics::bytesReceived, 1},
+  {"caretaker_sim_udp_bytes_sent_total", "counter", "UDP payload bytes sent to the server",
+    &SimulatorMetrics::bytesSent, 1},
+  {"caretaker_sim_state_writes_in_flight", "gauge", "Device state updates waiting for the state backend",
+    &SimulatorMetrics::stateWritesInFlight, 1},
+  {"caretaker_sim_messenger_parse_errors_total", "counter", "Received commands without a handler, a valid command id or readable arguments",
+    &SimulatorMetrics::parseErrors, 1},
+  {"caretaker_sim_messenger_buffer_resets_total", "counter", "Received commands dropped because they overflowed the command buffer",
+    &SimulatorMetrics::bufferResets, 1},
+  {"caretaker_sim_messenger_ack_retries_total", "counter", "Reliable commands sent again because their ack didn't arrive in time",
+    &SimulatorMetrics::ackRetries, 1},
+  {"caretaker_sim_messenger_ack_failures_total", "counter", "Reliable commands given up without an ack after their last retry",
+    &SimulatorMetrics::ackFailures, 1},
+  {"caretaker_sim_registration_attempts_total", "counter", "Registration requests sent to the server",
+    &SimulatorMetrics::registrationAttempts, 1}
+};
+
+void MetricsServer::writeMetrics(struct evbuffer *output) {
+  evbuffer_add_printf(output, "# HELP caretaker_sim_tick_duration_seconds Duration of a simulator tick\n");
+  evbuffer_add_printf(output, "# TYPE caretaker_sim_tick_duration_seconds histogram\n");
+  for (size_t i = 0; i < devices.size(); ++i) {
+    devices[i]->getMetrics().tickDuration.write(output, "caretaker_sim_tick_duration_seconds",
+      devices[i]->getDeviceId());
+  }
+  evbuffer_add_printf(output, "# HELP caretaker_sim_state_write_latency_seconds Latency of the device state updates\n");
+  evbuffer_add_printf(output, "# TYPE caretaker_sim_state_write_latency_seconds histogram\n");
+  for (size_t i = 0; i < devices.size(); ++i) {
+    devices[i]->getMetrics().stateWriteLatency.write(output, "caretaker_sim_state_write_latency_seconds",
+      devices[i]->getDeviceId());
+  }
+  for (size_t f = 0; f < sizeof(counterFamilies) / sizeof(counterFamilies[0]); ++f) {
+    const CounterFamily &family = counterFamilies[f];
+    evbuffer_add_printf(output, "# HELP %s %s\n", family.name, family.help);
+    evbuffer_add_printf(output, "# TYPE %s %s\n", family.name, family.type);
+    for (size_t i = 0; i < devices.size(); ++i) {
+      MetricsCounter &counter = devices[i]->getMetrics().*family.counter;
+      if (family.scale == 1) {
+        evbuffer_add_printf(output, "%s{device=\"%s\"} %lu\n", family.name,
+          devices[i]->getDeviceId().c_str(), counter.get());
+      } else {
+        evbuffer_add_printf(output, "%s{device=\"%s\"} %.6f\n", family.name,
+          devices[i]->getDeviceId().c_str(), counter.get() * family.scale);
+      }
+    }
+  }
+}
@@ -0,0 +1,79 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <atomic>
+
+struct event_base;
+struct evhttp;
+struct evhttp_request;
+struct evbuffer;
+class Simulator;
+
+// Counters are only written by the thread that runs the device and read by
+// the thread that serves the metrics, so they are updated without a locked
+// instruction.
+class MetricsCounter {
+public:
+  MetricsCounter() : value(0) {}
+  void add(unsigned long n) {
+    value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+  void set(unsigned long n) {
+    value.store(n, std::memory_order_relaxed);
+  }
+  unsigned long get() {
+    return value.load(std::memory_order_relaxed);
+  }
+
+private:
+  std::atomic<unsigned long> value;
+};
+
+// Histogram of microsecond durations with fixed buckets, reported in seconds
+class MetricsHistogram {
+public:
+  static const int BUCKETS = 14;
+  void observe(unsigned long micros);
+  void write(struct evbuffer *output, const char *name, const std::string &device);
+
+private:
+  static const unsigned long BOUNDS[BUCKETS];
+  MetricsCounter counts[BUCKETS + 1];
+  MetricsCounter sumMicros;
+};
+
+struct SimulatorMetrics {
+  MetricsHistogram tickDuration;
+  MetricsCounter loopMicros;
+  MetricsCounter datagramsReceived;
+  MetricsCounter datagramsSent;
+  MetricsCounter datagramsDropped;
+  MetricsCounter bytesReceived;
+  MetricsCounter bytesSent;
+  MetricsCounter stateWritesInFlight;
+  MetricsHistogram stateWriteLatency;
+  MetricsCounter parseErrors;
+  MetricsCounter bufferResets;
+  MetricsCounter ackRetries;
+  MetricsCounter ackFailures;
+  MetricsCounter registrationAttempts;
+};
+
+// Serves the metrics of the simulated devices in the Prometheus text format
+// on http://HOST:PORT/metrics
+class MetricsServer {
+public:
+  MetricsServer(struct event_base *events, const std::vector<Simulator *> &devices);
+  bool listen(const std::string &host, int port);
+
+private:
+  static void onRequest(struct evhttp_request *request, void *arg);
+  void writeMetrics(struct evbuffer *output);
+  struct evhttp *http;
+  std::vector<Simulator *> devices;
+};
+
+#endif // METRICS_H
@@ -0,0 +1,89 @@
+#include <ReceiveBuffer.h>
+#include <string.h>
+#include <algorithm>
+
+ReceiveBuffer::ReceiveBuffer() {
+  head = 0;
+  tail = 0;
+  firstDatagram = 0;
+  datagramCount = 0;
+  overflows = 0;
+}
+
+size_t ReceiveBuffer::available() {
+  return tail - head;
+}
+
+int ReceiveBuffer::read() {
+  if (available() == 0) {
+    return -1;
+  }
+  int c = (unsigned char) buffer[head % CAPACITY];
+  consume(1);
+  return c;
+}
+
+size_t ReceiveBuffer::read(char *data, size_t length) {
+  size_t count = 0;
+  while (count < length) {
+    const char *bytes;
+    size_t n = std::min(peek(&bytes), length - count);
+    if (n == 0) {
+      break;
+    }
+    memcpy(data + count, bytes, n);
+    consume(n);
+    count += n;
+  }
+  return count;
+}
+
+// Return the readable bytes up to the end of the ring or of the first
+// datagram. The bytes stay valid until the next write, even if they are
+// consumed.
+size_t ReceiveBuffer::peek(const char **data) {
+  size_t start = head % CAPACITY;
+  *data = buffer + start;
+  size_t length = std::min(available(), CAPACITY - start);
+  if (datagramCount > 0) {
+    length = std::min(length, (size_t) (datagramEnds[firstDatagram] - head));
+  }
+  return length;
+}
+
+// Returns true if the consumed bytes end a datagram
+bool ReceiveBuffer::consume(size_t length) {
+  head += std::min(length, available());
+  bool datagramEnded = false;
+  while (datagramCount > 0 && datagramEnds[firstDatagram] <= head) {
+    firstDatagram = (firstDatagram + 1) % MAX_DATAGRAMS;
+    --datagramCount;
+    datagramEnded = true;
+  }
+  return datagramEnded;
+}
+
+// Copies the datagram into the free space, which may wrap around the end of
+// the ring
+bool ReceiveBuffer::write(const char *data, size_t length) {
+  if (datagramCount == MAX_DATAGRAMS || length > CAPACITY - available()) {
+    countOverflow();
+    return false;
+  }
+  size_t start = tail % CAPACITY;
+  size_t first = std::min(length, CAPACITY - start);
+  memcpy(buffer + start, data, first);
+  memcpy(buffer, data + first, length - first);
+  tail += length;
+  datagramEnds[(firstDatagram + datagramCount) % MAX_DATAGRAMS] = tail;
+  ++datagramCount;
+  return true;
+}
+
+void ReceiveBuffer::countOverflow() {
+  ++overflows;
+}
+
+unsigned long ReceiveBuffer::getOverflows() {
+  return overflows;
+}
@@ -0,0 +1,34 @@
+#ifndef RECEIVE_BUFFER_H
+#define RECEIVE_BUFFER_H
+
+#include <stddef.h>
+
+// Fixed capacity ring buffer for the messages received from the server.
+// Datagrams are stored completely or not at all, a datagram that doesn't
+// fit is dropped and counted as an overflow. peek() stops at the end of a
+// datagram, consume() reports when a datagram was read completely.
+class ReceiveBuffer {
+public:
+  static const size_t CAPACITY = 4096;
+  static const size_t MAX_DATAGRAMS = 64;
+  ReceiveBuffer();
+  size_t available();
+  int read();
+  size_t read(char *data, size_t length);
+  size_t peek(const char **data);
+  bool consume(size_t length);
+  bool write(const char *data, size_t length);
+  void countOverflow();
+  unsigned long getOverflows();
+
+private:
+  char buffer[CAPACITY];
+  unsigned long head;
+  unsigned long tail;
+  unsigned long datagramEnds[MAX_DATAGRAMS];
+  size_t firstDatagram;
+  size_t datagramCount;
+  unsigned long overflows;
+};
+
+#endif // RECEIVE_BUFFER_H
@@ -0,0 +1,198 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <functional>
+#include <hiredis/adapters/libevent.h>
+#include <RedisStateBackend.h>
+#include <Simulator.h>
+
+static const char *DEVICE_INDEX_KEY = "caretaker.device-index";
+static const char *DEVICE_INDEX_VERSION_KEY = "caretaker.device-index.version";
+static const char *DEVICE_INDEX_CHANNEL = "caretaker.device-index.changes";
+
+// Updates the index and publishes the change atomically, so that the versions
+// of the published changes and of the index entries are consistent
+static const char *UPDATE_DEVICE_INDEX_SCRIPT =
+  "local version = redis.call('INCR', KEYS[2]) "
+  "if ARGV[1] == 'add' then redis.call('ZADD', KEYS[1], version, ARGV[2]) "
+  "else redis.call('ZREM', KEYS[1], ARGV[2]) end "
+  "redis.call('PUBLISH', KEYS[3], version .. ' ' .. ARGV[1] .. ' ' .. ARGV[2]) "
+  "return version";
+
+static unsigned long monotonicMicros() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+RedisStateBackend::RedisStateBackend(struct event_base *events, const std::string &host, int port,
+    int poolSize) {
+  this->events = events;
+  this->host = host;
+  this->port = port;
+  this->poolSize = poolSize > 0 ? poolSize : 1;
+  listener = NULL;
+  subscription = NULL;
+  connections = 0;
+  openConnections = 0;
+  devicesToDelete = 0;
+}
+
+void RedisStateBackend::connect(Listener *listener, const std::string &devicePattern) {
+  this->listener = listener;
+  log(LOG_INFO, "Connecting to Redis...");
+  for (int i = 0; i < poolSize; ++i) {
+    pool.push_back(openConnection());
+  }
+  subscription = openConnection();
+  redisAsyncCommand(pool[0]->context, NULL, NULL, "CONFIG set notify-keyspace-events KEA");
+  std::string cmd = "PSUBSCRIBE " + std::string(DEVICE_KEY_PREFIX) + devicePattern + DEVICE_INPUT_SUFFIX;
+  redisAsyncCommand(subscription->context, onDeviceInput, NULL, cmd.c_str());
+}
+
+const char *RedisStateBackend::getName() {
+  return "redis";
+}
+
+RedisStateBackend::Connection *RedisStateBackend::openConnection() {
+  redisAsyncContext *redis = redisAsyncConnect(host.c_str(), port);
+  if (redis != NULL && redis->err) {
+    log(LOG_ERROR, "%s", redis->errstr);
+    exit(1);
+  }
+  Connection *connection = new Connection();
+  connection->backend = this;
+  connection->context = redis;
+  redis->data = connection;
+  redisLibeventAttach(redis, events);
+  redisAsyncSetConnectCallback(redis, onConnected);
+  redisAsyncSetDisconnectCallback(redis, onDisconnected);
+  return connection;
+}
+
+// All commands of a device use the same connection, so that its state
+// updates are applied in order
+RedisStateBackend::Connection *RedisStateBackend::getConnection(const std::string &deviceId) {
+  return pool[std::hash<std::string>()(deviceId) % pool.size()];
+}
+
+void RedisStateBackend::onConnected(const redisAsyncContext *redis, int status) {
+  RedisStateBackend *self = ((Connection *) redis->data)->backend;
+  if (status != REDIS_OK) {
+    log(LOG_ERROR, "%s", redis->errstr);
+    exit(1);
+  }
+  ++self->connections;
+  ++self->openConnections;
+  if (self->connections == self->pool.size() + 1) {
+    log(LOG_INFO, "Redis connections established (%d connections)", self->connections);
+    self->listener->onStateBackendReady();
+  }
+}
+
+void RedisStateBackend::onDisconnected(const redisAsyncContext *redis, int status) {
+  RedisStateBackend *self = ((Connection *) redis->data)->backend;
+  if (status != REDIS_OK) {
+    log(LOG_ERROR, "%s", redis->errstr);
+    return;
+  }
+  if (--self->openConnections == 0) {
+    log(LOG_INFO, "Redis connections closed");
+    self->listener->onStateBackendClosed();
+  }
+}
+
+void RedisStateBackend::onDeviceInput(redisAsyncContext *redis, void *_reply, void *data) {
+  RedisStateBackend *self = ((Connection *) redis->data)->backend;
+  redisReply *reply  = (redisReply *) _reply;
+  if (reply == NULL) {
+    return;
+  }
+  if (reply->type == REDIS_REPLY_ARRAY && reply->elements == 4) {
+    if (strcmp(reply->element[0]->str, "pmessage") == 0) {
+      const char *channel = reply->element[2]->str;
+      size_t prefixLength = strlen(DEVICE_KEY_PREFIX);
+      size_t suffixLength = strlen(DEVICE_INPUT_SUFFIX);
+      if (reply->element[2]->len > prefixLength + suffixLength) {
+        std::string deviceId(channel + prefixLength, reply->element[2]->len - prefixLength - suffixLength);
+        self->listener->onDeviceInput(deviceId, reply->element[3]->str, reply->element[3]->len);
+      }
+    }
+  }
+}
+
+void RedisStateBackend::registerDevice(const std::string &deviceId) {
+  updateDeviceIndex("add", deviceId);
+}
+
+// Every backend subscribes to the input of all devices, nothing to release
+void RedisStateBackend::releaseDevice(const std::string &deviceId) {
+}
+
+void RedisStateBackend::updateDeviceIndex(const char *change, const std::string &deviceId) {
+  redisAsyncCommand(getConnection(deviceId)->context, NULL, NULL, "EVAL %s 3 %s %s %s %s %s",
+    UPDATE_DEVICE_INDEX_SCRIPT, DEVICE_INDEX_KEY, DEVICE_INDEX_VERSION_KEY, DEVICE_INDEX_CHANNEL, change,
+    deviceId.c_str());
+}
+
+// hiredis copies the arguments into its output buffer, all commands issued
+// during one event loop iteration are written to the connection at once
+void RedisStateBackend::writeState(Simulator *device, const std::string &deviceId, const Fields &fields,
+    size_t count) {
+  key = DEVICE_KEY_PREFIX + deviceId;
+  commandArgv.clear();
+  commandArgvLen.clear();
+  commandArgv.push_back("HSET");
+  commandArgvLen.push_back(4);
+  commandArgv.push_back(key.c_str());
+  commandArgvLen.push_back(key.length());
+  for (size_t i = 0; i < count; ++i) {
+    commandArgv.push_back(fields[i].first.c_str());
+    commandArgvLen.push_back(fields[i].first.length());
+    commandArgv.push_back(fields[i].second.c_str());
+    commandArgvLen.push_back(fields[i].second.length());
+  }
+  Connection *connection = getConnection(deviceId);
+  redisAsyncCommandArgv(connection->context, onStateWritten, device, commandArgv.size(), &commandArgv[0],
+    &commandArgvLen[0]);
+  connection->commandStarts.push_back(monotonicMicros());
+}
+
+void RedisStateBackend::onStateWritten(redisAsyncContext *redis, void *reply, void *data) {
+  Connection *connection = (Connection *) redis->data;
+  Simulator *device = (Simulator *) data;
+  if (connection->commandStarts.empty()) {
+    return;
+  }
+  unsigned long latency = monotonicMicros() - connection->commandStarts.front();
+  connection->commandStarts.pop_front();
+  device->deviceStateWritten(latency);
+}
+
+void RedisStateBackend::close(const std::vector<std::string> &deviceIds) {
+  log(LOG_INFO, "Disconnecting from Redis...");
+  devicesToDelete = deviceIds.size();
+  if (devicesToDelete == 0) {
+    disconnect();
+    return;
+  }
+  for (size_t i = 0; i < deviceIds.size(); ++i) {
+    updateDeviceIndex("remove", deviceIds[i]);
+    std::string cmd = DEVICE_KEY_PREFIX + deviceIds[i];
+    redisAsyncCommand(getConnection(deviceIds[i])->context, onDeviceDeleted, this, "DEL %s", cmd.c_str());
+  }
+}
+
+void RedisStateBackend::onDeviceDeleted(redisAsyncContext *redis, void *reply, void *data) {
+  RedisStateBackend *self = (RedisStateBackend *) data;
+  if (--self->devicesToDelete == 0) {
+    self->disconnect();
+  }
+}
+
+void RedisStateBackend::disconnect() {
+  redisAsyncDisconnect(subscription->context);
+  for (size_t i = 0; i < pool.size(); ++i) {
+    redisAsyncDisconnect(pool[i]->context);
+  }
+}
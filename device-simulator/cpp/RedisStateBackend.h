@@ -0,0 +1,63 @@
+#ifndef REDIS_STATE_BACKEND_H
+#define REDIS_STATE_BACKEND_H
+
+#include <hiredis/hiredis.h>
+#include <hiredis/async.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <StateBackend.h>
+
+// Stores the device state in the hash caretaker.devices.<id> and receives the
+// device input from the channel caretaker.devices.<id>.input. The state is
+// written through a pool of command connections, the input is received with
+// a pattern subscription on a separate connection.
+//
+// The registered devices are indexed in the sorted set caretaker.device-index,
+// scored by the version of their registration. Every registration and removal
+// increments caretaker.device-index.version and is published as
+// "<version> add|remove <id>" on caretaker.device-index.changes, so that a UI
+// can page through the index and follow the changes without KEYS scans.
+class RedisStateBackend : public StateBackend {
+public:
+  RedisStateBackend(struct event_base *events, const std::string &host, int port, int poolSize);
+  void connect(Listener *listener, const std::string &devicePattern);
+  void registerDevice(const std::string &deviceId);
+  void releaseDevice(const std::string &deviceId);
+  void writeState(Simulator *device, const std::string &deviceId, const Fields &fields, size_t count);
+  void close(const std::vector<std::string> &deviceIds);
+  const char *getName();
+
+private:
+  // The replies of a connection arrive in the order of the commands, so the
+  // oldest start time belongs to the next reply
+  struct Connection {
+    RedisStateBackend *backend;
+    redisAsyncContext *context;
+    std::deque<unsigned long> commandStarts;
+  };
+  static void onConnected(const redisAsyncContext *redis, int status);
+  static void onDisconnected(const redisAsyncContext *redis, int status);
+  static void onDeviceInput(redisAsyncContext *redis, void *reply, void *data);
+  static void onStateWritten(redisAsyncContext *redis, void *reply, void *data);
+  static void onDeviceDeleted(redisAsyncContext *redis, void *reply, void *data);
+  Connection *openConnection();
+  Connection *getConnection(const std::string &deviceId);
+  void updateDeviceIndex(const char *change, const std::string &deviceId);
+  void disconnect();
+  struct event_base *events;
+  std::string host;
+  int port;
+  int poolSize;
+  Listener *listener;
+  std::vector<Connection *> pool;
+  Connection *subscription;
+  size_t connections;
+  size_t openConnections;
+  size_t devicesToDelete;
+  std::string key;
+  std::vector<const char *> commandArgv;
+  std::vector<size_t> commandArgvLen;
+};
+
+#endif // REDIS_STATE_BACKEND_H
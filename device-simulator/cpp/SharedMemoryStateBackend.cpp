@@ -0,0 +1,253 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <event2/event.h>
+#include <SharedMemoryStateBackend.h>
+#include <Simulator.h>
+
+const char *SharedMemoryStateBackend::DEFAULT_NAME = "/caretaker-devices";
+
+static unsigned long monotonicMicros() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+SharedMemoryStateBackend::SharedMemoryStateBackend(struct event_base *events, const std::string &name) {
+  this->events = events;
+  this->name = name;
+  pollEvent = NULL;
+  listener = NULL;
+  table = NULL;
+}
+
+// Only the input of the devices whose state was written through this backend
+// is polled, so the device pattern isn't needed
+void SharedMemoryStateBackend::connect(Listener *listener, const std::string &devicePattern) {
+  this->listener = listener;
+  openTable();
+  log(LOG_INFO, "Using shared memory state table %s", name.c_str());
+  pollEvent = event_new(events, -1, EV_PERSIST, onPoll, this);
+  struct timeval tv;
+  tv.tv_sec = 0;
+  tv.tv_usec = POLL_INTERVAL_MS * 1000;
+  event_add(pollEvent, &tv);
+  // Like a Redis connection, the backend becomes ready in the event loop
+  struct timeval now = {0, 0};
+  event_base_once(events, -1, EV_TIMEOUT, onReady, this, &now);
+}
+
+const char *SharedMemoryStateBackend::getName() {
+  return "shm";
+}
+
+// All simulators that use the same name share the table, it is sized and
+// initialized by the first one
+void SharedMemoryStateBackend::openTable() {
+  int fd = shm_open(name.c_str(), O_RDWR | O_CREAT, 0666);
+  if (fd < 0) {
+    log(LOG_ERROR, "Unable to open shared memory %s: %s", name.c_str(), strerror(errno));
+    exit(1);
+  }
+  if (ftruncate(fd, sizeof(SharedStateTable)) < 0) {
+    log(LOG_ERROR, "Unable to size shared memory %s: %s", name.c_str(), strerror(errno));
+    exit(1);
+  }
+  void *memory = mmap(NULL, sizeof(SharedStateTable), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (memory == MAP_FAILED) {
+    log(LOG_ERROR, "Unable to map shared memory %s: %s", name.c_str(), strerror(errno));
+    exit(1);
+  }
+  table = (SharedStateTable *) memory;
+  if (table->magic == 0) {
+    table->version = SharedStateTable::VERSION;
+    table->slotCount = SharedStateTable::SLOT_COUNT;
+    table->slotSize = sizeof(SharedStateSlot);
+    table->magic = SharedStateTable::MAGIC;
+  }
+  if (table->magic != SharedStateTable::MAGIC || table->version != SharedStateTable::VERSION ||
+      table->slotSize != sizeof(SharedStateSlot)) {
+    log(LOG_ERROR, "Shared memory %s is not a compatible state table", name.c_str());
+    exit(1);
+  }
+}
+
+void SharedMemoryStateBackend::onReady(int fd, short event, void *arg) {
+  SharedMemoryStateBackend *self = (SharedMemoryStateBackend *) arg;
+  self->listener->onStateBackendReady();
+}
+
+void SharedMemoryStateBackend::onPoll(int fd, short event, void *arg) {
+  SharedMemoryStateBackend *self = (SharedMemoryStateBackend *) arg;
+  self->pollInput();
+}
+
+// A device that moved from another event loop is found by its id, a new
+// device claims a free slot
+SharedStateSlot *SharedMemoryStateBackend::findSlot(const std::string &deviceId, bool create) {
+  std::map<std::string, SharedStateSlot *>::iterator cached = slots.find(deviceId);
+  if (cached != slots.end()) {
+    return cached->second;
+  }
+  if (deviceId.length() >= SharedStateSlot::DEVICE_ID_SIZE) {
+    log(LOG_ERROR, "Device id too long for the shared memory state table: %s", deviceId.c_str());
+    return NULL;
+  }
+  SharedStateSlot *freeSlot = NULL;
+  for (uint32_t i = 0; i < SharedStateTable::SLOT_COUNT; ++i) {
+    SharedStateSlot *slot = &table->slots[i];
+    if (slot->used.load(std::memory_order_acquire) == 0) {
+      if (freeSlot == NULL) {
+        freeSlot = slot;
+      }
+    } else if (strcmp(slot->deviceId, deviceId.c_str()) == 0) {
+      slots[deviceId] = slot;
+      return slot;
+    }
+  }
+  if (!create) {
+    return NULL;
+  }
+  for (uint32_t i = freeSlot != NULL ? freeSlot - table->slots : SharedStateTable::SLOT_COUNT;
+      i < SharedStateTable::SLOT_COUNT; ++i) {
+    SharedStateSlot *slot = &table->slots[i];
+    uint32_t unused = 0;
+    if (slot->used.compare_exchange_strong(unused, 1)) {
+      uint32_t sequence = slot->stateSequence.load(std::memory_order_relaxed);
+      slot->stateSequence.store(sequence + 1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      strcpy(slot->deviceId, deviceId.c_str());
+      slot->stateLength = 0;
+      slot->stateSequence.store(sequence + 2, std::memory_order_release);
+      slot->inputConsumed.store(slot->inputSequence.load(std::memory_order_acquire), std::memory_order_release);
+      slots[deviceId] = slot;
+      return slot;
+    }
+  }
+  log(LOG_ERROR, "Shared memory state table %s is full", name.c_str());
+  return NULL;
+}
+
+// The slot is only written by the event loop that runs the device, so its
+// current state can be read without the sequence lock
+void SharedMemoryStateBackend::mergeState(SharedStateSlot *slot, const Fields &fields, size_t count) {
+  size_t mergedSize = 0;
+  const char *line = slot->state;
+  const char *end = slot->state + slot->stateLength;
+  while (line < end) {
+    const char *lineEnd = (const char *) memchr(line, '\n', end - line);
+    const char *separator = (const char *) memchr(line, ' ', lineEnd - line);
+    if (mergedSize == mergedState.size()) {
+      mergedState.push_back(std::make_pair(std::string(), std::string()));
+    }
+    mergedState[mergedSize].first.assign(line, separator - line);
+    mergedState[mergedSize].second.assign(separator + 1, lineEnd - separator - 1);
+    ++mergedSize;
+    line = lineEnd + 1;
+  }
+  for (size_t i = 0; i < count; ++i) {
+    size_t j = 0;
+    while (j < mergedSize && mergedState[j].first != fields[i].first) {
+      ++j;
+    }
+    if (j == mergedSize) {
+      if (mergedSize == mergedState.size()) {
+        mergedState.push_back(std::make_pair(std::string(), std::string()));
+      }
+      mergedState[j].first = fields[i].first;
+      ++mergedSize;
+    }
+    mergedState[j].second = fields[i].second;
+  }
+  serializedState.clear();
+  for (size_t i = 0; i < mergedSize; ++i) {
+    size_t length = mergedState[i].first.length() + mergedState[i].second.length() + 2;
+    if (serializedState.length() + length > SharedStateSlot::STATE_SIZE) {
+      log(LOG_WARNING, "State of device %s truncated at field %s", slot->deviceId, mergedState[i].first.c_str());
+      break;
+    }
+    serializedState += mergedState[i].first;
+    serializedState += ' ';
+    serializedState += mergedState[i].second;
+    serializedState += '\n';
+  }
+}
+
+// The used slots of the table are the index of the registered devices
+void SharedMemoryStateBackend::registerDevice(const std::string &deviceId) {
+  findSlot(deviceId, true);
+}
+
+// The slot stays used, the backend that takes over the device finds it again
+void SharedMemoryStateBackend::releaseDevice(const std::string &deviceId) {
+  slots.erase(deviceId);
+}
+
+void SharedMemoryStateBackend::writeState(Simulator *device, const std::string &deviceId, const Fields &fields,
+    size_t count) {
+  unsigned long start = monotonicMicros();
+  SharedStateSlot *slot = findSlot(deviceId, true);
+  if (slot == NULL) {
+    return;
+  }
+  mergeState(slot, fields, count);
+  uint32_t sequence = slot->stateSequence.load(std::memory_order_relaxed);
+  slot->stateSequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  memcpy(slot->state, serializedState.c_str(), serializedState.length());
+  slot->stateLength = serializedState.length();
+  slot->stateSequence.store(sequence + 2, std::memory_order_release);
+  device->deviceStateWritten(monotonicMicros() - start);
+}
+
+// Reads the pending input of the devices with the sequence lock. The input
+// stays pending if the device isn't run by the listener anymore.
+void SharedMemoryStateBackend::pollInput() {
+  for (std::map<std::string, SharedStateSlot *>::iterator i = slots.begin(); i != slots.end(); ++i) {
+    SharedStateSlot *slot = i->second;
+    uint32_t sequence = slot->inputSequence.load(std::memory_order_acquire);
+    if ((sequence & 1) != 0 || sequence == slot->inputConsumed.load(std::memory_order_relaxed)) {
+      continue;
+    }
+    size_t length = slot->inputLength;
+    if (length > SharedStateSlot::INPUT_SIZE) {
+      continue;
+    }
+    memcpy(input, slot->input, length);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot->inputSequence.load(std::memory_order_relaxed) != sequence) {
+      continue;
+    }
+    if (listener->onDeviceInput(i->first, input, length)) {
+      slot->inputConsumed.store(sequence, std::memory_order_release);
+    }
+  }
+}
+
+void SharedMemoryStateBackend::close(const std::vector<std::string> &deviceIds) {
+  log(LOG_INFO, "Releasing the shared memory state table...");
+  for (size_t i = 0; i < deviceIds.size(); ++i) {
+    SharedStateSlot *slot = findSlot(deviceIds[i], false);
+    if (slot == NULL) {
+      continue;
+    }
+    uint32_t sequence = slot->stateSequence.load(std::memory_order_relaxed);
+    slot->stateSequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot->deviceId[0] = '\0';
+    slot->stateLength = 0;
+    slot->stateSequence.store(sequence + 2, std::memory_order_release);
+    slot->used.store(0, std::memory_order_release);
+    slots.erase(deviceIds[i]);
+  }
+  event_free(pollEvent);
+  pollEvent = NULL;
+  munmap(table, sizeof(SharedStateTable));
+  table = NULL;
+  listener->onStateBackendClosed();
+}
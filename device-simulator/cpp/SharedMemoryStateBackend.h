@@ -0,0 +1,79 @@
+#ifndef SHARED_MEMORY_STATE_BACKEND_H
+#define SHARED_MEMORY_STATE_BACKEND_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <atomic>
+#include <StateBackend.h>
+
+// Layout of the shared memory state table, so that the UI or a test harness
+// can map it with shm_open() and mmap(). Every device uses one slot. The state
+// is stored as "<field> <value>\n" lines and is protected by a sequence lock:
+// the simulator makes stateSequence odd while it writes the slot, a reader
+// copies the slot and retries if stateSequence was odd or has changed.
+//
+// Device input is written by the reader side with the same protocol on
+// inputSequence. The simulator sets inputConsumed to the sequence number of
+// the input it has received, the next input may only be written after that.
+struct SharedStateSlot {
+  static const size_t DEVICE_ID_SIZE = 64;
+  static const size_t STATE_SIZE = 1024;
+  static const size_t INPUT_SIZE = 256;
+  std::atomic<uint32_t> used;
+  std::atomic<uint32_t> stateSequence;
+  char deviceId[DEVICE_ID_SIZE];
+  uint32_t stateLength;
+  char state[STATE_SIZE];
+  std::atomic<uint32_t> inputSequence;
+  std::atomic<uint32_t> inputConsumed;
+  uint32_t inputLength;
+  char input[INPUT_SIZE];
+};
+
+struct SharedStateTable {
+  static const uint32_t MAGIC = 0x43545354;
+  static const uint32_t VERSION = 1;
+  static const uint32_t SLOT_COUNT = 16384;
+  uint32_t magic;
+  uint32_t version;
+  uint32_t slotCount;
+  uint32_t slotSize;
+  SharedStateSlot slots[SLOT_COUNT];
+};
+
+// Stores the device state in a POSIX shared memory table instead of Redis.
+// The table is created on first use and is kept when the simulator exits,
+// only the slots of its devices are freed. The device input is polled.
+class SharedMemoryStateBackend : public StateBackend {
+public:
+  static const char *DEFAULT_NAME;
+  static const int POLL_INTERVAL_MS = 10;
+  SharedMemoryStateBackend(struct event_base *events, const std::string &name);
+  void connect(Listener *listener, const std::string &devicePattern);
+  void registerDevice(const std::string &deviceId);
+  void releaseDevice(const std::string &deviceId);
+  void writeState(Simulator *device, const std::string &deviceId, const Fields &fields, size_t count);
+  void close(const std::vector<std::string> &deviceIds);
+  const char *getName();
+
+private:
+  static void onReady(int fd, short event, void *arg);
+  static void onPoll(int fd, short event, void *arg);
+  void openTable();
+  SharedStateSlot *findSlot(const std::string &deviceId, bool create);
+  void pollInput();
+  void mergeState(SharedStateSlot *slot, const Fields &fields, size_t count);
+  struct event_base *events;
+  struct event *pollEvent;
+  std::string name;
+  Listener *listener;
+  SharedStateTable *table;
+  std::map<std::string, SharedStateSlot *> slots;
+  std::vector<std::pair<std::string, std::string> > mergedState;
+  std::string serializedState;
+  char input[SharedStateSlot::INPUT_SIZE];
+};
+
+#endif // SHARED_MEMORY_STATE_BACKEND_H
@@ -1,58 +1,153 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <signal.h>
+#include <errno.h>
+#include <time.h>
 #include <string.h>
 #include <string>
-#include <hiredis/adapters/libevent.h>
+#include <algorithm>
+#include <event2/event.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <getopt.h>
 #include <Simulator.h>
+#include <VirtualClock.h>
+#include <UdpChannel.h>
+#include <TrafficCapture.h>
+#include <Metrics.h>
+#include <StateBackend.h>
+#include <SimulatorHost.h>
+#include <CaretakerDevice.h>
 
-void setup();
-void loop();
-
-Simulator *Simulator::instance;
-BounceHandler *Simulator::bounceHandler;
-ArduinoHandler *Simulator::arduinoHandler;
+thread_local Simulator *Simulator::instance;
 
 Simulator::Simulator() {
-  instance = this;
-  redis = NULL;
-  subRedis = NULL;
-  redisConnected = false;
-  subRedisConnected = false;
-  deviceStateChanged = false;
+  if (instance == NULL) {
+    instance = this;
+  }
+  stateBackend = NULL;
+  stateWritesPending = 0;
+  stopping = false;
+  registered = false;
+  pendingStateSize = 0;
+  tickEvent = NULL;
+  socketEvent = NULL;
+  tickInterval = LOOP_INTERVAL_MS;
+  ticking = false;
+  tickActive = false;
+  nextTickMillis = 0;
   bounceHandler = NULL;
-  msgSocket = -1;
+  arduinoHandler = NULL;
+  setupFunction = NULL;
+  loopFunction = NULL;
+  deviceContext = new DeviceContext();
+  simulatorHost = NULL;
+  firmwareOwner = NULL;
+  clock = NULL;
+  virtualTime = false;
+  virtualTimeSpeedUp = 0;
+  events = NULL;
+  network = new UdpChannel(this);
+  capture = NULL;
+  metricsServer = NULL;
+  metricsPort = 0;
+  mtu = TRANSACTION_SIZE;
   currentMillis = 0;
+  tickCount = 0;
+  busyMicros = 0;
+  recentBusyMicros = 0;
 }
 
 Simulator *Simulator::getInstance() {
   return instance;
 }
 
+static unsigned long monotonicMicros() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+// The device of each type whose state is in the firmware globals of this thread
+static thread_local std::map<std::string, Simulator *> firmwareOwners;
+
+// Must be called before calling into the firmware of this simulator, so that
+// millis(), digitalWrite(), Stream, ... are routed to this instance. The
+// instance and the firmware globals are per thread, the globals are swapped
+// with the device of the same type that used them last on this thread.
+void Simulator::activate() {
+  instance = this;
+  if (firmwareOwner == NULL) {
+    firmwareOwner = &firmwareOwners[deviceType];
+  }
+  Simulator *owner = *firmwareOwner;
+  if (owner == this) {
+    return;
+  }
+  *firmwareOwner = this;
+  if (owner != NULL) {
+    owner->saveFirmwareState();
+  }
+  restoreFirmwareState();
+}
+
+// Must be called on the current thread before the device moves to another
+// one, it saves the firmware globals of this thread if they are the device's
+void Simulator::releaseFirmware() {
+  if (firmwareOwner == NULL) {
+    return;
+  }
+  if (*firmwareOwner == this) {
+    saveFirmwareState();
+    *firmwareOwner = NULL;
+  }
+  firmwareOwner = NULL;
+}
+
 int Simulator::run(int argc, char* argv[]) {
   parseProgramArgs(argc, argv);
 
-  setbuf(stdout, NULL);
-  setbuf(stderr, NULL);
+  if (!replayFile.empty()) {
+    return replay();
+  }
   log("Simulator starting...");
   initEvents();
   initNetwork();
-  connectToRedis();
-  setup();
-  log("Entering event loop");
-  event_base_dispatch(events);
+  connectToStateBackend();
+  if (metricsPort > 0) {
+    startMetricsServer();
+  }
+  activate();
+  (*setupFunction)();
+  flushMessagesToServer();
+  if (virtualTime) {
+    log("Entering event loop (virtual time)");
+    clock->run();
+  } else {
+    log("Entering event loop");
+    event_base_dispatch(events);
+  }
+  stopCapture();
   return 0;
 }
 
 void Simulator::log(const char *format, ...) {
   va_list args;
   va_start (args, format);
-  vprintf (format, args);
+  vlog(LOG_INFO, format, args);
+  va_end (args);
+}
+
+void Simulator::log(LogLevel level, const char *format, ...) {
+  va_list args;
+  va_start (args, format);
+  vlog(level, format, args);
   va_end (args);
-  printf("\n");
+}
+
+// Devices of a simulator host are tagged with their device id
+void Simulator::vlog(LogLevel level, const char *format, va_list args) {
+  Logger::getInstance()->log(level, simulatorHost != NULL ? deviceId.c_str() : NULL, format, args);
 }
 
 void Simulator::setBounceHandler(BounceHandler *bounceHandler) {
@@ -60,7 +155,7 @@ void Simulator::setBounceHandler(BounceHandler *bounceHandler) {
 }
 
 BounceHandler *Simulator::getBounceHandler() {
-  return bounceHandler;
+  return instance->bounceHandler;
 }
 
 void Simulator::setArduinoHandler(ArduinoHandler *arduinoHandler) {
@@ -68,21 +163,22 @@ void Simulator::setArduinoHandler(ArduinoHandler *arduinoHandler) {
 }
 
 ArduinoHandler *Simulator::getArduinoHandler() {
-  return arduinoHandler;
+  return instance->arduinoHandler;
 }
 
 void Simulator::sendMessageToServer(std::string &msg) {
-  sendto(msgSocket, msg.c_str(), msg.length(), 0, (struct sockaddr *) &serverAddress, sizeof(struct sockaddr));
+  tickActive = true;
+  network->send(msg);
 }
 
-void Simulator::onSigInt(int signo) {
+void Simulator::onStopSignal(int signo) {
   instance->log("Terminating...");
   if (instance->events) {
-    instance->disconnectFromRedis();
+    instance->disconnectFromStateBackend();
   }
 }
 
-std::string &Simulator::getMessageFromServer() {
+ReceiveBuffer &Simulator::getMessageFromServer() {
   return messageFromServer;
 }
 
@@ -98,96 +194,94 @@ void Simulator::setDeviceType(std::string deviceType) {
   this->deviceType = deviceType;
 }
 
+void Simulator::setFirmware(FirmwareFunction setup, FirmwareFunction loop) {
+  setupFunction = setup;
+  loopFunction = loop;
+}
+
+DeviceContext *Simulator::getDeviceContext() {
+  return deviceContext;
+}
+
 unsigned long Simulator::getCurrentMillis() {
   return currentMillis;
 }
 
-void Simulator::onRedisConnected(const redisAsyncContext *redis, int status) {
-  Simulator *self = (Simulator *) redis->data;
-  if (status != REDIS_OK) {
-    self->log("Error: %s", redis->errstr);
-    exit(1);
-  }
-  if (redis == self->redis) {
-    self->log("Redis command connection established");
-    self->redisConnected = true;
-  }
-  if (redis == self->subRedis) {
-    self->log("Redis pub/sub connection established");
-    self->subRedisConnected = true;
-  }
-  if (self->redisConnected && self->subRedisConnected) {
-    self->initDeviceState();
-    self->nextTick();
-  }
+int Simulator::getMtu() {
+  return mtu;
 }
 
-void Simulator::onRedisDisconnected(const redisAsyncContext *redis, int status) {
-  Simulator *self = (Simulator *) redis->data;
-  if (status != REDIS_OK) {
-    self->log("Error: %s", redis->errstr);
-    return;
-  }
-  if (redis == self->redis) {
-    self->log("Redis command connection closed");
-    self->redis = NULL;
-  }
-  if (redis == self->subRedis) {
-    self->log("Redis pub/sub connection closed");
-    self->subRedis = NULL;
-  }
-  if (self->redis == NULL && self->subRedis == NULL) {
-    event_base_loopbreak(self->events);
-  }
+SimulatorMetrics &Simulator::getMetrics() {
+  return metrics;
 }
 
-void Simulator::onDeviceStateChanged(redisAsyncContext *redis, void *_reply, void *data) {
-  Simulator *self = (Simulator *) redis->data;
-  redisReply *reply  = (redisReply *) _reply;
-  if (reply == NULL) {
-    return;
-  }
-  if (reply->type == REDIS_REPLY_ARRAY && reply->elements == 3) {
-    if (strcmp(reply->element[0]->str, "message") == 0) {
-      self->deviceStateChanged = true;
-    }
-  }
+void Simulator::onStateBackendReady() {
+  initDeviceState();
+  flushDeviceState();
+  nextTick();
+}
+
+void Simulator::onStateBackendClosed() {
+  stateBackend = NULL;
+  event_base_loopbreak(events);
+}
+
+bool Simulator::onDeviceInput(const std::string &deviceId, const char *message, size_t length) {
+  receiveDeviceInput(message, length);
+  return true;
 }
 
-void Simulator::onDeviceStateReceived(redisAsyncContext *redis, void *_reply, void *data) {
-  Simulator *self = (Simulator *) redis->data;
-  redisReply *reply  = (redisReply *) _reply;
-  if (reply == NULL) {
+// Device input messages have the form "<field> <value>" and are published by
+// the UI on caretaker.devices.<id>.input. The device state hash itself is not
+// watched, so the state updates of the simulator don't trigger re-reads.
+void Simulator::receiveDeviceInput(const char *message, size_t length) {
+  const char *separator = (const char *) memchr(message, ' ', length);
+  if (separator == NULL) {
     return;
   }
-  if (reply->type == REDIS_REPLY_ARRAY) {
-    std::string msg = "New device state:";
-    std::map<std::string, std::string> state;
-    for (int i = 0; i < reply->elements; i += 2) {
-      std::string key = reply->element[i]->str;
-      std::string val = reply->element[i + 1]->str;
-      state[key] = val;
-      msg += " " + key + "=" + val;
-    }
-    self->log(msg.c_str());
-    self->updateDeviceState(state);
+  std::string key(message, separator - message);
+  std::string value(separator + 1, length - (separator + 1 - message));
+  log(LOG_DEBUG, "Device input: %s=%s", key.c_str(), value.c_str());
+  if (capture != NULL) {
+    capture->write(TrafficCapture::DEVICE_INPUT, currentMillis, message, length);
   }
-}
-
-void Simulator::onDeviceKeyDeleted(redisAsyncContext *redis, void *reply, void *data) {
-  Simulator *self = (Simulator *) redis->data;
-  redisAsyncDisconnect(self->subRedis);
-  redisAsyncDisconnect(self->redis);
+  updateDeviceState(key, value);
+  wakeUp();
 }
 
 void Simulator::onMessageReceivedFromServer(int fd, short event, void *arg) {
   Simulator *self = (Simulator *) arg;
-  char buf[256];
-  struct sockaddr_in addr;
-	socklen_t addrSize = sizeof(addr);
-  int len = recvfrom(self->msgSocket, &buf, sizeof(buf) - 1, 0, (struct sockaddr *) &addr, &addrSize);
-  buf[len] = '\0';
-  self->messageFromServer += buf;
+  self->receiveMessagesFromServer();
+}
+
+void Simulator::receiveMessagesFromServer() {
+  unsigned long overflows = messageFromServer.getOverflows();
+  if (network->receive(messageFromServer) > 0) {
+    wakeUp();
+  }
+  if (messageFromServer.getOverflows() != overflows) {
+    log(LOG_WARNING, "Messages from server dropped, receive buffer full (%lu overflows)",
+      messageFromServer.getOverflows());
+  }
+}
+
+// Sends the messages of this tick with one sendmmsg() and reports the UDP
+// syscalls since the previous tick
+void Simulator::flushMessagesToServer() {
+  network->flush();
+  UdpChannel::Statistics &statistics = network->getStatistics();
+  if (Logger::getInstance()->isEnabled(LOG_DEBUG) &&
+      (statistics.received > 0 || statistics.sent > 0 || statistics.dropped > 0)) {
+    log(LOG_DEBUG, "UDP: received %lu datagrams in %lu syscalls, sent %lu datagrams in %lu syscalls, dropped %lu",
+      statistics.received, statistics.receiveCalls, statistics.sent, statistics.sendCalls,
+      statistics.dropped);
+  }
+  metrics.datagramsReceived.add(statistics.received);
+  metrics.bytesReceived.add(statistics.receivedBytes);
+  metrics.datagramsSent.add(statistics.sent);
+  metrics.bytesSent.add(statistics.sentBytes);
+  metrics.datagramsDropped.add(statistics.dropped);
+  network->resetStatistics();
 }
 
 void Simulator::onTick(int fd, short event, void *arg) {
@@ -200,18 +294,27 @@ void Simulator::parseProgramArgs(int argc, char* argv[]) {
   port = 2000;
   serverHost = "localhost";
   serverPort = 2000;
-  redisHost = "localhost";
-  redisPort = 6379;
+  stateOptions.type = "redis";
+  stateOptions.redisHost = "localhost";
+  stateOptions.redisPort = 6379;
+  stateOptions.poolSize = 1;
   static struct option longOptions[] = {
     {"name", required_argument, 0, 'n'},
     {"bind", required_argument, 0, 'b'},
     {"port", required_argument, 0, 'p'},
     {"server", required_argument, 0, 's'},
     {"redis", required_argument, 0, 'r'},
+    {"state", required_argument, 0, 'S'},
+    {"virtual-time", optional_argument, 0, 't'},
+    {"log-level", required_argument, 0, 'l'},
+    {"capture", required_argument, 0, 'C'},
+    {"replay", required_argument, 0, 'R'},
+    {"metrics", required_argument, 0, 'm'},
+    {"mtu", required_argument, 0, 'u'},
     {"help", no_argument, 0, 'h'},
     {0, 0, 0, 0}
   };
-  static const char *shortOptions = "n:p:b:s:r:h";
+  static const char *shortOptions = "n:p:b:s:r:S:t::l:C:R:m:u:h";
   int c;
   int longIndex = 0;
   while ((c = getopt_long(argc, argv, shortOptions, longOptions, &longIndex)) != -1) {
@@ -235,14 +338,47 @@ void Simulator::parseProgramArgs(int argc, char* argv[]) {
           break;
         }
       case 'r' : {
-        redisHost = optarg;
+        std::string redisHost = optarg;
         int colonIndex = redisHost.find(':');
         if (colonIndex != -1) {
-          redisPort = std::stoi(redisHost.substr(redisHost.find(':') + 1, -1));
+          stateOptions.redisPort = std::stoi(redisHost.substr(redisHost.find(':') + 1, -1));
+        }
+        stateOptions.redisHost = redisHost.substr(0, colonIndex);
+        break;
+      }
+      case 'S':
+        if (!StateBackend::parseType(optarg, &stateOptions)) {
+          printf("%s: Invalid state backend: %s\n", argv[0], optarg);
+          exit(1);
+        }
+        break;
+      case 't':
+        virtualTime = true;
+        if (optarg) {
+          virtualTimeSpeedUp = std::stod(optarg);
+        }
+        break;
+      case 'l': {
+        LogLevel level;
+        if (!Logger::parseLevel(optarg, &level)) {
+          printf("%s: Invalid log level: %s\n", argv[0], optarg);
+          exit(1);
         }
-        redisHost = redisHost.substr(0, colonIndex);
+        Logger::getInstance()->setLevel(level);
         break;
       }
+      case 'C':
+        captureFile = optarg;
+        break;
+      case 'R':
+        replayFile = optarg;
+        break;
+      case 'm':
+        metricsPort = atoi(optarg);
+        break;
+      case 'u':
+        mtu = atoi(optarg);
+        break;
       case 'h':
         printf("Usage: %s DEVICE_ID\n", argv[0]);
         printf("  -n, --name=DEVICE_NAME    if not specified, the device id is used as the device name\n");
@@ -250,6 +386,18 @@ void Simulator::parseProgramArgs(int argc, char* argv[]) {
         printf("  -p, --port=PORT_NUMBER    the port number for UDP communication (default: 2000)\n");
         printf("  -s, --server=SERVER       the server host and (optional) port (default: localhost:2000)\n");
         printf("  -r, --redis=REDIS_SERVER  the host name/ip address of the Redis server (default: localhost:6379)\n");
+        printf("  -S, --state=BACKEND       where the device state is stored, redis or shm[:NAME] for a\n");
+        printf("                            shared memory table (default: redis, NAME: /caretaker-devices)\n");
+        printf("  -t, --virtual-time[=SPEEDUP]  run in virtual time, as fast as possible or SPEEDUP times\n");
+        printf("                            faster than real time\n");
+        printf("  -l, --log-level=LEVEL     log only messages of LEVEL and above, one of debug, info,\n");
+        printf("                            warning, error (default: info)\n");
+        printf("  -C, --capture=FILE        record the UDP traffic and the device input and state to FILE\n");
+        printf("  -R, --replay=FILE         feed the received UDP messages and device input of a capture\n");
+        printf("                            into the firmware as fast as possible, without server and Redis\n");
+        printf("  -m, --metrics=PORT        serve Prometheus metrics on http://HOST:PORT/metrics\n");
+        printf("  -u, --mtu=BYTES           pack the commands sent during a loop() into datagrams of up to\n");
+        printf("                            BYTES, 0 sends every command separately (default: %d)\n", TRANSACTION_SIZE);
         printf("  -h, --help                print this help\n");
         exit(0);
       case 0:
@@ -259,26 +407,31 @@ void Simulator::parseProgramArgs(int argc, char* argv[]) {
         exit(1);
     }
   }
-  if (optind == argc) {
+  if (optind == argc && !replayFile.empty()) {
+    deviceId = "replay";
+  } else if (optind == argc) {
     printf("%s: Missing device id\n", argv[0]);
     printf("»%s --help« prints more help\n", argv[0]);
     exit(1);
+  } else {
+    deviceId = argv[optind];
   }
-  deviceId = argv[optind];
   if (deviceName.empty()) {
     deviceName = deviceId;
   }
 }
 
 void Simulator::initEvents() {
-  signal(SIGINT, onSigInt);
+  signal(SIGINT, onStopSignal);
+  signal(SIGTERM, onStopSignal);
   signal(SIGPIPE, SIG_IGN);
   events = event_base_new();
+  if (virtualTime) {
+    clock = new VirtualClock(events, virtualTimeSpeedUp);
+  }
 }
 
 void Simulator::initNetwork() {
-  msgSocket = socket(PF_INET, SOCK_DGRAM, 0);
-
   memset(&serverAddress, 0, sizeof(serverAddress));
   serverAddress.sin_family = AF_INET;
   serverAddress.sin_port = htons(serverPort);
@@ -291,80 +444,281 @@ void Simulator::initNetwork() {
   deviceAddress.sin_port = htons(port);
   inet_aton(host.c_str(), &deviceAddress.sin_addr);
 
-  bind(msgSocket, (struct sockaddr *) &deviceAddress, sizeof(struct sockaddr));
+  if (!network->open(deviceAddress, serverAddress)) {
+    log(LOG_ERROR, "Unable to open UDP port %d: %s", port, strerror(errno));
+    exit(1);
+  }
 
-  struct event *socketEvent;
-  socketEvent = event_new(events, msgSocket, EV_READ | EV_PERSIST, onMessageReceivedFromServer, this);
-  event_add(socketEvent, NULL);
+  attachEvents();
+  if (!captureFile.empty()) {
+    startCapture();
+  }
 }
 
-void Simulator::connectToRedis() {
-  log("Connecting to Redis...");
-  redis = redisAsyncConnect(redisHost.c_str(), redisPort);
-  if (redis != NULL && redis->err) {
-    printf("Error: %s\n", redis->errstr);
+void Simulator::startMetricsServer() {
+  metricsServer = new MetricsServer(events, std::vector<Simulator *>(1, this));
+  if (!metricsServer->listen(host, metricsPort)) {
+    log(LOG_ERROR, "Unable to open metrics port %d: %s", metricsPort, strerror(errno));
     exit(1);
   }
-  subRedis = redisAsyncConnect(redisHost.c_str(), redisPort);
-  if (subRedis != NULL && subRedis->err) {
-    printf("Error: %s\n", subRedis->errstr);
+  log("Serving metrics on http://%s:%d/metrics", host.c_str(), metricsPort);
+}
+
+void Simulator::startCapture() {
+  capture = new TrafficCapture();
+  if (!capture->openForWriting(captureFile)) {
+    log(LOG_ERROR, "Unable to write capture %s: %s", captureFile.c_str(), strerror(errno));
     exit(1);
   }
-  redis->data = this;
-  subRedis->data = this;
-  redisLibeventAttach(redis, events);
-  redisLibeventAttach(subRedis, events);
-  redisAsyncSetConnectCallback(redis, onRedisConnected);
-  redisAsyncSetConnectCallback(subRedis, onRedisConnected);
-  redisAsyncSetDisconnectCallback(redis, onRedisDisconnected);
-  redisAsyncSetDisconnectCallback(subRedis, onRedisDisconnected);
+  network->setCapture(capture);
+  log("Capturing to %s", captureFile.c_str());
+}
+
+// Writes the buffered records, called when the event loop has ended
+void Simulator::stopCapture() {
+  if (capture == NULL) {
+    return;
+  }
+  network->setCapture(NULL);
+  capture->close();
+  delete capture;
+  capture = NULL;
+}
+
+// The events are recreated when the device moves to the event base of
+// another shard
+void Simulator::attachEvents() {
+  socketEvent = event_new(events, network->getSocket(), EV_READ | EV_PERSIST, onMessageReceivedFromServer, this);
+  event_add(socketEvent, NULL);
+}
+
+void Simulator::detachEvents() {
+  event_free(socketEvent);
+  socketEvent = NULL;
+  if (tickEvent != NULL) {
+    event_free(tickEvent);
+    tickEvent = NULL;
+  }
+  ticking = false;
+}
+
+void Simulator::connectToStateBackend() {
+  stateBackend = StateBackend::create(stateOptions, events);
+  stateBackend->connect(this, deviceId);
+  registerDevice();
+}
 
-  redisAsyncCommand(redis, NULL, NULL, "CONFIG set notify-keyspace-events KEA");
-  std::string cmd = "HMSET caretaker.devices." + deviceId + " id " + deviceId +
-    " type " + deviceType  + " name " + deviceName;
-  redisAsyncCommand(redis, NULL, NULL, cmd.c_str());
-  cmd = "SUBSCRIBE __keyspace@0__:caretaker.devices." + deviceId;
-  redisAsyncCommand(subRedis, onDeviceStateChanged, NULL, cmd.c_str());
+void Simulator::registerDevice() {
+  stateBackend->registerDevice(deviceId);
+  sendDeviceState("id", deviceId);
+  sendDeviceState("type", deviceType);
+  sendDeviceState("name", deviceName);
+  flushDeviceState();
 }
 
-void Simulator::disconnectFromRedis() {
-  log("Disconnect from Redis...");
-  std::string cmd = "DEL caretaker.devices." + deviceId;
-  redisAsyncCommand(redis, onDeviceKeyDeleted, NULL, cmd.c_str());
+void Simulator::disconnectFromStateBackend() {
+  if (stateBackend != NULL && !stopping) {
+    stopping = true;
+    stateBackend->close(std::vector<std::string>(1, deviceId));
+  }
 }
 
 void Simulator::tick() {
-  currentMillis += LOOP_INTERVAL_MS;
-  loop();
-  if (deviceStateChanged) {
-    log("Device state has changed");
-    deviceStateChanged = false;
-    std::string cmd = "HGETALL caretaker.devices." + deviceId;
-    log(("Getting device state with \"" + cmd + "\"").c_str());
-    redisAsyncCommand(redis, onDeviceStateReceived, NULL, cmd.c_str());
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  if (clock != NULL) {
+    currentMillis = clock->getCurrentMillis();
+  } else {
+    struct timeval now, elapsed;
+    event_base_gettimeofday_cached(events, &now);
+    evutil_timersub(&now, &lastTickTime, &elapsed);
+    unsigned long elapsedMillis = elapsed.tv_sec * 1000 + elapsed.tv_usec / 1000;
+    struct timeval counted;
+    counted.tv_sec = elapsedMillis / 1000;
+    counted.tv_usec = (elapsedMillis % 1000) * 1000;
+    evutil_timeradd(&lastTickTime, &counted, &lastTickTime);
+    currentMillis += elapsedMillis;
   }
+  activate();
+  unsigned long loopStart = monotonicMicros();
+  (*loopFunction)();
+  deviceContext->messenger.endTransaction();
+  metrics.loopMicros.add(monotonicMicros() - loopStart);
+  flushDeviceState();
+  flushMessagesToServer();
+  // Back off while the device is idle, wakeUp() snaps back on new input
+  if (tickActive || messageFromServer.available() > 0) {
+    tickInterval = LOOP_INTERVAL_MS;
+  } else if (tickInterval < MAX_LOOP_INTERVAL_MS) {
+    tickInterval = std::min(tickInterval * 2, (int) MAX_LOOP_INTERVAL_MS);
+  }
+  tickActive = false;
   nextTick();
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  ++tickCount;
+  unsigned long tickMicros = (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000;
+  busyMicros += tickMicros;
+  metrics.tickDuration.observe(tickMicros);
 }
 
 void Simulator::nextTick() {
+  ticking = true;
+  if (clock != NULL) {
+    nextTickMillis = clock->getCurrentMillis() + tickInterval;
+    clock->schedule(this, nextTickMillis);
+    return;
+  }
+  if (tickEvent == NULL) {
+    tickEvent = evtimer_new(events, onTick, this);
+    event_base_gettimeofday_cached(events, &lastTickTime);
+  }
   struct timeval tv;
-  tv.tv_sec = 0;
-  tv.tv_usec = LOOP_INTERVAL_MS * 1000;
-  struct event *ev = event_new(events, 0, EV_TIMEOUT, onTick, this);
-  evtimer_add(ev, &tv);
+  tv.tv_sec = tickInterval / 1000;
+  tv.tv_usec = (tickInterval % 1000) * 1000;
+  evtimer_add(tickEvent, &tv);
+}
+
+void Simulator::wakeUp() {
+  tickActive = true;
+  if (ticking && tickInterval > LOOP_INTERVAL_MS) {
+    tickInterval = LOOP_INTERVAL_MS;
+    nextTick();
+  }
 }
 
 void Simulator::sendDeviceState(DeviceState &state) {
-  std::string cmd = "HMSET caretaker.devices." + deviceId;
   for (DeviceState::iterator i = state.begin(); i != state.end(); ++i) {
-    cmd += " " + i->first + " " + i->second;
+    sendDeviceState(i->first, i->second);
   }
-  log(("Updating device state with \"" + cmd + "\"").c_str());
-  redisAsyncCommand(redis, NULL, NULL, cmd.c_str());
 }
 
-void Simulator::sendDeviceState(std::string key, std::string value) {
-  std::string cmd = "HMSET caretaker.devices." + deviceId + " " + key + " " + value;
-  log(("Updating device state with \"" + cmd + "\"").c_str());
-  redisAsyncCommand(redis, NULL, NULL, cmd.c_str());
+// Device state updates are collected during a tick and written with a single
+// HSET by flushDeviceState(). The field strings are reused between ticks.
+void Simulator::sendDeviceState(const std::string &key, const std::string &value) {
+  tickActive = true;
+  for (size_t i = 0; i < pendingStateSize; ++i) {
+    if (pendingState[i].first == key) {
+      pendingState[i].second = value;
+      return;
+    }
+  }
+  if (pendingStateSize == pendingState.size()) {
+    pendingState.push_back(std::make_pair(std::string(), std::string()));
+  }
+  pendingState[pendingStateSize].first = key;
+  pendingState[pendingStateSize].second = value;
+  ++pendingStateSize;
+}
+
+void Simulator::flushDeviceState() {
+  if (pendingStateSize == 0) {
+    return;
+  }
+  bool logState = Logger::getInstance()->isEnabled(LOG_DEBUG);
+  std::string msg = "Updating device state:";
+  for (size_t i = 0; i < pendingStateSize; ++i) {
+    if (logState) {
+      msg += " " + pendingState[i].first + "=" + pendingState[i].second;
+    }
+    if (capture != NULL) {
+      std::string field = pendingState[i].first + " " + pendingState[i].second;
+      capture->write(TrafficCapture::DEVICE_STATE, currentMillis, field.c_str(), field.length());
+    }
+  }
+  if (logState) {
+    log(LOG_DEBUG, "%s", msg.c_str());
+  }
+  if (stateBackend != NULL) {
+    ++stateWritesPending;
+    metrics.stateWritesInFlight.set(stateWritesPending);
+    stateBackend->writeState(this, deviceId, pendingState, pendingStateSize);
+  }
+  pendingStateSize = 0;
+}
+
+// Called by the firmware when the server has answered a registration request
+void Simulator::deviceRegistered() {
+  if (!registered) {
+    registered = true;
+    if (simulatorHost != NULL) {
+      simulatorHost->deviceRegistered();
+    }
+  }
+}
+
+// Called by the state backend when a write of flushDeviceState() is done
+void Simulator::deviceStateWritten(unsigned long latencyMicros) {
+  metrics.stateWriteLatency.observe(latencyMicros);
+  if (stateWritesPending > 0) {
+    --stateWritesPending;
+  }
+  metrics.stateWritesInFlight.set(stateWritesPending);
+}
+
+// Replays the received messages and device input of a capture. The firmware
+// loop runs whenever the virtual time of the capture advances, so messages
+// that were received together are processed together. Sent messages and
+// state updates are discarded.
+int Simulator::replay() {
+  TrafficCapture replayCapture;
+  if (!replayCapture.openForReading(replayFile)) {
+    log(LOG_ERROR, "Unable to read capture %s", replayFile.c_str());
+    return 1;
+  }
+  log("Replaying %s...", replayFile.c_str());
+  activate();
+  (*setupFunction)();
+  initDeviceState();
+  replayTick();
+  network->resetStatistics();
+  TrafficCapture::Record record;
+  unsigned long records = 0;
+  unsigned long datagrams = 0;
+  unsigned long bytes = 0;
+  bool pending = false;
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  while (replayCapture.read(record)) {
+    ++records;
+    if (record.millis != currentMillis && pending) {
+      replayTick();
+      pending = false;
+    }
+    currentMillis = record.millis;
+    switch (record.type) {
+      case TrafficCapture::UDP_RECEIVED:
+        // Run the firmware early if a burst doesn't fit into the buffer
+        if (!messageFromServer.write(record.data.c_str(), record.data.length())) {
+          replayTick();
+          messageFromServer.write(record.data.c_str(), record.data.length());
+        }
+        ++datagrams;
+        bytes += record.data.length();
+        pending = true;
+        break;
+      case TrafficCapture::DEVICE_INPUT:
+        receiveDeviceInput(record.data.c_str(), record.data.length());
+        pending = true;
+        break;
+      default:
+        break;
+    }
+  }
+  if (pending) {
+    replayTick();
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  log("Replayed %lu records, %lu datagrams (%lu bytes) in %.3f s, %.0f datagrams/s, %lu messages sent, "
+    "%lu overflows", records, datagrams, bytes, elapsed, elapsed > 0 ? datagrams / elapsed : 0.0,
+    network->getStatistics().sent, messageFromServer.getOverflows());
+  return 0;
+}
+
+void Simulator::replayTick() {
+  activate();
+  (*loopFunction)();
+  deviceContext->messenger.endTransaction();
+  flushDeviceState();
+  network->flush();
 }
@@ -1,79 +1,142 @@
 #ifndef SIMULATOR_H
 #define SIMULATOR_H
 
-#include <hiredis/hiredis.h>
-#include <hiredis/async.h>
 #include <string>
 #include <map>
+#include <vector>
 #include <netinet/in.h>
+#include <ReceiveBuffer.h>
+#include <Logger.h>
+#include <Metrics.h>
+#include <StateBackend.h>
 
 class BounceHandler;
 class ArduinoHandler;
+class SimulatorHost;
+class SimulatorShard;
+class VirtualClock;
+class UdpChannel;
+class TrafficCapture;
+struct DeviceContext;
+class Simulator;
 
-class Simulator {
+class Simulator : public StateBackend::Listener {
+  friend class SimulatorHost;
+  friend class SimulatorShard;
+  friend class VirtualClock;
 public:
+  typedef void (*FirmwareFunction)();
   Simulator();
   static Simulator *getInstance();
+  void activate();
+  void releaseFirmware();
   int run(int argc, char* argv[]);
   void log(const char *format, ...);
+  void log(LogLevel level, const char *format, ...);
   void setBounceHandler(BounceHandler *bounceHandler);
   static BounceHandler *getBounceHandler();
   void setArduinoHandler(ArduinoHandler *arduinoHandler);
   static ArduinoHandler *getArduinoHandler();
   void sendMessageToServer(std::string &msg);
-  std::string &getMessageFromServer();
+  ReceiveBuffer &getMessageFromServer();
   std::string getDeviceId();
   std::string getDeviceName();
   void setDeviceType(std::string deviceType);
+  void setFirmware(FirmwareFunction setup, FirmwareFunction loop);
+  DeviceContext *getDeviceContext();
   unsigned long getCurrentMillis();
+  int getMtu();
+  SimulatorMetrics &getMetrics();
+  void deviceStateWritten(unsigned long latencyMicros);
+  void deviceRegistered();
+  void onStateBackendReady();
+  void onStateBackendClosed();
+  bool onDeviceInput(const std::string &deviceId, const char *message, size_t length);
 
 protected:
   typedef std::map<std::string, std::string> DeviceState;
   void sendDeviceState(DeviceState &state);
-  void sendDeviceState(std::string key, std::string value);
+  void sendDeviceState(const std::string &key, const std::string &value);
+  virtual void saveFirmwareState() {}
+  virtual void restoreFirmwareState() {}
 
 private:
-  static void onSigInt(int signo);
-  static void onRedisConnected(const redisAsyncContext *redis, int status);
-  static void onRedisDisconnected(const redisAsyncContext *redis, int status);
-  static void onDeviceStateChanged(redisAsyncContext *redis, void *reply, void *data);
-  static void onDeviceStateReceived(redisAsyncContext *redis, void *reply, void *data);
+  static void onStopSignal(int signo);
   static void onTick(int fd, short event, void *arg);
-  static void onDeviceKeyDeleted(redisAsyncContext *redis, void *reply, void *data);
   static void onMessageReceivedFromServer(int fd, short event, void *arg);
   void parseProgramArgs(int argc, char* argv[]);
+  void vlog(LogLevel level, const char *format, va_list args);
   void initEvents();
   void initNetwork();
-  void connectToRedis();
-  void disconnectFromRedis();
+  void attachEvents();
+  void startCapture();
+  void stopCapture();
+  void startMetricsServer();
+  int replay();
+  void replayTick();
+  void detachEvents();
+  void connectToStateBackend();
+  void registerDevice();
+  void disconnectFromStateBackend();
   void tick();
   void nextTick();
+  void wakeUp();
+  void receiveDeviceInput(const char *message, size_t length);
+  void receiveMessagesFromServer();
+  void flushMessagesToServer();
+  void flushDeviceState();
   virtual void initDeviceState() {}
-  virtual void updateDeviceState(DeviceState &state) {}
-  static Simulator *instance;
-  static BounceHandler *bounceHandler;
-  static ArduinoHandler *arduinoHandler;
+  virtual void updateDeviceState(const std::string &key, const std::string &value) {}
+  static thread_local Simulator *instance;
   static const int LOOP_INTERVAL_MS = 10;
+  static const int MAX_LOOP_INTERVAL_MS = 1000;
+  BounceHandler *bounceHandler;
+  ArduinoHandler *arduinoHandler;
+  FirmwareFunction setupFunction;
+  FirmwareFunction loopFunction;
+  DeviceContext *deviceContext;
+  SimulatorHost *simulatorHost;
+  Simulator **firmwareOwner;
+  VirtualClock *clock;
+  bool virtualTime;
+  double virtualTimeSpeedUp;
   std::string deviceId;
   std::string deviceName;
-  redisAsyncContext *redis;
-  redisAsyncContext *subRedis;
-  bool redisConnected;
-  bool subRedisConnected;
+  std::vector<std::pair<std::string, std::string> > pendingState;
+  size_t pendingStateSize;
+  StateBackend *stateBackend;
+  StateBackend::Options stateOptions;
+  unsigned long stateWritesPending;
+  bool stopping;
+  bool registered;
   struct event_base *events;
-  bool deviceStateChanged;
+  struct event *tickEvent;
+  struct event *socketEvent;
+  struct timeval lastTickTime;
+  int tickInterval;
+  bool ticking;
+  bool tickActive;
+  unsigned long nextTickMillis;
   struct sockaddr_in serverAddress;
   struct sockaddr_in deviceAddress;
-  int msgSocket;
-  std::string messageFromServer;
+  UdpChannel *network;
+  TrafficCapture *capture;
+  std::string captureFile;
+  std::string replayFile;
+  SimulatorMetrics metrics;
+  MetricsServer *metricsServer;
+  int metricsPort;
+  ReceiveBuffer messageFromServer;
   std::string host;
   int port;
   std::string serverHost;
   int serverPort;
-  std::string redisHost;
-  int redisPort;
+  int mtu;
   std::string deviceType;
   unsigned long currentMillis;
+  unsigned long tickCount;
+  unsigned long busyMicros;
+  unsigned long recentBusyMicros;
 };
 
 #endif // SIMULATOR_H
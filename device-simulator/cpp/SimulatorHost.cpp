@@ -0,0 +1,339 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <signal.h>
+#include <errno.h>
+#include <string.h>
+#include <string>
+#include <functional>
+#include <thread>
+#include <event2/thread.h>
+#include <getopt.h>
+#include <SimulatorHost.h>
+#include <SimulatorShard.h>
+#include <Simulator.h>
+#include <Metrics.h>
+#include <CmdMessenger.h>
+
+SimulatorHost *SimulatorHost::instance;
+
+SimulatorHost::SimulatorHost() : registeredDevices(0) {
+  instance = this;
+  virtualTime = false;
+  virtualTimeSpeedUp = 0;
+}
+
+SimulatorHost::DeviceTypes &SimulatorHost::getDeviceTypes() {
+  static DeviceTypes deviceTypes;
+  return deviceTypes;
+}
+
+void SimulatorHost::registerDeviceType(std::string type, DeviceFactory factory) {
+  getDeviceTypes()[type] = factory;
+}
+
+// The first shard runs on the calling thread, it also handles SIGINT and SIGTERM
+int SimulatorHost::run(int argc, char* argv[]) {
+  clock_gettime(CLOCK_MONOTONIC, &startTime);
+  parseProgramArgs(argc, argv);
+
+  signal(SIGPIPE, SIG_IGN);
+  evthread_use_pthreads();
+  log("Simulator host starting with %zu devices on %d threads...", devices.size(), threads);
+  createShards();
+  if (metricsPort > 0) {
+    startMetricsServer();
+  }
+  for (size_t i = 1; i < shards.size(); ++i) {
+    shards[i]->start();
+  }
+  shards[0]->run();
+  for (size_t i = 1; i < shards.size(); ++i) {
+    shards[i]->join();
+  }
+  return 0;
+}
+
+void SimulatorHost::log(const char *format, ...) {
+  va_list args;
+  va_start (args, format);
+  Logger::getInstance()->log(LOG_INFO, NULL, format, args);
+  va_end (args);
+}
+
+void SimulatorHost::log(LogLevel level, const char *format, ...) {
+  va_list args;
+  va_start (args, format);
+  Logger::getInstance()->log(level, NULL, format, args);
+  va_end (args);
+}
+
+void SimulatorHost::stop() {
+  log("Terminating...");
+  for (size_t i = 0; i < shards.size(); ++i) {
+    shards[i]->stop();
+  }
+}
+
+// The metrics are served by the first shard, the counters of the devices on
+// the other shards are read without locking
+void SimulatorHost::startMetricsServer() {
+  MetricsServer *metricsServer = new MetricsServer(shards[0]->getEvents(), devices);
+  if (!metricsServer->listen(host, metricsPort)) {
+    log(LOG_ERROR, "Unable to open metrics port %d: %s", metricsPort, strerror(errno));
+    exit(1);
+  }
+  log("Serving metrics on http://%s:%d/metrics", host.c_str(), metricsPort);
+}
+
+// Called by the devices when the server has answered their first
+// registration request, on the thread of their shard
+void SimulatorHost::deviceRegistered() {
+  if (registeredDevices.fetch_add(1) + 1 == devices.size()) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double elapsed = (now.tv_sec - startTime.tv_sec) + (now.tv_nsec - startTime.tv_nsec) / 1e9;
+    log("All %zu devices registered with the server %.3f s after the start", devices.size(), elapsed);
+  }
+}
+
+SimulatorShard *SimulatorHost::getShard(int index) {
+  return shards[index];
+}
+
+int SimulatorHost::getShardCount() {
+  return shards.size();
+}
+
+void SimulatorHost::parseProgramArgs(int argc, char* argv[]) {
+  host = "localhost";
+  port = 2000;
+  serverHost = "localhost";
+  serverPort = 2000;
+  stateOptions.type = "redis";
+  stateOptions.redisHost = "localhost";
+  stateOptions.redisPort = 6379;
+  poolSize = 4;
+  metricsPort = 0;
+  mtu = TRANSACTION_SIZE;
+  startRate = 0;
+  threads = std::thread::hardware_concurrency();
+  static struct option longOptions[] = {
+    {"bind", required_argument, 0, 'b'},
+    {"port", required_argument, 0, 'p'},
+    {"server", required_argument, 0, 's'},
+    {"redis", required_argument, 0, 'r'},
+    {"state", required_argument, 0, 'S'},
+    {"connections", required_argument, 0, 'c'},
+    {"threads", required_argument, 0, 'j'},
+    {"virtual-time", optional_argument, 0, 't'},
+    {"log-level", required_argument, 0, 'l'},
+    {"capture", required_argument, 0, 'C'},
+    {"metrics", required_argument, 0, 'm'},
+    {"manifest", required_argument, 0, 'f'},
+    {"start-rate", required_argument, 0, 'a'},
+    {"mtu", required_argument, 0, 'u'},
+    {"help", no_argument, 0, 'h'},
+    {0, 0, 0, 0}
+  };
+  static const char *shortOptions = "p:b:s:r:S:c:j:t::l:C:m:f:a:u:h";
+  int c;
+  int longIndex = 0;
+  while ((c = getopt_long(argc, argv, shortOptions, longOptions, &longIndex)) != -1) {
+    switch(c) {
+      case 'p':
+        port = std::stoi(optarg);
+        break;
+      case 'b':
+        host = optarg;
+        break;
+      case 's': {
+          serverHost = optarg;
+          int colonIndex = serverHost.find(':');
+          if (colonIndex != -1) {
+            serverPort = std::stoi(serverHost.substr(colonIndex + 1, -1));
+          }
+          serverHost = serverHost.substr(0, colonIndex);
+          break;
+        }
+      case 'r' : {
+        std::string redisHost = optarg;
+        int colonIndex = redisHost.find(':');
+        if (colonIndex != -1) {
+          stateOptions.redisPort = std::stoi(redisHost.substr(colonIndex + 1, -1));
+        }
+        stateOptions.redisHost = redisHost.substr(0, colonIndex);
+        break;
+      }
+      case 'S':
+        if (!StateBackend::parseType(optarg, &stateOptions)) {
+          printf("%s: Invalid state backend: %s\n", argv[0], optarg);
+          exit(1);
+        }
+        break;
+      case 'c':
+        poolSize = std::stoi(optarg);
+        break;
+      case 'j':
+        threads = std::stoi(optarg);
+        break;
+      case 't':
+        virtualTime = true;
+        if (optarg) {
+          virtualTimeSpeedUp = std::stod(optarg);
+        }
+        break;
+      case 'l': {
+        LogLevel level;
+        if (!Logger::parseLevel(optarg, &level)) {
+          printf("%s: Invalid log level: %s\n", argv[0], optarg);
+          exit(1);
+        }
+        Logger::getInstance()->setLevel(level);
+        break;
+      }
+      case 'C':
+        capturePrefix = optarg;
+        break;
+      case 'm':
+        metricsPort = atoi(optarg);
+        break;
+      case 'f':
+        manifestFile = optarg;
+        break;
+      case 'a':
+        startRate = atof(optarg);
+        break;
+      case 'u':
+        mtu = atoi(optarg);
+        break;
+      case 'h':
+        printf("Usage: %s [DEVICE_TYPE[:COUNT]...]\n", argv[0]);
+        printf("  -b, --bind=HOST           listen on ip address HOST (default: localhost)\n");
+        printf("  -p, --port=PORT_NUMBER    the UDP port of the first device, the following devices\n");
+        printf("                            use consecutive port numbers (default: 2000)\n");
+        printf("  -s, --server=SERVER       the server host and (optional) port (default: localhost:2000)\n");
+        printf("  -r, --redis=REDIS_SERVER  the host name/ip address of the Redis server (default: localhost:6379)\n");
+        printf("  -S, --state=BACKEND       where the device state is stored, redis or shm[:NAME] for a\n");
+        printf("                            shared memory table (default: redis, NAME: /caretaker-devices)\n");
+        printf("  -c, --connections=COUNT   the number of pooled Redis command connections per thread\n");
+        printf("                            (default: 4)\n");
+        printf("  -j, --threads=COUNT       the number of threads the devices are distributed over\n");
+        printf("                            (default: one per core)\n");
+        printf("  -t, --virtual-time[=SPEEDUP]  run in virtual time, as fast as possible or SPEEDUP times\n");
+        printf("                            faster than real time, always uses a single thread\n");
+        printf("  -l, --log-level=LEVEL     log only messages of LEVEL and above, one of debug, info,\n");
+        printf("                            warning, error (default: info)\n");
+        printf("  -C, --capture=PREFIX      record the traffic of every device to PREFIX.DEVICE_ID\n");
+        printf("  -m, --metrics=PORT        serve Prometheus metrics of all devices on http://HOST:PORT/metrics\n");
+        printf("  -f, --manifest=FILE       create the devices listed in the YAML manifest FILE\n");
+        printf("  -a, --start-rate=RATE     start at most RATE devices per second (default: all at once)\n");
+        printf("  -u, --mtu=BYTES           pack the commands a device sends during a loop() into datagrams\n");
+        printf("                            of up to BYTES, 0 sends every command separately (default: %d)\n",
+          TRANSACTION_SIZE);
+        printf("  -h, --help                print this help\n");
+        printf("Device types:");
+        for (DeviceTypes::iterator i = getDeviceTypes().begin(); i != getDeviceTypes().end(); ++i) {
+          printf(" %s", i->first.c_str());
+        }
+        printf("\n");
+        exit(0);
+      case 0:
+        break;
+      default:
+        printf("»%s --help« prints more help\n", argv[0]);
+        exit(1);
+    }
+  }
+  if (optind == argc && manifestFile.empty()) {
+    printf("%s: Missing device types\n", argv[0]);
+    printf("»%s --help« prints more help\n", argv[0]);
+    exit(1);
+  }
+  if (poolSize < 1) {
+    poolSize = 1;
+  }
+  if (threads < 1 || virtualTime) {
+    threads = 1;
+  }
+  nextPort = port;
+  if (!manifestFile.empty()) {
+    loadManifest(manifestFile);
+  }
+  for (int i = optind; i < argc; ++i) {
+    createDevices(argv[i]);
+  }
+  if ((size_t) threads > devices.size()) {
+    threads = devices.size();
+  }
+}
+
+void SimulatorHost::createDevices(std::string spec) {
+  FleetManifest::Entry entry;
+  entry.type = spec;
+  int colonIndex = spec.find(':');
+  if (colonIndex != -1) {
+    entry.type = spec.substr(0, colonIndex);
+    entry.count = std::stoi(spec.substr(colonIndex + 1, -1));
+  }
+  createDevices(entry);
+}
+
+void SimulatorHost::loadManifest(const std::string &fileName) {
+  FleetManifest manifest;
+  if (!manifest.load(fileName)) {
+    printf("Invalid manifest %s: %s\n", fileName.c_str(), manifest.getError().c_str());
+    exit(1);
+  }
+  for (size_t i = 0; i < manifest.getEntries().size(); ++i) {
+    createDevices(manifest.getEntries()[i]);
+  }
+}
+
+// Devices without an id are numbered per type, the ports of the devices
+// without a port are assigned consecutively
+void SimulatorHost::createDevices(const FleetManifest::Entry &entry) {
+  DeviceTypes::iterator factory = getDeviceTypes().find(entry.type);
+  if (factory == getDeviceTypes().end()) {
+    printf("Unknown device type: %s\n", entry.type.c_str());
+    exit(1);
+  }
+  for (int i = 1; i <= entry.count; ++i) {
+    Simulator *device = (*factory->second)();
+    device->simulatorHost = this;
+    if (entry.id.empty()) {
+      device->deviceId = entry.type + "-" + std::to_string(++typeCounts[entry.type]);
+    } else if (entry.count == 1) {
+      device->deviceId = entry.id;
+    } else {
+      device->deviceId = entry.id + "-" + std::to_string(i);
+    }
+    if (entry.name.empty()) {
+      device->deviceName = device->deviceId;
+    } else if (entry.count == 1) {
+      device->deviceName = entry.name;
+    } else {
+      device->deviceName = entry.name + " " + std::to_string(i);
+    }
+    device->host = entry.bind.empty() ? host : entry.bind;
+    device->port = entry.port > 0 ? entry.port + i - 1 : nextPort++;
+    device->serverHost = entry.serverHost.empty() ? serverHost : entry.serverHost;
+    device->serverPort = entry.serverPort > 0 ? entry.serverPort : serverPort;
+    device->mtu = mtu;
+    if (!capturePrefix.empty()) {
+      device->captureFile = capturePrefix + "." + device->deviceId;
+    }
+    devices.push_back(device);
+  }
+}
+
+// Devices are assigned to the shards by the hash of their id
+void SimulatorHost::createShards() {
+  for (int i = 0; i < threads; ++i) {
+    shards.push_back(new SimulatorShard(this, i));
+  }
+  std::hash<std::string> hash;
+  for (size_t i = 0; i < devices.size(); ++i) {
+    shards[hash(devices[i]->deviceId) % shards.size()]->addDevice(devices[i]);
+  }
+}
@@ -0,0 +1,67 @@
+#ifndef SIMULATOR_HOST_H
+#define SIMULATOR_HOST_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <atomic>
+#include <time.h>
+#include <Simulator.h>
+#include <FleetManifest.h>
+
+class SimulatorShard;
+
+class SimulatorHost {
+  friend class SimulatorShard;
+public:
+  typedef Simulator *(*DeviceFactory)();
+  SimulatorHost();
+  static void registerDeviceType(std::string type, DeviceFactory factory);
+  int run(int argc, char* argv[]);
+  void log(const char *format, ...);
+  void log(LogLevel level, const char *format, ...);
+  void stop();
+  SimulatorShard *getShard(int index);
+  int getShardCount();
+  void deviceRegistered();
+
+private:
+  typedef std::map<std::string, DeviceFactory> DeviceTypes;
+  static DeviceTypes &getDeviceTypes();
+  void parseProgramArgs(int argc, char* argv[]);
+  void createDevices(std::string spec);
+  void createDevices(const FleetManifest::Entry &entry);
+  void loadManifest(const std::string &fileName);
+  void createShards();
+  void startMetricsServer();
+  static SimulatorHost *instance;
+  std::vector<Simulator *> devices;
+  std::vector<SimulatorShard *> shards;
+  bool virtualTime;
+  double virtualTimeSpeedUp;
+  std::string host;
+  int port;
+  std::string serverHost;
+  int serverPort;
+  StateBackend::Options stateOptions;
+  int poolSize;
+  int threads;
+  std::string capturePrefix;
+  int metricsPort;
+  int mtu;
+  std::string manifestFile;
+  double startRate;
+  int nextPort;
+  std::map<std::string, int> typeCounts;
+  struct timespec startTime;
+  std::atomic<size_t> registeredDevices;
+};
+
+class SimulatorDeviceType {
+public:
+  SimulatorDeviceType(const char *type, SimulatorHost::DeviceFactory factory) {
+    SimulatorHost::registerDeviceType(type, factory);
+  }
+};
+
+#endif // SIMULATOR_HOST_H
@@ -0,0 +1,351 @@
+#include <stdlib.h>
+#include <signal.h>
+#include <string.h>
+#include <string>
+#include <algorithm>
+#include <event2/event.h>
+#include <SimulatorShard.h>
+#include <SimulatorHost.h>
+#include <Simulator.h>
+#include <VirtualClock.h>
+
+// A shard only steals devices from a shard that is busy for at least 10% of
+// the rebalance interval and has more than twice its own load
+static const unsigned long STEAL_THRESHOLD_MICROS = SimulatorShard::REBALANCE_INTERVAL_MS * 100;
+
+SimulatorShard::SimulatorShard(SimulatorHost *host, int index) :
+    deviceCount(0), ticks(0), load(0), stealRequest(-1) {
+  this->host = host;
+  this->index = index;
+  stateBackend = NULL;
+  startEvent = NULL;
+  devicesStarted = 0;
+  startCredit = 0;
+  started = false;
+  stopping = false;
+  mailboxClosed = false;
+  events = event_base_new();
+  clock = NULL;
+  if (host->virtualTime) {
+    clock = new VirtualClock(events, host->virtualTimeSpeedUp);
+  }
+  stopEvent = event_new(events, -1, 0, onStop, this);
+  mailboxEvent = event_new(events, -1, EV_PERSIST, onMailbox, this);
+  event_add(mailboxEvent, NULL);
+  rebalanceEvent = NULL;
+  signalEvent = NULL;
+  termSignalEvent = NULL;
+}
+
+void SimulatorShard::addDevice(Simulator *device) {
+  devices.push_back(device);
+  devicesById[device->deviceId] = device;
+  ++deviceCount;
+}
+
+void SimulatorShard::start() {
+  thread = std::thread(&SimulatorShard::run, this);
+}
+
+void SimulatorShard::run() {
+  if (index == 0) {
+    signalEvent = evsignal_new(events, SIGINT, onStopSignal, this);
+    event_add(signalEvent, NULL);
+    termSignalEvent = evsignal_new(events, SIGTERM, onStopSignal, this);
+    event_add(termSignalEvent, NULL);
+  }
+  if (host->getShardCount() > 1) {
+    rebalanceEvent = event_new(events, -1, EV_PERSIST, onRebalance, this);
+    struct timeval tv;
+    tv.tv_sec = REBALANCE_INTERVAL_MS / 1000;
+    tv.tv_usec = (REBALANCE_INTERVAL_MS % 1000) * 1000;
+    event_add(rebalanceEvent, &tv);
+  }
+  connectToStateBackend();
+  if (clock != NULL) {
+    host->log("Entering event loop (virtual time)");
+    clock->run();
+  } else {
+    host->log("Shard %d entering event loop with %zu devices", index, devices.size());
+    event_base_dispatch(events);
+  }
+  for (size_t i = 0; i < devices.size(); ++i) {
+    devices[i]->stopCapture();
+  }
+}
+
+void SimulatorShard::join() {
+  thread.join();
+}
+
+// May be called from any thread
+void SimulatorShard::stop() {
+  event_active(stopEvent, EV_TIMEOUT, 0);
+}
+
+struct event_base *SimulatorShard::getEvents() {
+  return events;
+}
+
+int SimulatorShard::getIndex() {
+  return index;
+}
+
+size_t SimulatorShard::getDeviceCount() {
+  return deviceCount.load(std::memory_order_relaxed);
+}
+
+unsigned long SimulatorShard::getTicks() {
+  return ticks.load(std::memory_order_relaxed);
+}
+
+unsigned long SimulatorShard::getLoad() {
+  return load.load(std::memory_order_relaxed);
+}
+
+// Called by an idle shard, only one request is pending at a time
+bool SimulatorShard::requestDevices(int thief) {
+  int none = -1;
+  return stealRequest.compare_exchange_strong(none, thief);
+}
+
+bool SimulatorShard::isBusier(Simulator *a, Simulator *b) {
+  return a->recentBusyMicros > b->recentBusyMicros;
+}
+
+void SimulatorShard::onStopSignal(int fd, short event, void *arg) {
+  SimulatorShard *self = (SimulatorShard *) arg;
+  self->host->stop();
+}
+
+void SimulatorShard::onStop(int fd, short event, void *arg) {
+  SimulatorShard *self = (SimulatorShard *) arg;
+  self->disconnectFromStateBackend();
+}
+
+void SimulatorShard::onMailbox(int fd, short event, void *arg) {
+  SimulatorShard *self = (SimulatorShard *) arg;
+  self->receiveDevices();
+}
+
+void SimulatorShard::onRebalance(int fd, short event, void *arg) {
+  SimulatorShard *self = (SimulatorShard *) arg;
+  self->rebalance();
+}
+
+void SimulatorShard::onStateBackendReady() {
+  startDevices();
+}
+
+void SimulatorShard::onStateBackendClosed() {
+  host->log("State backend of shard %d closed", index);
+  event_base_loopbreak(events);
+}
+
+// With Redis every shard receives the input of all devices and picks the
+// devices it currently runs
+bool SimulatorShard::onDeviceInput(const std::string &deviceId, const char *message, size_t length) {
+  std::map<std::string, Simulator *>::iterator device = devicesById.find(deviceId);
+  if (device == devicesById.end()) {
+    return false;
+  }
+  device->second->receiveDeviceInput(message, length);
+  return true;
+}
+
+void SimulatorShard::connectToStateBackend() {
+  StateBackend::Options options = host->stateOptions;
+  options.poolSize = host->poolSize;
+  stateBackend = StateBackend::create(options, events);
+  host->log("Shard %d connecting to the %s state backend...", index, stateBackend->getName());
+  stateBackend->connect(this, "*");
+}
+
+void SimulatorShard::disconnectFromStateBackend() {
+  if (stopping) {
+    return;
+  }
+  host->log("Shard %d disconnecting from the state backend...", index);
+  stopping = true;
+  if (startEvent != NULL) {
+    event_free(startEvent);
+    startEvent = NULL;
+  }
+  // Devices still in the mailbox are closed with the own devices, later
+  // hand overs are refused
+  std::vector<Simulator *> received;
+  {
+    std::lock_guard<std::mutex> lock(mailboxMutex);
+    received.swap(mailbox);
+    mailboxClosed = true;
+  }
+  for (size_t i = 0; i < received.size(); ++i) {
+    devices.push_back(received[i]);
+    devicesById[received[i]->deviceId] = received[i];
+  }
+  deviceCount.fetch_add(received.size(), std::memory_order_relaxed);
+  std::vector<std::string> deviceIds;
+  for (size_t i = 0; i < devices.size(); ++i) {
+    deviceIds.push_back(devices[i]->deviceId);
+  }
+  stateBackend->close(deviceIds);
+}
+
+// Without a start rate all devices are started at once, otherwise the shard
+// starts its share of the rate every START_INTERVAL_MS
+void SimulatorShard::startDevices() {
+  if (host->startRate <= 0) {
+    startDevices(devices.size());
+    return;
+  }
+  startEvent = event_new(events, -1, EV_PERSIST, onStartDevices, this);
+  struct timeval tv;
+  tv.tv_sec = 0;
+  tv.tv_usec = START_INTERVAL_MS * 1000;
+  event_add(startEvent, &tv);
+  startDevices(1);
+}
+
+void SimulatorShard::onStartDevices(int fd, short event, void *arg) {
+  SimulatorShard *self = (SimulatorShard *) arg;
+  self->startCredit += self->host->startRate * START_INTERVAL_MS / 1000 / self->host->getShardCount();
+  size_t count = (size_t) self->startCredit;
+  self->startCredit -= count;
+  self->startDevices(count);
+}
+
+void SimulatorShard::startDevices(size_t count) {
+  for (; count > 0 && devicesStarted < devices.size(); --count) {
+    Simulator *device = devices[devicesStarted++];
+    device->events = events;
+    device->clock = clock;
+    device->stateBackend = stateBackend;
+    device->initNetwork();
+    device->registerDevice();
+    device->activate();
+    (*device->setupFunction)();
+    device->flushMessagesToServer();
+    device->initDeviceState();
+    device->flushDeviceState();
+    device->nextTick();
+  }
+  if (devicesStarted < devices.size()) {
+    return;
+  }
+  if (startEvent != NULL) {
+    event_free(startEvent);
+    startEvent = NULL;
+  }
+  started = true;
+  host->log("Shard %d started %zu devices", index, devices.size());
+  receiveDevices();
+}
+
+// Takes over the devices that were handed over by other shards. The devices
+// continue with their state, only their events are moved to this shard.
+void SimulatorShard::receiveDevices() {
+  if (!started || stopping) {
+    return;
+  }
+  std::vector<Simulator *> received;
+  {
+    std::lock_guard<std::mutex> lock(mailboxMutex);
+    received.swap(mailbox);
+  }
+  for (size_t i = 0; i < received.size(); ++i) {
+    Simulator *device = received[i];
+    device->events = events;
+    device->stateBackend = stateBackend;
+    stateBackend->registerDevice(device->deviceId);
+    device->attachEvents();
+    devices.push_back(device);
+    devicesById[device->deviceId] = device;
+    device->nextTick();
+  }
+  deviceCount.fetch_add(received.size(), std::memory_order_relaxed);
+}
+
+// Publishes the load of the last interval. A pending steal request of an idle
+// shard is served, otherwise this shard asks the busiest shard for devices
+// if it is much less busy itself.
+void SimulatorShard::rebalance() {
+  if (!started || stopping) {
+    return;
+  }
+  unsigned long busyMicros = 0;
+  unsigned long tickCount = 0;
+  for (size_t i = 0; i < devices.size(); ++i) {
+    Simulator *device = devices[i];
+    device->recentBusyMicros = device->busyMicros;
+    device->busyMicros = 0;
+    busyMicros += device->recentBusyMicros;
+    tickCount += device->tickCount;
+    device->tickCount = 0;
+  }
+  load.store(busyMicros, std::memory_order_relaxed);
+  ticks.fetch_add(tickCount, std::memory_order_relaxed);
+  host->log(LOG_DEBUG, "Shard %d: %zu devices, %lu ticks, busy %lu us", index, devices.size(),
+    tickCount, busyMicros);
+
+  int thief = stealRequest.exchange(-1);
+  if (thief != -1) {
+    handOverDevices(host->getShard(thief));
+    return;
+  }
+  SimulatorShard *busiest = NULL;
+  for (int i = 0; i < host->getShardCount(); ++i) {
+    SimulatorShard *shard = host->getShard(i);
+    if (shard != this && (busiest == NULL || shard->getLoad() > busiest->getLoad())) {
+      busiest = shard;
+    }
+  }
+  if (busiest != NULL && busiest->getLoad() > STEAL_THRESHOLD_MICROS &&
+      busyMicros * 2 < busiest->getLoad()) {
+    busiest->requestDevices(index);
+  }
+}
+
+// Moves the busiest devices that together carry about half of the load
+// difference to the mailbox of the thief. Devices with state writes in flight
+// stay, their completions run on the state backend of this shard.
+void SimulatorShard::handOverDevices(SimulatorShard *thief) {
+  unsigned long ownLoad = getLoad();
+  unsigned long thiefLoad = thief->getLoad();
+  if (ownLoad <= thiefLoad || devices.size() < 2) {
+    return;
+  }
+  unsigned long target = (ownLoad - thiefLoad) / 2;
+  std::vector<Simulator *> candidates(devices);
+  std::sort(candidates.begin(), candidates.end(), isBusier);
+  std::vector<Simulator *> moved;
+  unsigned long movedLoad = 0;
+  for (size_t i = 0; i < candidates.size() && moved.size() + 1 < devices.size(); ++i) {
+    Simulator *device = candidates[i];
+    if (device->stateWritesPending > 0 || movedLoad + device->recentBusyMicros > target) {
+      continue;
+    }
+    movedLoad += device->recentBusyMicros;
+    moved.push_back(device);
+  }
+  if (moved.empty()) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(thief->mailboxMutex);
+  if (thief->mailboxClosed) {
+    return;
+  }
+  for (size_t i = 0; i < moved.size(); ++i) {
+    Simulator *device = moved[i];
+    device->detachEvents();
+    device->releaseFirmware();
+    stateBackend->releaseDevice(device->deviceId);
+    devices.erase(std::find(devices.begin(), devices.end(), device));
+    devicesById.erase(device->deviceId);
+  }
+  deviceCount.fetch_sub(moved.size(), std::memory_order_relaxed);
+  load.fetch_sub(movedLoad, std::memory_order_relaxed);
+  host->log(LOG_DEBUG, "Shard %d hands over %zu devices (busy %lu us) to shard %d", index,
+    moved.size(), movedLoad, thief->index);
+  thief->mailbox.insert(thief->mailbox.end(), moved.begin(), moved.end());
+  event_active(thief->mailboxEvent, EV_TIMEOUT, 0);
+}
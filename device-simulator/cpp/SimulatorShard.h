@@ -0,0 +1,82 @@
+#ifndef SIMULATOR_SHARD_H
+#define SIMULATOR_SHARD_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <StateBackend.h>
+
+class Simulator;
+class SimulatorHost;
+class VirtualClock;
+
+// A shard runs a part of the devices of a simulator host on its own thread.
+// It owns an event base and a state backend, e.g. a pool of Redis command
+// connections and a pub/sub connection for the device input. All devices of a shard are only touched
+// by the thread of the shard. Devices are handed over to another shard
+// through its mailbox.
+class SimulatorShard : public StateBackend::Listener {
+public:
+  SimulatorShard(SimulatorHost *host, int index);
+  void addDevice(Simulator *device);
+  void start();
+  void run();
+  void join();
+  void stop();
+  int getIndex();
+  struct event_base *getEvents();
+  size_t getDeviceCount();
+  unsigned long getTicks();
+  unsigned long getLoad();
+  bool requestDevices(int thief);
+  static const int REBALANCE_INTERVAL_MS = 1000;
+  static const int START_INTERVAL_MS = 100;
+  void onStateBackendReady();
+  void onStateBackendClosed();
+  bool onDeviceInput(const std::string &deviceId, const char *message, size_t length);
+
+private:
+  static bool isBusier(Simulator *a, Simulator *b);
+  static void onStopSignal(int fd, short event, void *arg);
+  static void onStop(int fd, short event, void *arg);
+  static void onMailbox(int fd, short event, void *arg);
+  static void onRebalance(int fd, short event, void *arg);
+  static void onStartDevices(int fd, short event, void *arg);
+  void connectToStateBackend();
+  void disconnectFromStateBackend();
+  void startDevices();
+  void startDevices(size_t count);
+  void receiveDevices();
+  void rebalance();
+  void handOverDevices(SimulatorShard *thief);
+  SimulatorHost *host;
+  int index;
+  std::vector<Simulator *> devices;
+  std::map<std::string, Simulator *> devicesById;
+  StateBackend *stateBackend;
+  bool started;
+  bool stopping;
+  struct event_base *events;
+  struct event *stopEvent;
+  struct event *mailboxEvent;
+  struct event *rebalanceEvent;
+  struct event *startEvent;
+  size_t devicesStarted;
+  double startCredit;
+  struct event *signalEvent;
+  struct event *termSignalEvent;
+  VirtualClock *clock;
+  std::thread thread;
+  std::mutex mailboxMutex;
+  std::vector<Simulator *> mailbox;
+  bool mailboxClosed;
+  std::atomic<size_t> deviceCount;
+  std::atomic<unsigned long> ticks;
+  std::atomic<unsigned long> load;
+  std::atomic<int> stealRequest;
+};
+
+#endif // SIMULATOR_SHARD_H
@@ -0,0 +1,36 @@
+#include <stdarg.h>
+#include <string.h>
+#include <StateBackend.h>
+#include <RedisStateBackend.h>
+#include <SharedMemoryStateBackend.h>
+
+const char *StateBackend::DEVICE_KEY_PREFIX = "caretaker.devices.";
+const char *StateBackend::DEVICE_INPUT_SUFFIX = ".input";
+
+// The spec is "redis" or "shm[:NAME]"
+bool StateBackend::parseType(const char *spec, Options *options) {
+  if (strcmp(spec, "redis") == 0) {
+    options->type = "redis";
+    return true;
+  }
+  if (strncmp(spec, "shm", 3) == 0 && (spec[3] == '\0' || spec[3] == ':')) {
+    options->type = "shm";
+    options->name = spec[3] == ':' ? spec + 4 : SharedMemoryStateBackend::DEFAULT_NAME;
+    return !options->name.empty();
+  }
+  return false;
+}
+
+StateBackend *StateBackend::create(const Options &options, struct event_base *events) {
+  if (options.type == "shm") {
+    return new SharedMemoryStateBackend(events, options.name);
+  }
+  return new RedisStateBackend(events, options.redisHost, options.redisPort, options.poolSize);
+}
+
+void StateBackend::log(LogLevel level, const char *format, ...) {
+  va_list args;
+  va_start (args, format);
+  Logger::getInstance()->log(level, NULL, format, args);
+  va_end (args);
+}
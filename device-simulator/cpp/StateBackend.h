@@ -0,0 +1,61 @@
+#ifndef STATE_BACKEND_H
+#define STATE_BACKEND_H
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <Logger.h>
+
+struct event_base;
+class Simulator;
+
+// Stores the state of the simulated devices and delivers the device input
+// from the UI. A backend is used by the event loop thread that created it,
+// it reports to its listener from that event loop.
+class StateBackend {
+public:
+  typedef std::vector<std::pair<std::string, std::string> > Fields;
+
+  class Listener {
+  public:
+    virtual ~Listener() {}
+    virtual void onStateBackendReady() = 0;
+    virtual void onStateBackendClosed() = 0;
+    // Returns false if the device doesn't run on this listener
+    virtual bool onDeviceInput(const std::string &deviceId, const char *message, size_t length) = 0;
+  };
+
+  struct Options {
+    std::string type;
+    std::string name;
+    std::string redisHost;
+    int redisPort;
+    int poolSize;
+  };
+
+  static const char *DEVICE_KEY_PREFIX;
+  static const char *DEVICE_INPUT_SUFFIX;
+  static bool parseType(const char *spec, Options *options);
+  static StateBackend *create(const Options &options, struct event_base *events);
+  virtual ~StateBackend() {}
+  // Connects and watches the input of the devices that match the device id
+  // pattern, "*" watches all devices
+  virtual void connect(Listener *listener, const std::string &devicePattern) = 0;
+  // Adds the device to the list of registered devices
+  virtual void registerDevice(const std::string &deviceId) = 0;
+  // Stops watching the input of a device that moves to the backend of another
+  // event loop, its state and registration are kept
+  virtual void releaseDevice(const std::string &deviceId) = 0;
+  // Merges the first count fields into the state of the device, the device is
+  // notified with Simulator::deviceStateWritten() when the write is done
+  virtual void writeState(Simulator *device, const std::string &deviceId, const Fields &fields,
+    size_t count) = 0;
+  // Deletes the state and the registration of the devices and disconnects
+  virtual void close(const std::vector<std::string> &deviceIds) = 0;
+  virtual const char *getName() = 0;
+
+protected:
+  static void log(LogLevel level, const char *format, ...);
+};
+
+#endif // STATE_BACKEND_H
@@ -1,31 +1,29 @@
 #include <Stream.h>
 #include <stdio.h>
 #include <string.h>
-#include <sys/socket.h>
 #include <Simulator.h>
 
-#define min(a,b) (((a)<(b))?(a):(b))
-
 int Stream::available() {
-  return Simulator::getInstance()->getMessageFromServer().length();
+  return Simulator::getInstance()->getMessageFromServer().available();
 }
 
-size_t Stream::read() {
-  if (available() == 0) {
-    return 0;
-  }
-  std::string &msg = Simulator::getInstance()->getMessageFromServer();
-  int c = msg[0];
-  msg.erase(0, 1);
-  return 1;
+int Stream::read() {
+  return Simulator::getInstance()->getMessageFromServer().read();
 }
 
 size_t Stream::readBytes(char *buffer, size_t length) {
-  std::string &msg = Simulator::getInstance()->getMessageFromServer();
-  int len = min(length, msg.length());
-  strncpy(buffer, msg.c_str(), len);
-  msg.erase(0, len);
-  return len;
+  return Simulator::getInstance()->getMessageFromServer().read(buffer, length);
+}
+
+// Not part of the Arduino Stream, lets the simulator CmdMessenger parse the
+// received bytes in place. peekBytes() may return less than available(), it
+// stops at the end of a datagram. consume() returns true at the end of one.
+size_t Stream::peekBytes(const char **bytes) {
+  return Simulator::getInstance()->getMessageFromServer().peek(bytes);
+}
+
+bool Stream::consume(size_t length) {
+  return Simulator::getInstance()->getMessageFromServer().consume(length);
 }
 
 size_t Stream::print(char c) {
@@ -44,6 +42,16 @@ size_t Stream::print(const char *s) {
   return strlen(s);
 }
 
+size_t Stream::write(uint8_t b) {
+  buffer += (char) b;
+  return 1;
+}
+
+size_t Stream::write(const uint8_t *bytes, size_t length) {
+  buffer.append((const char *) bytes, length);
+  return length;
+}
+
 size_t Stream::println() {
   Simulator::getInstance()->sendMessageToServer(buffer);
   buffer.clear();
@@ -2,17 +2,22 @@
 #define STREAM_H
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <string>
 
 class Stream {
 public:
   int available();
-  size_t read();
+  int read();
   size_t readBytes(char *buffer, size_t length);
+  size_t peekBytes(const char **bytes);
+  bool consume(size_t length);
   size_t print(char c);
   size_t print(int i);
   size_t print(const char *);
   size_t println();
+  size_t write(uint8_t b);
+  size_t write(const uint8_t *bytes, size_t length);
 private:
   std::string buffer;
 };
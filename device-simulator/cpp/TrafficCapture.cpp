@@ -0,0 +1,97 @@
+#include <TrafficCapture.h>
+#include <string.h>
+
+static const char MAGIC[] = {'C', 'T', 'C', 'A', 'P', 1};
+static const size_t FILE_BUFFER_SIZE = 64 * 1024;
+
+TrafficCapture::TrafficCapture() {
+  file = NULL;
+  lastMillis = 0;
+}
+
+TrafficCapture::~TrafficCapture() {
+  close();
+}
+
+bool TrafficCapture::openForWriting(const std::string &path) {
+  file = fopen(path.c_str(), "wb");
+  if (file == NULL) {
+    return false;
+  }
+  setvbuf(file, NULL, _IOFBF, FILE_BUFFER_SIZE);
+  lastMillis = 0;
+  return fwrite(MAGIC, sizeof(MAGIC), 1, file) == 1;
+}
+
+bool TrafficCapture::openForReading(const std::string &path) {
+  file = fopen(path.c_str(), "rb");
+  if (file == NULL) {
+    return false;
+  }
+  setvbuf(file, NULL, _IOFBF, FILE_BUFFER_SIZE);
+  lastMillis = 0;
+  char magic[sizeof(MAGIC)];
+  return fread(magic, sizeof(magic), 1, file) == 1 && memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+void TrafficCapture::write(RecordType type, unsigned long millis, const char *data, size_t length) {
+  if (file == NULL) {
+    return;
+  }
+  fputc(type, file);
+  writeVarint(millis >= lastMillis ? millis - lastMillis : 0);
+  writeVarint(length);
+  fwrite(data, 1, length, file);
+  lastMillis = millis;
+}
+
+// Returns false at the end of the file or if the last record is incomplete
+bool TrafficCapture::read(Record &record) {
+  if (file == NULL) {
+    return false;
+  }
+  int type = fgetc(file);
+  unsigned long delta;
+  unsigned long length;
+  if (type == EOF || !readVarint(&delta) || !readVarint(&length)) {
+    return false;
+  }
+  record.type = (RecordType) type;
+  record.millis = lastMillis + delta;
+  record.data.resize(length);
+  if (length > 0 && fread(&record.data[0], 1, length, file) != length) {
+    return false;
+  }
+  lastMillis = record.millis;
+  return true;
+}
+
+void TrafficCapture::close() {
+  if (file != NULL) {
+    fclose(file);
+    file = NULL;
+  }
+}
+
+void TrafficCapture::writeVarint(unsigned long value) {
+  while (value >= 0x80) {
+    fputc((int) (value & 0x7f) | 0x80, file);
+    value >>= 7;
+  }
+  fputc((int) value, file);
+}
+
+bool TrafficCapture::readVarint(unsigned long *value) {
+  *value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    int c = fgetc(file);
+    if (c == EOF) {
+      return false;
+    }
+    *value |= (unsigned long) (c & 0x7f) << shift;
+    if ((c & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
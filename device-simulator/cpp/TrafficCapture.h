@@ -0,0 +1,39 @@
+#ifndef TRAFFIC_CAPTURE_H
+#define TRAFFIC_CAPTURE_H
+
+#include <stdio.h>
+#include <string>
+
+// Binary capture of the traffic of a simulated device. The file starts with
+// a magic number, every record consists of the record type, the difference
+// to the virtual timestamp (currentMillis) of the previous record and the
+// length of the data as varints, followed by the data.
+class TrafficCapture {
+public:
+  enum RecordType {
+    UDP_RECEIVED = 1,
+    UDP_SENT = 2,
+    DEVICE_INPUT = 3,
+    DEVICE_STATE = 4
+  };
+  struct Record {
+    RecordType type;
+    unsigned long millis;
+    std::string data;
+  };
+  TrafficCapture();
+  ~TrafficCapture();
+  bool openForWriting(const std::string &path);
+  bool openForReading(const std::string &path);
+  void write(RecordType type, unsigned long millis, const char *data, size_t length);
+  bool read(Record &record);
+  void close();
+
+private:
+  void writeVarint(unsigned long value);
+  bool readVarint(unsigned long *value);
+  FILE *file;
+  unsigned long lastMillis;
+};
+
+#endif // TRAFFIC_CAPTURE_H
@@ -0,0 +1,151 @@
+#include <UdpChannel.h>
+#include <ReceiveBuffer.h>
+#include <Simulator.h>
+#include <TrafficCapture.h>
+#include <errno.h>
+#include <string.h>
+#include <event2/util.h>
+
+UdpChannel::UdpChannel(Simulator *simulator) {
+  this->simulator = simulator;
+  capture = NULL;
+  msgSocket = -1;
+  sendQueueSize = 0;
+  memset(&serverAddress, 0, sizeof(serverAddress));
+  for (int i = 0; i < BATCH_SIZE; ++i) {
+    receiveSegments[i].iov_base = receiveBuffers[i];
+    receiveSegments[i].iov_len = MAX_DATAGRAM_SIZE;
+  }
+  resetStatistics();
+}
+
+bool UdpChannel::open(struct sockaddr_in &deviceAddress, struct sockaddr_in &serverAddress) {
+  this->serverAddress = serverAddress;
+  msgSocket = socket(PF_INET, SOCK_DGRAM, 0);
+  if (msgSocket < 0) {
+    return false;
+  }
+  if (bind(msgSocket, (struct sockaddr *) &deviceAddress, sizeof(struct sockaddr)) < 0) {
+    return false;
+  }
+  evutil_make_socket_nonblocking(msgSocket);
+  return true;
+}
+
+int UdpChannel::getSocket() {
+  return msgSocket;
+}
+
+// Receive until the socket would block. Datagrams that are truncated or that
+// don't fit into the buffer are dropped. Returns the number of datagrams that
+// were stored.
+size_t UdpChannel::receive(ReceiveBuffer &buffer) {
+  size_t stored = 0;
+  for (;;) {
+    memset(receiveHeaders, 0, sizeof(receiveHeaders));
+    for (int i = 0; i < BATCH_SIZE; ++i) {
+      receiveHeaders[i].msg_hdr.msg_iov = &receiveSegments[i];
+      receiveHeaders[i].msg_hdr.msg_iovlen = 1;
+    }
+    int count = recvmmsg(msgSocket, receiveHeaders, BATCH_SIZE, MSG_DONTWAIT, NULL);
+    ++statistics.receiveCalls;
+    if (count < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        simulator->log(LOG_ERROR, "recvmmsg() failed: %s", strerror(errno));
+      }
+      break;
+    }
+    for (int i = 0; i < count; ++i) {
+      size_t length = receiveHeaders[i].msg_len;
+      if (length == 0) {
+        continue;
+      }
+      ++statistics.received;
+      if (receiveHeaders[i].msg_hdr.msg_flags & MSG_TRUNC) {
+        buffer.countOverflow();
+        ++statistics.dropped;
+        continue;
+      }
+      if (!buffer.write(receiveBuffers[i], length)) {
+        ++statistics.dropped;
+        continue;
+      }
+      statistics.receivedBytes += length;
+      if (capture != NULL) {
+        capture->write(TrafficCapture::UDP_RECEIVED, simulator->getCurrentMillis(),
+          receiveBuffers[i], length);
+      }
+      ++stored;
+    }
+    if (count < BATCH_SIZE) {
+      break;
+    }
+  }
+  return stored;
+}
+
+// The queued strings are reused between ticks
+void UdpChannel::send(const std::string &msg) {
+  if (capture != NULL) {
+    capture->write(TrafficCapture::UDP_SENT, simulator->getCurrentMillis(), msg.c_str(), msg.length());
+  }
+  if (sendQueueSize == sendQueue.size()) {
+    sendQueue.push_back(std::string());
+  }
+  sendQueue[sendQueueSize] = msg;
+  ++sendQueueSize;
+}
+
+// Without a socket, e.g. during a replay, the messages are discarded
+void UdpChannel::flush() {
+  if (sendQueueSize == 0) {
+    return;
+  }
+  if (msgSocket < 0) {
+    statistics.sent += sendQueueSize;
+    sendQueueSize = 0;
+    return;
+  }
+  sendSegments.resize(sendQueueSize);
+  sendHeaders.resize(sendQueueSize);
+  memset(&sendHeaders[0], 0, sendQueueSize * sizeof(struct mmsghdr));
+  for (size_t i = 0; i < sendQueueSize; ++i) {
+    sendSegments[i].iov_base = (void *) sendQueue[i].c_str();
+    sendSegments[i].iov_len = sendQueue[i].length();
+    sendHeaders[i].msg_hdr.msg_name = &serverAddress;
+    sendHeaders[i].msg_hdr.msg_namelen = sizeof(serverAddress);
+    sendHeaders[i].msg_hdr.msg_iov = &sendSegments[i];
+    sendHeaders[i].msg_hdr.msg_iovlen = 1;
+  }
+  size_t first = 0;
+  while (first < sendQueueSize) {
+    int count = sendmmsg(msgSocket, &sendHeaders[first], sendQueueSize - first, 0);
+    ++statistics.sendCalls;
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      simulator->log(LOG_ERROR, "sendmmsg() failed: %s", strerror(errno));
+      statistics.dropped += sendQueueSize - first;
+      break;
+    }
+    statistics.sent += count;
+    for (int i = 0; i < count; ++i) {
+      statistics.sentBytes += sendSegments[first + i].iov_len;
+    }
+    first += count;
+  }
+  sendQueueSize = 0;
+}
+
+void UdpChannel::setCapture(TrafficCapture *capture) {
+  this->capture = capture;
+}
+
+UdpChannel::Statistics &UdpChannel::getStatistics() {
+  return statistics;
+}
+
+void UdpChannel::resetStatistics() {
+  memset(&statistics, 0, sizeof(statistics));
+}
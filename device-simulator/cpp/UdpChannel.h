@@ -0,0 +1,54 @@
+#ifndef UDP_CHANNEL_H
+#define UDP_CHANNEL_H
+
+#include <string>
+#include <vector>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+class ReceiveBuffer;
+class Simulator;
+class TrafficCapture;
+
+// Non-blocking UDP socket of a simulated device. All readable datagrams are
+// received with recvmmsg() in one wakeup, outgoing datagrams are queued and
+// sent with a single sendmmsg() when the tick is finished.
+class UdpChannel {
+public:
+  static const int BATCH_SIZE = 16;
+  static const size_t MAX_DATAGRAM_SIZE = 512;
+  struct Statistics {
+    unsigned long receiveCalls;
+    unsigned long received;
+    unsigned long receivedBytes;
+    unsigned long sendCalls;
+    unsigned long sent;
+    unsigned long sentBytes;
+    unsigned long dropped;
+  };
+  UdpChannel(Simulator *simulator);
+  bool open(struct sockaddr_in &deviceAddress, struct sockaddr_in &serverAddress);
+  int getSocket();
+  size_t receive(ReceiveBuffer &buffer);
+  void send(const std::string &msg);
+  void flush();
+  void setCapture(TrafficCapture *capture);
+  Statistics &getStatistics();
+  void resetStatistics();
+
+private:
+  Simulator *simulator;
+  TrafficCapture *capture;
+  int msgSocket;
+  struct sockaddr_in serverAddress;
+  char receiveBuffers[BATCH_SIZE][MAX_DATAGRAM_SIZE];
+  struct iovec receiveSegments[BATCH_SIZE];
+  struct mmsghdr receiveHeaders[BATCH_SIZE];
+  std::vector<std::string> sendQueue;
+  size_t sendQueueSize;
+  std::vector<struct iovec> sendSegments;
+  std::vector<struct mmsghdr> sendHeaders;
+  Statistics statistics;
+};
+
+#endif // UDP_CHANNEL_H
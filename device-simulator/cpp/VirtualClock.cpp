@@ -0,0 +1,64 @@
+#include <VirtualClock.h>
+#include <Simulator.h>
+
+VirtualClock::VirtualClock(struct event_base *events, double speedUp) {
+  this->events = events;
+  this->speedUp = speedUp;
+  currentMillis = 0;
+  sequence = 0;
+}
+
+unsigned long VirtualClock::getCurrentMillis() {
+  return currentMillis;
+}
+
+void VirtualClock::schedule(Simulator *simulator, unsigned long millis) {
+  Entry entry;
+  entry.millis = millis;
+  entry.sequence = sequence++;
+  entry.simulator = simulator;
+  queue.push(entry);
+}
+
+void VirtualClock::run() {
+  evutil_gettimeofday(&startTime, NULL);
+  while (!event_base_got_break(events)) {
+    if (queue.empty()) {
+      event_base_loop(events, EVLOOP_ONCE);
+      continue;
+    }
+    if (queue.top().millis > currentMillis) {
+      waitUntil(queue.top().millis);
+      if (event_base_got_break(events)) {
+        break;
+      }
+      currentMillis = queue.top().millis;
+    }
+    while (!queue.empty() && queue.top().millis <= currentMillis) {
+      Entry entry = queue.top();
+      queue.pop();
+      // Skip ticks that were rescheduled by Simulator::wakeUp()
+      if (entry.millis == entry.simulator->nextTickMillis) {
+        entry.simulator->tick();
+      }
+    }
+  }
+}
+
+void VirtualClock::waitUntil(unsigned long millis) {
+  if (speedUp > 0) {
+    struct timeval now, elapsed;
+    evutil_gettimeofday(&now, NULL);
+    evutil_timersub(&now, &startTime, &elapsed);
+    long waitMillis = (long) (millis / speedUp) - (elapsed.tv_sec * 1000 + elapsed.tv_usec / 1000);
+    if (waitMillis > 0) {
+      struct timeval tv;
+      tv.tv_sec = waitMillis / 1000;
+      tv.tv_usec = (waitMillis % 1000) * 1000;
+      event_base_loopexit(events, &tv);
+      event_base_dispatch(events);
+      return;
+    }
+  }
+  event_base_loop(events, EVLOOP_NONBLOCK);
+}
@@ -0,0 +1,39 @@
+#ifndef VIRTUAL_CLOCK_H
+#define VIRTUAL_CLOCK_H
+
+#include <event2/event.h>
+#include <queue>
+#include <vector>
+
+class Simulator;
+
+// Drives the simulator ticks in virtual time. Instead of waiting for a real
+// timer, the clock jumps to the next scheduled tick. Pending UDP and Redis
+// events are dispatched whenever the virtual time advances, so they are seen
+// by the firmware at the current virtual timestamp.
+class VirtualClock {
+public:
+  VirtualClock(struct event_base *events, double speedUp);
+  unsigned long getCurrentMillis();
+  void schedule(Simulator *simulator, unsigned long millis);
+  void run();
+
+private:
+  struct Entry {
+    unsigned long millis;
+    unsigned long sequence;
+    Simulator *simulator;
+    bool operator>(const Entry &other) const {
+      return millis != other.millis ? millis > other.millis : sequence > other.sequence;
+    }
+  };
+  void waitUntil(unsigned long millis);
+  struct event_base *events;
+  double speedUp;
+  unsigned long currentMillis;
+  unsigned long sequence;
+  struct timeval startTime;
+  std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry> > queue;
+};
+
+#endif // VIRTUAL_CLOCK_H
@@ -0,0 +1,22 @@
+#define SIMULATOR_HOST
+
+#include <Simulator.h>
+#include <SimulatorHost.h>
+#include <Arduino.h>
+#include <Bounce.h>
+#include <PinChangeInt.h>
+#include <CaretakerDevice.h>
+#include <stdlib.h>
+
+namespace remotecontrol_device {
+
+#include "../../remotecontrol-wifly-device/src/remotecontrol.cpp"
+#include "../../remotecontrol-wifly-device/sim/remotecontrol-sim.cpp"
+
+Simulator *createSimulator() {
+  return new RemoteControlSimulator();
+}
+
+}
+
+static SimulatorDeviceType deviceType("remotecontrol", remotecontrol_device::createSimulator);
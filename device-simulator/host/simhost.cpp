@@ -0,0 +1,6 @@
+#include <SimulatorHost.h>
+
+int main(int argc, char* argv[]) {
+  SimulatorHost host;
+  return host.run(argc, argv);
+}
@@ -0,0 +1,22 @@
+#define SIMULATOR_HOST
+
+#include <Simulator.h>
+#include <SimulatorHost.h>
+#include <Arduino.h>
+#include <Bounce.h>
+#include <PinChangeInt.h>
+#include <CaretakerDevice.h>
+#include <stdlib.h>
+
+namespace switch_device {
+
+#include "../../switch-wifly-device/src/switch.cpp"
+#include "../../switch-wifly-device/sim/switch-sim.cpp"
+
+Simulator *createSimulator() {
+  return new SwitchSimulator();
+}
+
+}
+
+static SimulatorDeviceType deviceType("switch", switch_device::createSimulator);
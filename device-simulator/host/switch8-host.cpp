@@ -0,0 +1,22 @@
+#define SIMULATOR_HOST
+
+#include <Simulator.h>
+#include <SimulatorHost.h>
+#include <Arduino.h>
+#include <Bounce.h>
+#include <PinChangeInt.h>
+#include <CaretakerDevice.h>
+#include <stdlib.h>
+
+namespace switch8_device {
+
+#include "../../switch8-wifly-device/src/switch8.cpp"
+#include "../../switch8-wifly-device/sim/switch8-sim.cpp"
+
+Simulator *createSimulator() {
+  return new Switch8Simulator();
+}
+
+}
+
+static SimulatorDeviceType deviceType("switch8", switch8_device::createSimulator);
@@ -0,0 +1,89 @@
+#include <stdlib.h>
+#include <CommandFields.h>
+
+CommandFields::CommandFields() {
+  fields = NULL;
+  nextIndex = 0;
+}
+
+// The first field is the command id, the arguments are read from the second
+CommandFields::CommandFields(const std::vector<std::string> &fields) {
+  this->fields = &fields;
+  nextIndex = 1;
+}
+
+void CommandFields::sendCmdStart(int cmdId) {
+  values.clear();
+  values.push_back(cmdId);
+}
+
+void CommandFields::sendCmdEnd() {
+}
+
+const std::vector<long> &CommandFields::getValues() {
+  return values;
+}
+
+const std::string *CommandFields::nextField() {
+  if (fields == NULL || nextIndex >= fields->size()) {
+    return NULL;
+  }
+  return &(*fields)[nextIndex++];
+}
+
+bool CommandFields::readField(long &value) {
+  const std::string *field = nextField();
+  if (field == NULL || field->empty()) {
+    return false;
+  }
+  char *end;
+  value = strtol(field->c_str(), &end, 10);
+  return *end == '\0';
+}
+
+bool CommandFields::readField(int &value) {
+  long l;
+  if (!readField(l)) {
+    return false;
+  }
+  value = (int) l;
+  return true;
+}
+
+bool CommandFields::readField(uint8_t &value) {
+  long l;
+  if (!readField(l) || l < 0 || l > 255) {
+    return false;
+  }
+  value = (uint8_t) l;
+  return true;
+}
+
+bool CommandFields::readField(bool &value) {
+  long l;
+  if (!readField(l)) {
+    return false;
+  }
+  value = l != 0;
+  return true;
+}
+
+bool CommandFields::readField(float &value) {
+  const std::string *field = nextField();
+  if (field == NULL || field->empty()) {
+    return false;
+  }
+  char *end;
+  value = strtof(field->c_str(), &end);
+  return *end == '\0';
+}
+
+// Valid as long as the fields
+bool CommandFields::readField(const char *&value) {
+  const std::string *field = nextField();
+  if (field == NULL) {
+    return false;
+  }
+  value = field->c_str();
+  return true;
+}
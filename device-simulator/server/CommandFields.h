@@ -0,0 +1,53 @@
+#ifndef COMMAND_FIELDS_H
+#define COMMAND_FIELDS_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// Messenger for the generated protocol.h structs. Sent commands are collected
+// as the integers that StandInServer::sendCommand() encodes, received ones are
+// read from the fields of a parsed text command or binary frame.
+class CommandFields {
+public:
+  CommandFields();
+  CommandFields(const std::vector<std::string> &fields);
+  void sendCmdStart(int cmdId);
+  void sendCmdEnd();
+  const std::vector<long> &getValues();
+
+  // Only integer arguments can be sent
+  template <class T> void sendCmdArg(T arg) {
+    values.push_back(static_cast<long>(arg));
+  }
+
+  // Returns 0 or the number of the first missing or malformed argument
+  template <class... T> uint8_t read(T &... args) {
+    return readFields(1, args...);
+  }
+
+private:
+  uint8_t readFields(uint8_t argNumber) {
+    return 0;
+  }
+
+  template <class T, class... Rest> uint8_t readFields(uint8_t argNumber, T &arg, Rest &... rest) {
+    if (!readField(arg)) {
+      return argNumber;
+    }
+    return readFields(argNumber + 1, rest...);
+  }
+
+  bool readField(long &value);
+  bool readField(int &value);
+  bool readField(uint8_t &value);
+  bool readField(bool &value);
+  bool readField(float &value);
+  bool readField(const char *&value);
+  const std::string *nextField();
+  const std::vector<std::string> *fields;
+  size_t nextIndex;
+  std::vector<long> values;
+};
+
+#endif // COMMAND_FIELDS_H
@@ -0,0 +1,81 @@
+#include <LatencyHistogram.h>
+#include <string.h>
+
+LatencyHistogram::LatencyHistogram() {
+  reset();
+}
+
+void LatencyHistogram::record(uint64_t micros) {
+  ++buckets[bucketIndex(micros)];
+  ++count;
+  if (micros > max) {
+    max = micros;
+  }
+}
+
+void LatencyHistogram::add(const LatencyHistogram &other) {
+  for (int i = 0; i < BUCKETS; ++i) {
+    buckets[i] += other.buckets[i];
+  }
+  count += other.count;
+  if (other.max > max) {
+    max = other.max;
+  }
+}
+
+void LatencyHistogram::reset() {
+  memset(buckets, 0, sizeof(buckets));
+  count = 0;
+  max = 0;
+}
+
+uint64_t LatencyHistogram::getCount() {
+  return count;
+}
+
+uint64_t LatencyHistogram::getMax() {
+  return max;
+}
+
+// Returns the upper bound of the bucket that contains the percentile
+uint64_t LatencyHistogram::getPercentile(double percentile) {
+  if (count == 0) {
+    return 0;
+  }
+  uint64_t rank = (uint64_t) (percentile / 100.0 * count + 0.5);
+  if (rank < 1) {
+    rank = 1;
+  }
+  uint64_t seen = 0;
+  for (int i = 0; i < BUCKETS; ++i) {
+    seen += buckets[i];
+    if (seen >= rank) {
+      uint64_t value = bucketValue(i);
+      return value < max ? value : max;
+    }
+  }
+  return max;
+}
+
+// Values below SUB_BUCKETS have a bucket of their own, above that the index
+// is made of the position of the highest bit and the SUB_BUCKET_BITS below it
+int LatencyHistogram::bucketIndex(uint64_t micros) {
+  if (micros < SUB_BUCKETS) {
+    return (int) micros;
+  }
+  int range = 63 - __builtin_clzll(micros) - SUB_BUCKET_BITS + 1;
+  if (range > RANGES) {
+    return BUCKETS - 1;
+  }
+  int subBucket = (int) (micros >> (range - 1)) - SUB_BUCKETS;
+  return range * SUB_BUCKETS + subBucket;
+}
+
+uint64_t LatencyHistogram::bucketValue(int index) {
+  int range = index / SUB_BUCKETS;
+  if (range == 0) {
+    return index;
+  }
+  uint64_t subBucket = index % SUB_BUCKETS + SUB_BUCKETS;
+  return ((subBucket + 1) << (range - 1)) - 1;
+}
@@ -0,0 +1,31 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <stdint.h>
+
+// Log-linear histogram of latencies in microseconds. Every power of two range
+// is split into SUB_BUCKETS buckets, so a percentile is accurate to about 3%
+// up to an hour of latency, with a fixed amount of memory.
+class LatencyHistogram {
+public:
+  LatencyHistogram();
+  void record(uint64_t micros);
+  void add(const LatencyHistogram &other);
+  void reset();
+  uint64_t getCount();
+  uint64_t getMax();
+  uint64_t getPercentile(double percentile);
+
+private:
+  static const int SUB_BUCKET_BITS = 5;
+  static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+  static const int RANGES = 32;
+  static const int BUCKETS = (RANGES + 1) * SUB_BUCKETS;
+  static int bucketIndex(uint64_t micros);
+  static uint64_t bucketValue(int index);
+  uint64_t buckets[BUCKETS];
+  uint64_t count;
+  uint64_t max;
+};
+
+#endif // LATENCY_HISTOGRAM_H
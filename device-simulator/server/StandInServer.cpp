@@ -0,0 +1,635 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <signal.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <string>
+#include <algorithm>
+#include <event2/event.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <getopt.h>
+#include <StandInServer.h>
+#include <messages.h>
+#include <protocol.h>
+
+StandInServer *StandInServer::instance;
+
+StandInServer::StandInServer() {
+  instance = this;
+  sent = 0;
+  answered = 0;
+  lost = 0;
+  receivedBytes = 0;
+  receivedDatagrams = 0;
+  droppedDatagrams = 0;
+  acksSent = 0;
+  sentBytes = 0;
+  events = NULL;
+  workloadTimer = NULL;
+  lastWorkloadTime = 0;
+  msgSocket = -1;
+}
+
+int StandInServer::run(int argc, char* argv[]) {
+  parseProgramArgs(argc, argv);
+
+  setbuf(stdout, NULL);
+  setbuf(stderr, NULL);
+  log("Stand-in server starting with %zu workloads...", workloads.size());
+  initEvents();
+  initNetwork();
+  log("Entering event loop");
+  event_base_dispatch(events);
+  report(true);
+  return 0;
+}
+
+void StandInServer::log(const char *format, ...) {
+  va_list args;
+  va_start (args, format);
+  vprintf (format, args);
+  va_end (args);
+  printf("\n");
+}
+
+void StandInServer::onSigInt(int signo) {
+  instance->log("Terminating...");
+  event_base_loopbreak(instance->events);
+}
+
+void StandInServer::onMessageReceived(int fd, short event, void *arg) {
+  StandInServer *self = (StandInServer *) arg;
+  self->receiveMessages();
+}
+
+void StandInServer::onWorkloadTimer(int fd, short event, void *arg) {
+  StandInServer *self = (StandInServer *) arg;
+  self->sendWrites();
+}
+
+void StandInServer::onReportTimer(int fd, short event, void *arg) {
+  StandInServer *self = (StandInServer *) arg;
+  self->expireWrites();
+  self->report(false);
+}
+
+// Monotonic time in microseconds
+uint64_t StandInServer::now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+std::string StandInServer::addressKey(struct sockaddr_in &address) {
+  return std::string(inet_ntoa(address.sin_addr)) + ":" + std::to_string(ntohs(address.sin_port));
+}
+
+void StandInServer::parseProgramArgs(int argc, char* argv[]) {
+  host = "localhost";
+  port = 2000;
+  reportInterval = 1;
+  duration = 0;
+  timeout = 1000;
+  binaryFrames = false;
+  reliableStates = false;
+  loss = 0;
+  static struct option longOptions[] = {
+    {"bind", required_argument, 0, 'b'},
+    {"port", required_argument, 0, 'p'},
+    {"interval", required_argument, 0, 'i'},
+    {"duration", required_argument, 0, 'd'},
+    {"timeout", required_argument, 0, 't'},
+    {"frames", no_argument, 0, 'f'},
+    {"reliable", no_argument, 0, 'r'},
+    {"loss", required_argument, 0, 'l'},
+    {"help", no_argument, 0, 'h'},
+    {0, 0, 0, 0}
+  };
+  static const char *shortOptions = "b:p:i:d:t:frl:h";
+  int c;
+  int longIndex = 0;
+  while ((c = getopt_long(argc, argv, shortOptions, longOptions, &longIndex)) != -1) {
+    switch(c) {
+      case 'b':
+        host = optarg;
+        break;
+      case 'p':
+        port = std::stoi(optarg);
+        break;
+      case 'i':
+        reportInterval = std::stoi(optarg);
+        break;
+      case 'd':
+        duration = std::stoi(optarg);
+        break;
+      case 't':
+        timeout = std::stoi(optarg);
+        break;
+      case 'f':
+        binaryFrames = true;
+        break;
+      case 'r':
+        reliableStates = true;
+        break;
+      case 'l':
+        loss = std::stoi(optarg);
+        break;
+      case 'h':
+        printf("Usage: %s [WORKLOAD[:RATE]...]\n", argv[0]);
+        printf("  -b, --bind=HOST           listen on ip address HOST (default: localhost)\n");
+        printf("  -p, --port=PORT_NUMBER    the port number for UDP communication (default: 2000)\n");
+        printf("  -i, --interval=SECONDS    print the latencies every SECONDS seconds (default: 1)\n");
+        printf("  -d, --duration=SECONDS    stop after SECONDS seconds (default: run until interrupted)\n");
+        printf("  -t, --timeout=MS          count writes without a state answer after MS milliseconds\n");
+        printf("                            as lost (default: 1000)\n");
+        printf("  -f, --frames              switch the devices to binary frames after their registration\n");
+        printf("  -r, --reliable            let the devices send their states as reliable commands after\n");
+        printf("                            their registration, they are acknowledged and retried\n");
+        printf("  -l, --loss=PERCENT        drop PERCENT of the received datagrams, to test the retries\n");
+        printf("                            of the reliable state messages (default: 0)\n");
+        printf("  -h, --help                print this help\n");
+        printf("Workloads: switch pwm rgb, RATE is the number of writes per second sent round robin\n");
+        printf("to the registered devices of the matching type (default: 10)\n");
+        exit(0);
+      case 0:
+        break;
+      default:
+        printf("»%s --help« prints more help\n", argv[0]);
+        exit(1);
+    }
+  }
+  if (reportInterval < 1) {
+    reportInterval = 1;
+  }
+  for (int i = optind; i < argc; ++i) {
+    createWorkload(argv[i]);
+  }
+}
+
+void StandInServer::createWorkload(std::string spec) {
+  Workload workload;
+  workload.name = spec;
+  workload.rate = 10;
+  int colonIndex = spec.find(':');
+  if (colonIndex != -1) {
+    workload.name = spec.substr(0, colonIndex);
+    workload.rate = std::stod(spec.substr(colonIndex + 1, -1));
+  }
+  if (workload.name == "switch") {
+    workload.deviceType = "Switch";
+    workload.writeCommand = SwitchWriteMsg::ID;
+    workload.stateCommand = SwitchStateMsg::ID;
+  } else if (workload.name == "pwm") {
+    workload.deviceType = "Dimmer";
+    workload.writeCommand = PwmWriteMsg::ID;
+    workload.stateCommand = PwmStateMsg::ID;
+  } else if (workload.name == "rgb") {
+    workload.deviceType = "DimmerRgb";
+    workload.writeCommand = RgbWriteMsg::ID;
+    workload.stateCommand = RgbStateMsg::ID;
+  } else {
+    printf("Unknown workload: %s\n", workload.name.c_str());
+    exit(1);
+  }
+  workload.due = 0;
+  workload.nextDevice = 0;
+  workload.sequence = 0;
+  workloads.push_back(workload);
+}
+
+void StandInServer::initEvents() {
+  signal(SIGINT, onSigInt);
+  events = event_base_new();
+  lastWorkloadTime = now();
+  if (!workloads.empty()) {
+    workloadTimer = event_new(events, -1, EV_PERSIST, onWorkloadTimer, this);
+    struct timeval tv;
+    tv.tv_sec = 0;
+    tv.tv_usec = WORKLOAD_INTERVAL_MS * 1000;
+    event_add(workloadTimer, &tv);
+  }
+  struct event *reportTimer = event_new(events, -1, EV_PERSIST, onReportTimer, this);
+  struct timeval tv;
+  tv.tv_sec = reportInterval;
+  tv.tv_usec = 0;
+  event_add(reportTimer, &tv);
+  if (duration > 0) {
+    tv.tv_sec = duration;
+    event_base_loopexit(events, &tv);
+  }
+}
+
+void StandInServer::initNetwork() {
+  msgSocket = socket(PF_INET, SOCK_DGRAM, 0);
+
+  struct sockaddr_in serverAddress;
+  memset(&serverAddress, 0, sizeof(serverAddress));
+  serverAddress.sin_family = AF_INET;
+  serverAddress.sin_port = htons(port);
+  struct hostent *hostent;
+  hostent = gethostbyname(host.c_str());
+  if (hostent == NULL) {
+    log("Error: Unknown host %s", host.c_str());
+    exit(1);
+  }
+  memcpy(&serverAddress.sin_addr, hostent->h_addr, hostent->h_length);
+
+  if (bind(msgSocket, (struct sockaddr *) &serverAddress, sizeof(struct sockaddr)) < 0) {
+    log("Error: Unable to open UDP port %d: %s", port, strerror(errno));
+    exit(1);
+  }
+  evutil_make_socket_nonblocking(msgSocket);
+
+  struct event *socketEvent;
+  socketEvent = event_new(events, msgSocket, EV_READ | EV_PERSIST, onMessageReceived, this);
+  event_add(socketEvent, NULL);
+}
+
+// CRC-8 with the polynomial 0x07 like the CmdMessenger binary frames
+uint8_t StandInServer::crc8(uint8_t crc, uint8_t data) {
+  crc ^= data;
+  for (int i = 0; i < 8; ++i) {
+    crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+  }
+  return crc;
+}
+
+// Payload and CRC bytes that could be taken for a frame start or end are
+// escaped like CmdMessenger does
+void StandInServer::appendFrameByte(std::string &frame, uint8_t value) {
+  if (value >= BINARY_FRAME_START && value <= BINARY_FRAME_ESCAPE) {
+    frame += (char) BINARY_FRAME_ESCAPE;
+    value ^= 0x20;
+  }
+  frame += (char) value;
+}
+
+// Encodes the command id and the integer arguments as zigzag varints
+std::string StandInServer::encodeFrame(const std::vector<long> &values) {
+  std::string payload;
+  for (size_t i = 0; i < values.size(); ++i) {
+    unsigned long zigzag = ((unsigned long) values[i] << 1) ^ (unsigned long) (values[i] >> (sizeof(long) * 8 - 1));
+    while (zigzag >= 0x80) {
+      payload += (char) ((zigzag & 0x7f) | 0x80);
+      zigzag >>= 7;
+    }
+    payload += (char) zigzag;
+  }
+  std::string frame(1, (char) BINARY_FRAME_START);
+  uint8_t crc = crc8(0, BINARY_FRAME_START);
+  for (size_t i = 0; i < payload.length(); ++i) {
+    crc = crc8(crc, payload[i]);
+    appendFrameByte(frame, payload[i]);
+  }
+  appendFrameByte(frame, crc);
+  frame += (char) BINARY_FRAME_END;
+  return frame;
+}
+
+// Unescapes the frame that starts at data, checks its CRC and decodes the
+// payload as zigzag varints. Only the command id and the leading integer
+// arguments are needed, string arguments don't decode to anything
+// meaningful. Returns the length of the frame including its start and end
+// byte, 0 if it is incomplete or corrupt.
+size_t StandInServer::decodeFrame(const char *data, size_t length, std::vector<std::string> &fields) {
+  std::string frame;
+  size_t end = 1;
+  for (; end < length && (uint8_t) data[end] != BINARY_FRAME_END; ++end) {
+    if ((uint8_t) data[end] == BINARY_FRAME_ESCAPE && end + 1 < length) {
+      frame += (char) (data[++end] ^ 0x20);
+    } else {
+      frame += data[end];
+    }
+  }
+  // The CRC of the start byte, the payload and the CRC is 0
+  uint8_t crc = crc8(0, BINARY_FRAME_START);
+  for (size_t i = 0; i < frame.length(); ++i) {
+    crc = crc8(crc, frame[i]);
+  }
+  if (end == length || frame.length() < 2 || crc != 0) {
+    return 0;
+  }
+  fields.clear();
+  unsigned long zigzag = 0;
+  size_t shift = 0;
+  for (size_t i = 0; i < frame.length() - 1; ++i) {
+    if (shift < 32) {
+      zigzag |= (unsigned long) (frame[i] & 0x7f) << shift;
+    }
+    shift += 7;
+    if ((frame[i] & 0x80) == 0) {
+      fields.push_back(std::to_string((long) ((zigzag >> 1) ^ -(long) (zigzag & 1))));
+      zigzag = 0;
+      shift = 0;
+    }
+  }
+  return fields.empty() ? 0 : end + 1;
+}
+
+// A datagram can contain several commands. Commands are terminated by ';',
+// arguments are separated by ',' and both can be escaped with '/'. Binary
+// frames start with BINARY_FRAME_START where a command starts.
+void StandInServer::receiveMessages() {
+  char buf[1024];
+  std::vector<std::string> fields;
+  for (;;) {
+    struct sockaddr_in address;
+    socklen_t addressSize = sizeof(address);
+    ssize_t len = recvfrom(msgSocket, buf, sizeof(buf), 0, (struct sockaddr *) &address, &addressSize);
+    if (len < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        log("Error: recvfrom() failed: %s", strerror(errno));
+      }
+      break;
+    }
+    receivedBytes += len;
+    ++receivedDatagrams;
+    if (loss > 0 && rand() % 100 < loss) {
+      ++droppedDatagrams;
+      continue;
+    }
+    fields.clear();
+    fields.push_back(std::string());
+    bool escaped = false;
+    for (ssize_t i = 0; i < len; ++i) {
+      char c = buf[i];
+      if ((uint8_t) c == BINARY_FRAME_START && !escaped && fields.size() == 1 && fields[0].empty()) {
+        size_t frameLength = decodeFrame(buf + i, len - i, fields);
+        if (frameLength == 0) {
+          break;
+        }
+        handleMessage(address, fields);
+        fields.clear();
+        fields.push_back(std::string());
+        i += frameLength - 1;
+      } else if (escaped) {
+        fields.back() += c;
+        escaped = false;
+      } else if (c == '/') {
+        escaped = true;
+      } else if (c == ',') {
+        fields.push_back(std::string());
+      } else if (c == ';') {
+        handleMessage(address, fields);
+        fields.clear();
+        fields.push_back(std::string());
+      } else if (c != '\r' && c != '\n') {
+        fields.back() += c;
+      }
+    }
+  }
+}
+
+void StandInServer::handleMessage(struct sockaddr_in &address, std::vector<std::string> &fields) {
+  if (fields[0].empty()) {
+    return;
+  }
+  int command = atoi(fields[0].c_str());
+  if (command == RegisterRequestMsg::ID) {
+    registerDevice(address, fields);
+    return;
+  }
+  Device *device = findDevice(address);
+  if (device == NULL) {
+    return;
+  }
+  if (command == ReliableMsg::ID) {
+    // Acknowledge the sequence number and handle the wrapped command, a
+    // retried command whose first copy arrived is only acknowledged again
+    ReliableMsg reliable;
+    CommandFields reliableFields(fields);
+    if (reliable.read(reliableFields) != 0) {
+      return;
+    }
+    AckMsg ack;
+    ack.sequence = reliable.sequence;
+    sendCommand(*device, ack);
+    ++acksSent;
+    if (!firstReceipt(*device, reliable.sequence)) {
+      return;
+    }
+    fields.erase(fields.begin(), fields.begin() + 2);
+    command = reliable.command;
+  }
+  if (command == BinaryModeMsg::ID) {
+    BinaryModeMsg mode;
+    CommandFields modeFields(fields);
+    device->binaryFrames = mode.read(modeFields) == 0 && mode.enable;
+    return;
+  }
+  if (command == ReliableModeMsg::ID) {
+    // The reliable states are acknowledged above, whether the device sends them or not
+    return;
+  }
+  if (command == PingMsg::ID) {
+    // The device answers a ping with a ping, don't answer the answer
+    if (device->pingAnswered) {
+      device->pingAnswered = false;
+    } else {
+      sendCommand(*device, PingMsg());
+      device->pingAnswered = true;
+    }
+    return;
+  }
+  // Devices answer the writes in order, state messages that were not
+  // requested (e.g. a pressed button) don't have a pending write
+  std::map<int, std::deque<uint64_t> >::iterator pending = device->pendingWrites.find(command);
+  if (pending != device->pendingWrites.end() && !pending->second.empty()) {
+    uint64_t latency = now() - pending->second.front();
+    pending->second.pop_front();
+    intervalLatency.record(latency);
+    ++answered;
+  }
+}
+
+// Same window as CmdMessenger::firstReceipt(), sequence numbers more than 32
+// behind the last one count as new
+bool StandInServer::firstReceipt(Device &device, uint8_t sequence) {
+  uint8_t ahead = sequence - device.lastReceivedSequence;
+  if (device.receivedSequences == 0 || (ahead != 0 && ahead < 128)) {
+    device.receivedSequences = device.receivedSequences == 0 || ahead >= 32 ? 1 :
+      (device.receivedSequences << ahead) | 1;
+    device.lastReceivedSequence = sequence;
+    return true;
+  }
+  uint8_t behind = device.lastReceivedSequence - sequence;
+  if (behind >= 32) {
+    return true;
+  }
+  uint32_t bit = (uint32_t) 1 << behind;
+  if (device.receivedSequences & bit) {
+    return false;
+  }
+  device.receivedSequences |= bit;
+  return true;
+}
+
+void StandInServer::registerDevice(struct sockaddr_in &address, std::vector<std::string> &fields) {
+  RegisterRequestMsg request;
+  CommandFields requestFields(fields);
+  if (request.read(requestFields) != 0) {
+    return;
+  }
+  Device *device = findDevice(address);
+  if (device == NULL) {
+    std::string key = addressKey(address);
+    devicesByAddress[key] = devices.size();
+    devices.push_back(Device());
+    device = &devices.back();
+    device->addressKey = key;
+    device->address = address;
+    device->pingAnswered = false;
+  }
+  device->binaryFrames = false;
+  device->receivedSequences = 0;
+  device->id = request.id;
+  std::string previousType = device->type;
+  device->type = request.type;
+  assignWorkloads(devicesByAddress[device->addressKey], previousType);
+  log("Device %s (%s) registered from %s", device->id.c_str(), device->type.c_str(),
+    device->addressKey.c_str());
+  sendCommand(*device, RegisterResponseMsg());
+  if (binaryFrames) {
+    BinaryModeMsg mode;
+    mode.enable = true;
+    sendCommand(*device, mode);
+  }
+  if (reliableStates) {
+    ReliableModeMsg mode;
+    mode.enable = true;
+    sendCommand(*device, mode);
+  }
+}
+
+// A workload only writes to the devices of the type that handles its write
+// command, e.g. no switch writes to a remote control
+void StandInServer::assignWorkloads(size_t deviceIndex, const std::string &previousType) {
+  const std::string &type = devices[deviceIndex].type;
+  if (type == previousType) {
+    return;
+  }
+  for (size_t i = 0; i < workloads.size(); ++i) {
+    std::vector<size_t> &targets = workloads[i].devices;
+    if (workloads[i].deviceType == previousType) {
+      targets.erase(std::find(targets.begin(), targets.end(), deviceIndex));
+    }
+    if (workloads[i].deviceType == type) {
+      targets.push_back(deviceIndex);
+    }
+  }
+}
+
+StandInServer::Device *StandInServer::findDevice(struct sockaddr_in &address) {
+  std::map<std::string, size_t>::iterator i = devicesByAddress.find(addressKey(address));
+  if (i == devicesByAddress.end()) {
+    return NULL;
+  }
+  return &devices[i->second];
+}
+
+// Called every WORKLOAD_INTERVAL_MS, sends the writes that became due since
+// the last call, so the target rate is kept when the timer fires late
+void StandInServer::sendWrites() {
+  uint64_t time = now();
+  double elapsed = (time - lastWorkloadTime) / 1000000.0;
+  lastWorkloadTime = time;
+  for (size_t i = 0; i < workloads.size(); ++i) {
+    Workload &workload = workloads[i];
+    if (workload.devices.empty()) {
+      workload.due = 0;
+      continue;
+    }
+    workload.due += workload.rate * elapsed;
+    while (workload.due >= 1) {
+      sendWrite(workload, devices[workload.devices[workload.nextDevice % workload.devices.size()]]);
+      ++workload.nextDevice;
+      workload.due -= 1;
+    }
+  }
+}
+
+void StandInServer::sendWrite(Workload &workload, Device &device) {
+  uint8_t value = workload.sequence++ % 256;
+  device.pendingWrites[workload.stateCommand].push_back(now());
+  switch (workload.writeCommand) {
+    case SwitchWriteMsg::ID: {
+      SwitchWriteMsg write;
+      write.switchNum = 0;
+      write.mode = WRITE_TOGGLE;
+      write.on = false;
+      sendCommand(device, write);
+      break;
+    }
+    case PwmWriteMsg::ID: {
+      PwmWriteMsg write;
+      write.mode = WRITE_ABSOLUTE;
+      write.value = value;
+      sendCommand(device, write);
+      break;
+    }
+    case RgbWriteMsg::ID: {
+      RgbWriteMsg write;
+      write.mode = WRITE_ABSOLUTE;
+      write.red = value;
+      write.green = 255 - value;
+      write.blue = value / 2;
+      sendCommand(device, write);
+      break;
+    }
+  }
+  ++sent;
+}
+
+void StandInServer::sendCommand(Device &device, const std::vector<long> &values) {
+  if (device.binaryFrames) {
+    sendMessage(device.address, encodeFrame(values));
+    return;
+  }
+  std::string msg = std::to_string(values[0]);
+  for (size_t i = 1; i < values.size(); ++i) {
+    msg += "," + std::to_string(values[i]);
+  }
+  msg += ";";
+  sendMessage(device.address, msg);
+}
+
+void StandInServer::sendMessage(struct sockaddr_in &address, const std::string &msg) {
+  if (sendto(msgSocket, msg.c_str(), msg.length(), 0, (struct sockaddr *) &address, sizeof(address)) < 0) {
+    log("Error: sendto() failed: %s", strerror(errno));
+    return;
+  }
+  sentBytes += msg.length();
+}
+
+void StandInServer::expireWrites() {
+  uint64_t oldest = now() - (uint64_t) timeout * 1000;
+  for (size_t i = 0; i < devices.size(); ++i) {
+    std::map<int, std::deque<uint64_t> > &pendingWrites = devices[i].pendingWrites;
+    for (std::map<int, std::deque<uint64_t> >::iterator j = pendingWrites.begin(); j != pendingWrites.end(); ++j) {
+      while (!j->second.empty() && j->second.front() < oldest) {
+        j->second.pop_front();
+        ++lost;
+      }
+    }
+  }
+}
+
+void StandInServer::report(bool final) {
+  totalLatency.add(intervalLatency);
+  LatencyHistogram &latency = final ? totalLatency : intervalLatency;
+  log("%s%zu devices, %lu writes sent, %lu answered, %lu lost, %lu acks sent, %lu bytes sent, "
+    "%lu received in %lu datagrams (%lu dropped), "
+    "latency (us) p50 %llu p99 %llu p999 %llu max %llu (%llu samples)",
+    final ? "Total: " : "", devices.size(), sent, answered, lost, acksSent, sentBytes, receivedBytes,
+    receivedDatagrams, droppedDatagrams,
+    (unsigned long long) latency.getPercentile(50),
+    (unsigned long long) latency.getPercentile(99),
+    (unsigned long long) latency.getPercentile(99.9),
+    (unsigned long long) latency.getMax(),
+    (unsigned long long) latency.getCount());
+  intervalLatency.reset();
+}
@@ -0,0 +1,113 @@
+#ifndef STAND_IN_SERVER_H
+#define STAND_IN_SERVER_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <stdint.h>
+#include <netinet/in.h>
+#include <LatencyHistogram.h>
+#include <CommandFields.h>
+
+// Stand-in for the Caretaker server. Devices register over UDP with the
+// messages.h protocol, the server then sends write commands at a fixed rate
+// and measures the time until the device answers with the matching state.
+class StandInServer {
+public:
+  StandInServer();
+  int run(int argc, char* argv[]);
+  void log(const char *format, ...);
+
+private:
+  struct Workload {
+    std::string name;
+    std::string deviceType;
+    int writeCommand;
+    int stateCommand;
+    std::vector<size_t> devices;
+    double rate;
+    double due;
+    size_t nextDevice;
+    unsigned long sequence;
+  };
+  struct Device {
+    std::string id;
+    std::string type;
+    std::string addressKey;
+    struct sockaddr_in address;
+    std::map<int, std::deque<uint64_t> > pendingWrites;
+    bool pingAnswered;
+    bool binaryFrames;
+    // The last 32 sequence numbers of the received reliable commands, bit n
+    // of receivedSequences is lastReceivedSequence - n, 0 if none was received
+    uint8_t lastReceivedSequence;
+    uint32_t receivedSequences;
+  };
+  static void onSigInt(int signo);
+  static void onMessageReceived(int fd, short event, void *arg);
+  static void onWorkloadTimer(int fd, short event, void *arg);
+  static void onReportTimer(int fd, short event, void *arg);
+  static uint64_t now();
+  static std::string addressKey(struct sockaddr_in &address);
+  static bool firstReceipt(Device &device, uint8_t sequence);
+  static uint8_t crc8(uint8_t crc, uint8_t data);
+  static void appendFrameByte(std::string &frame, uint8_t value);
+  static std::string encodeFrame(const std::vector<long> &values);
+  static size_t decodeFrame(const char *data, size_t length, std::vector<std::string> &fields);
+  void parseProgramArgs(int argc, char* argv[]);
+  void createWorkload(std::string spec);
+  void initEvents();
+  void initNetwork();
+  void receiveMessages();
+  void handleMessage(struct sockaddr_in &address, std::vector<std::string> &fields);
+  void registerDevice(struct sockaddr_in &address, std::vector<std::string> &fields);
+  Device *findDevice(struct sockaddr_in &address);
+  void assignWorkloads(size_t deviceIndex, const std::string &previousType);
+  void sendWrites();
+  void sendWrite(Workload &workload, Device &device);
+  void sendCommand(Device &device, const std::vector<long> &values);
+
+  // Sends a message struct of protocol.h
+  template <class Message> void sendCommand(Device &device, const Message &message) {
+    CommandFields command;
+    message.send(command);
+    sendCommand(device, command.getValues());
+  }
+
+  void sendMessage(struct sockaddr_in &address, const std::string &msg);
+  void expireWrites();
+  void report(bool final);
+  static StandInServer *instance;
+  static const int WORKLOAD_INTERVAL_MS = 1;
+  static const uint8_t BINARY_FRAME_START = 0xC0;
+  static const uint8_t BINARY_FRAME_END = 0xC1;
+  static const uint8_t BINARY_FRAME_ESCAPE = 0xC2;
+  std::vector<Workload> workloads;
+  std::vector<Device> devices;
+  std::map<std::string, size_t> devicesByAddress;
+  LatencyHistogram intervalLatency;
+  LatencyHistogram totalLatency;
+  unsigned long sent;
+  unsigned long answered;
+  unsigned long lost;
+  unsigned long receivedBytes;
+  unsigned long receivedDatagrams;
+  unsigned long droppedDatagrams;
+  unsigned long acksSent;
+  unsigned long sentBytes;
+  struct event_base *events;
+  struct event *workloadTimer;
+  uint64_t lastWorkloadTime;
+  int msgSocket;
+  std::string host;
+  int port;
+  int reportInterval;
+  int duration;
+  int timeout;
+  bool binaryFrames;
+  bool reliableStates;
+  int loss;
+};
+
+#endif // STAND_IN_SERVER_H
@@ -0,0 +1,6 @@
+#include <StandInServer.h>
+
+int main(int argc, char* argv[]) {
+  StandInServer server;
+  return server.run(argc, argv);
+}
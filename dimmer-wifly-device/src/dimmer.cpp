@@ -83,7 +83,6 @@ const unsigned long brightnesFadeDelay = 10;
 /** Device configuration */
 DeviceDescriptor device;
 
-void register_message_handlers();
 void blinkLED();
 void calmDownLED();
 void configureINT0();
@@ -92,6 +91,11 @@ void setBrightness(uint8_t val);
 void pwm_read();
 void pwm_write();
 
+// Device specific message handlers
+typedef MessengerDispatch<
+  MessengerHandler<MSG_PWM_WRITE, pwm_write>,
+  MessengerHandler<MSG_PWM_READ, pwm_read> > MessageHandlers;
+
 /**
  * System setup.
  */
@@ -100,7 +104,7 @@ void setup() {
   device.description = "Dimmer";
   device.ledPin = INFO_LED_PIN;
   device.buttonPin = SYS_BUTTON_PIN;
-  device.registerMessageHandlers = register_message_handlers;
+  device.dispatchMessage = MessageHandlers::dispatch;
   deviceInit(device);
 
   pinMode(INFO_LED_PIN, OUTPUT);
@@ -138,14 +142,6 @@ void loop() {
   }
 }
 
-/**
- * Register device specific message handlers.
- */
-void register_message_handlers() {
-  device.messenger->attach(MSG_PWM_WRITE, pwm_write);
-  device.messenger->attach(MSG_PWM_READ, pwm_read);
-}
-
 /**
  * Flash the LED.
  */
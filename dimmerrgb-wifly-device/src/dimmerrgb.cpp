@@ -46,12 +46,16 @@ uint8_t red = 0;
 uint8_t green = 0;
 uint8_t blue = 0;
 
-void register_message_handlers();
 void rgb(uint8_t r, uint8_t g, uint8_t b);
 void toggle();
 void rgb_write();
 void rgb_read();
 
+// Device specific message handlers
+typedef MessengerDispatch<
+  MessengerHandler<MSG_RGB_WRITE, rgb_write>,
+  MessengerHandler<MSG_RGB_READ, rgb_read> > MessageHandlers;
+
 /**
  * Main system setup.
  */
@@ -60,7 +64,7 @@ void setup() {
   device.description = DEVICE_DESCRIPTION;
   device.ledPin = INFO_LED_PIN;
   device.buttonPin = SYS_BUTTON_PIN;
-  device.registerMessageHandlers = register_message_handlers;
+  device.dispatchMessage = MessageHandlers::dispatch;
   deviceInit(device);
 
   pinMode(LED_RED_PIN, OUTPUT);
@@ -87,14 +91,6 @@ void loop() {
   }
 }
 
-/**
- * Register device specific message handlers.
- */
-void register_message_handlers() {
-  device.messenger->attach(MSG_RGB_WRITE, rgb_write);
-  device.messenger->attach(MSG_RGB_READ, rgb_read);
-}
-
 /**
  * Set the RGB values.
  */
@@ -123,35 +119,26 @@ void toggle() {
  * Called when a MSG_RGB_WRITE was received.
  */
 void rgb_write() {
-  int mode = device.messenger->readIntArg();
+  int mode;
+  if (device.messenger->read(mode) != 0) {
+    return;
+  }
   switch (mode) {
     case WRITE_DEFAULT:
       rgb(0, 0, 0);
       break;
-    case WRITE_ABSOLUTE: {
-      int red = device.messenger->readIntArg();
-      int green = device.messenger->readIntArg();
-      int blue = device.messenger->readIntArg();
-      rgb(red, green, blue);
-      break;
-    }
-    case WRITE_INCREMENT: {
-      int red = device.messenger->readIntArg();
-      int green = device.messenger->readIntArg();
-      int blue = device.messenger->readIntArg();
-      rgb(red, green, blue);
+    case WRITE_ABSOLUTE:
+    case WRITE_INCREMENT:
+    case WRITE_DECREMENT: {
+      uint8_t red, green, blue;
+      if (device.messenger->read(red, green, blue) == 0) {
+        rgb(red, green, blue);
+      }
       break;
     }
     case WRITE_INCREMENT_DEFAULT:
       rgb(red + 32, green + 32, blue + 32);
       break;
-    case WRITE_DECREMENT: {
-      int red = device.messenger->readIntArg();
-      int green = device.messenger->readIntArg();
-      int blue = device.messenger->readIntArg();
-      rgb(red, green, blue);
-      break;
-    }
     case WRITE_DECREMENT_DEFAULT:
       rgb(red + 32, green + 32, blue + 32);
       break;
@@ -45,9 +45,12 @@ DeviceDescriptor device;
 
 void blinkLed();
 void error(int num);
-void register_message_handlers();
 void sendButtonState(uint8_t button);
 void buttonRead();
+
+// Device specific message handlers
+typedef MessengerDispatch<
+  MessengerHandler<MSG_BUTTON_READ, buttonRead> > MessageHandlers;
 void send_server_register_params();
 
 /**
@@ -75,7 +78,7 @@ void setup() {
   device.description = "EadyVr Speech Interface";
   device.ledPin = INFO_LED_PIN;
   device.buttonPin = SYS_BUTTON_PIN;
-  device.registerMessageHandlers = register_message_handlers;
+  device.dispatchMessage = MessageHandlers::dispatch;
   device.sendServerRegisterParams = send_server_register_params;
   deviceInit(device);
 }
@@ -132,13 +135,6 @@ void loop() {
   }
 }
 
-/**
- * Register device specific message handlers.
- */
-void register_message_handlers() {
-  device.messenger->attach(MSG_BUTTON_READ, buttonRead);
-}
-
 /**
  * Blinke the LED <num> times in case of an error.
  *
@@ -228,11 +228,15 @@ void modeReflow();
 void loop();
 
 #ifdef CARETAKER
-void register_message_handlers();
 void sendTemperatureToServer();
 void sendStatusToServer();
 void onCommand();
 void onRead();
+
+// Device specific message handlers
+typedef MessengerDispatch<
+  MessengerHandler<MSG_REFLOW_OVEN_CMD, onCommand>,
+  MessengerHandler<MSG_REFLOW_OVEN_READ, onRead> > MessageHandlers;
 #endif
 
 /**
@@ -353,7 +357,7 @@ void setup() {
   device.description = "Reflow Oven";
   device.ledPin = 0;
   device.buttonPin = BUTTON_1;
-  device.registerMessageHandlers = register_message_handlers;
+  device.dispatchMessage = MessageHandlers::dispatch;
   deviceInit(device);
 #endif
 
@@ -676,14 +680,6 @@ void loop() {
 
 #ifdef CARETAKER
 
-/**
- * Register device specific message handlers.
- */
-void register_message_handlers() {
-  device.messenger->attach(MSG_REFLOW_OVEN_CMD, onCommand);
-  device.messenger->attach(MSG_REFLOW_OVEN_READ, onRead);
-}
-
 /**
  * Notify the Caretaker server about the current temperature.
  */
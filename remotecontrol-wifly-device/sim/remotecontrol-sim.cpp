@@ -2,16 +2,25 @@
 #include <Arduino.h>
 #include <Bounce.h>
 #include <stdlib.h>
+#include <CaretakerDevice.h>
 #include "../src/remotecontrol.h"
 
+void setup();
+void loop();
+extern FIRMWARE_GLOBAL unsigned long infoLedOffMillis;
+
 class RemoteControlSimulator : public Simulator {
   friend class RemoteControlArduinoHandler;
   friend class RemoteControlBounceHandler;
+public:
+  RemoteControlSimulator();
+
 private:
   bool button[4];
   bool buttonNew[4];
   bool buttonFalling[4];
   bool buttonRising[4];
+  unsigned long savedInfoLedOffMillis;
 
   void initDeviceState() {
     DeviceState state;
@@ -26,15 +35,23 @@ private:
     sendDeviceState(state);
   }
 
-  void updateDeviceState(DeviceState &state){
-    for (int i = 0; i < 4; ++i) {
-      std::string name = "button" + std::to_string(i);
-      if (state.find(name) != state.end()) {
-        buttonNew[i] = state[name] == "1";
+  void updateDeviceState(const std::string &key, const std::string &value) {
+    if (key.length() == 7 && key.compare(0, 6, "button") == 0) {
+      int i = key[6] - '0';
+      if (i >= 0 && i < 4) {
+        buttonNew[i] = value == "1";
       }
     }
   }
 
+  void saveFirmwareState() {
+    savedInfoLedOffMillis = infoLedOffMillis;
+  }
+
+  void restoreFirmwareState() {
+    infoLedOffMillis = savedInfoLedOffMillis;
+  }
+
   int pinToIndex(uint8_t pin) {
     switch(pin) {
       case BUTTON_01_PIN:
@@ -50,9 +67,12 @@ private:
   }
 };
 
-RemoteControlSimulator sim;
-
 class RemoteControlBounceHandler : public BounceHandler {
+  RemoteControlSimulator &sim;
+
+public:
+  RemoteControlBounceHandler(RemoteControlSimulator &sim) : sim(sim) {}
+
   int update(uint8_t pin) {
     int i = sim.pinToIndex(pin);
     if (i >= 0) {
@@ -94,9 +114,16 @@ class RemoteControlBounceHandler : public BounceHandler {
   }
 };
 
+RemoteControlSimulator::RemoteControlSimulator() {
+  savedInfoLedOffMillis = 0;
+  setBounceHandler(new RemoteControlBounceHandler(*this));
+  setDeviceType(DEVICE_TYPE);
+  setFirmware(setup, loop);
+}
+
+#ifndef SIMULATOR_HOST
 int main(int argc, char* argv[]) {
-  RemoteControlBounceHandler bounceHandler;
-  sim.setBounceHandler(&bounceHandler);
-  sim.setDeviceType(DEVICE_TYPE);
+  RemoteControlSimulator sim;
   return sim.run(argc, argv);
 }
+#endif
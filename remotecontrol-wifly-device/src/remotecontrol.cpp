@@ -30,10 +30,10 @@ Bounce buttons[] = { Bounce(BUTTON_01_PIN, 5), Bounce(BUTTON_02_PIN, 5), Bounce(
 const unsigned long INFO_LED_BLINK_MILLIS = 250;
 
 /** When to switch off the info LED */
-unsigned long infoLedOffMillis;
+FIRMWARE_GLOBAL unsigned long infoLedOffMillis;
 
 /** Device information. */
-DeviceDescriptor device;
+FIRMWARE_GLOBAL DeviceDescriptor device;
 
 void send_server_register_params();
 void deviceOperationalCallback();
@@ -43,7 +43,7 @@ void deviceOperationalCallback();
 const unsigned long AWAKE_TIMEOUT_SECONDS = 3;
 
 /** When to enter the sleep mode */
-unsigned long enterSleepModeMillis;
+FIRMWARE_GLOBAL unsigned long enterSleepModeMillis;
 
 bool isLowBattery();
 void buttonChanged();
@@ -7,6 +7,9 @@
  * You find a copy of license in the root directory of this project
  */
 
+#ifndef REMOTECONTROL_H
+#define REMOTECONTROL_H
+
 /**
  * This code uses 11 pin change interrupt pins. So ensure that the value of
  * MAX_PIN_CHANGE_PINS is at least set to 11 in PinChangeInt.h.
@@ -72,3 +75,5 @@ const uint8_t INFO_LED_PIN = 13;
 const uint8_t SYS_BUTTON_PIN = 12;
 const uint8_t NUM_BUTTONS = 4;
 #endif
+
+#endif // REMOTECONTROL_H
@@ -54,10 +54,14 @@ int ledValueOut[] = { 0, 20, 40, 100, 200, 254 };
 
 void timerIsr();
 void setValue(int value);
-void register_message_handlers();
 void rotary_read();
 void rotary_write();
 
+// Device specific message handlers
+typedef MessengerDispatch<
+  MessengerHandler<MSG_ROTARY_WRITE, rotary_write>,
+  MessengerHandler<MSG_ROTARY_READ, rotary_read> > MessageHandlers;
+
 /**
  * Main system setup.
  */
@@ -66,7 +70,7 @@ void setup() {
   device.description = DEVICE_DESCRIPTION;
   device.ledPin = INFO_LED_PIN;
   device.buttonPin = SYS_BUTTON_PIN;
-  device.registerMessageHandlers = register_message_handlers;
+  device.dispatchMessage = MessageHandlers::dispatch;
   deviceInit(device);
 
   pinMode(VALUE_LED_PIN, OUTPUT);
@@ -126,14 +130,6 @@ void setValue(int newValue) {
   }
 }
 
-/**
- * Register device specific message handlers.
- */
-void register_message_handlers() {
-  device.messenger->attach(MSG_ROTARY_WRITE, rotary_write);
-  device.messenger->attach(MSG_ROTARY_READ, rotary_read);
-}
-
 /**
  * Called when a MSG_ROTARY_READ was received.
  */
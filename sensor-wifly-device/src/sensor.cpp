@@ -46,9 +46,12 @@ const unsigned long SEND_INTERVAL = 1000;
 unsigned long nextSendMillis = 0;
 
 void send_server_register_params();
-void register_message_handlers();
 void switch_read();
 
+// Device specific message handlers
+typedef MessengerDispatch<
+  MessengerHandler<MSG_SENSOR_READ, switch_read> > MessageHandlers;
+
 /**
  * System setup.
  */
@@ -57,7 +60,7 @@ void setup() {
   device.description = DEVICE_DESCRIPTION;
   device.ledPin = INFO_LED_PIN;
   device.buttonPin = SYS_BUTTON_PIN;
-  device.registerMessageHandlers = register_message_handlers;
+  device.dispatchMessage = MessageHandlers::dispatch;
   device.sendServerRegisterParams = send_server_register_params;
   deviceInit(device);
 }
@@ -88,20 +91,15 @@ void loop() {
  * @param messenger
  */
 void send_server_register_params() {
-  device.messenger->sendCmdArg(2);
-  device.messenger->sendCmdArg(SENSOR_TEMPERATURE);
-  device.messenger->sendCmdArg(-10);
-  device.messenger->sendCmdArg(85);
-  device.messenger->sendCmdArg(SENSOR_BRIGHTNESS);
-  device.messenger->sendCmdArg(0);
-  device.messenger->sendCmdArg(100);
-}
-
-/**
- * Register device specific message handlers.
- */
-void register_message_handlers() {
-  device.messenger->attach(MSG_SENSOR_READ, switch_read);
+  static const SensorRangeArgs ranges[] = {
+    {SENSOR_TEMPERATURE, -10, 85},
+    {SENSOR_BRIGHTNESS, 0, 100}
+  };
+  const uint8_t numRanges = sizeof ranges / sizeof ranges[0];
+  device.messenger->sendCmdArg(numRanges);
+  for (uint8_t i = 0; i < numRanges; ++i) {
+    ranges[i].sendArgs(*device.messenger);
+  }
 }
 
 /**
@@ -4,9 +4,15 @@
 #include <stdlib.h>
 #include "../src/switch.h"
 
+void setup();
+void loop();
+
 class SwitchSimulator : public Simulator {
   friend class SwitchArduinoHandler;
   friend class SwitchBounceHandler;
+public:
+  SwitchSimulator();
+
 private:
   bool relais;
   bool button; bool buttonNew;
@@ -23,16 +29,19 @@ private:
     sendDeviceState(state);
   }
 
-  void updateDeviceState(DeviceState &state) {
-    if (state.find("button") != state.end()) {
-      buttonNew = state["button"] == "1";
+  void updateDeviceState(const std::string &key, const std::string &value) {
+    if (key == "button") {
+      buttonNew = value == "1";
     }
   }
 };
 
-SwitchSimulator sim;
-
 class SwitchArduinoHandler : public ArduinoHandler {
+  SwitchSimulator &sim;
+
+public:
+  SwitchArduinoHandler(SwitchSimulator &sim) : sim(sim) {}
+
   uint8_t digitalRead(uint8_t pin) {
     if (pin == SWITCH_PIN) {
       return sim.relais ? HIGH : LOW;
@@ -49,6 +58,11 @@ class SwitchArduinoHandler : public ArduinoHandler {
 };
 
 class SwitchBounceHandler : public BounceHandler {
+  SwitchSimulator &sim;
+
+public:
+  SwitchBounceHandler(SwitchSimulator &sim) : sim(sim) {}
+
   int update(uint8_t pin) {
     if (sim.button != sim.buttonNew) {
       sim.buttonFalling = sim.buttonNew == false;
@@ -65,11 +79,16 @@ class SwitchBounceHandler : public BounceHandler {
   }
 };
 
+SwitchSimulator::SwitchSimulator() {
+  setArduinoHandler(new SwitchArduinoHandler(*this));
+  setBounceHandler(new SwitchBounceHandler(*this));
+  setDeviceType(DEVICE_TYPE);
+  setFirmware(setup, loop);
+}
+
+#ifndef SIMULATOR_HOST
 int main(int argc, char* argv[]) {
-  SwitchArduinoHandler arduinoHandler;
-  sim.setArduinoHandler(&arduinoHandler);
-  SwitchBounceHandler bounceHandler;
-  sim.setBounceHandler(&bounceHandler);
-  sim.setDeviceType(DEVICE_TYPE);
+  SwitchSimulator sim;
   return sim.run(argc, argv);
 }
+#endif
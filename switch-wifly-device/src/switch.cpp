@@ -12,16 +12,21 @@
 #include <CaretakerDevice.h>
 #include "switch.h"
 
-DeviceDescriptor device;
+FIRMWARE_GLOBAL DeviceDescriptor device;
 
 Bounce button(MANUAL_BUTTON_PIN, 5);
 
 void send_server_register_params();
-void register_message_handlers();
 void switch_read();
 void switch_write();
+void send_switch_state(uint8_t switchNum);
 
-unsigned long nextBlinkMillis = 0;
+// Device specific message handlers
+typedef MessengerDispatch<
+  MessengerHandler<MSG_SWITCH_WRITE, switch_write>,
+  MessengerHandler<MSG_SWITCH_READ, switch_read> > MessageHandlers;
+
+FIRMWARE_GLOBAL unsigned long nextBlinkMillis = 0;
 
 /**
  * System setup.
@@ -31,7 +36,7 @@ void setup() {
   device.description = DEVICE_DESCRIPTION;
   device.ledPin = INFO_LED_PIN;
   device.buttonPin = SYS_BUTTON_PIN;
-  device.registerMessageHandlers = register_message_handlers;
+  device.dispatchMessage = MessageHandlers::dispatch;
   device.sendServerRegisterParams = send_server_register_params;
   deviceInit(device);
 
@@ -69,46 +74,38 @@ void send_server_register_params() {
   device.messenger->sendCmdArg(NUM_SWITCHES);
 }
 
-/**
- * Register device specific message handlers.
- */
-void register_message_handlers() {
-  device.messenger->attach(MSG_SWITCH_WRITE, switch_write);
-  device.messenger->attach(MSG_SWITCH_READ, switch_read);
-}
-
 /**
  * Called when a MSG_SWITCH_WRITE was received.
  */
 void switch_read() {
-  device.messenger->sendCmdStart(MSG_SWITCH_STATE);
-  device.messenger->sendCmdArg(0);
-  device.messenger->sendCmdArg(digitalRead(SWITCH_PIN));
-  device.messenger->sendCmdEnd();
+  SwitchStateMsg state;
+  state.switchNum = 0;
+  state.on = digitalRead(SWITCH_PIN) == HIGH;
+  state.send(*device.messenger);
 }
 
 /**
  * Called when a MSG_SWITCH_WRITE was received.
  */
 void switch_write() {
-  device.messenger->next(); // Ignore switch number
-  int mode = device.messenger->readIntArg();
-  switch (mode) {
+  SwitchWriteMsg write; // The switch number is ignored, there is only one switch
+  if (write.read(*device.messenger) != 0) {
+    return;
+  }
+  switch (write.mode) {
     case WRITE_DEFAULT:
       digitalWrite(SWITCH_PIN, LOW);
       break;
     case WRITE_ABSOLUTE:
-      digitalWrite(SWITCH_PIN, device.messenger->readIntArg() != 0 ? HIGH : LOW);
+      digitalWrite(SWITCH_PIN, write.on ? HIGH : LOW);
       break;
     case WRITE_INCREMENT:
-      device.messenger->next(); // Ignore increment value
       digitalWrite(SWITCH_PIN, HIGH);
       break;
     case WRITE_INCREMENT_DEFAULT:
       digitalWrite(SWITCH_PIN, HIGH);
       break;
     case WRITE_DECREMENT:
-      device.messenger->next(); // Ignore decrement value
       digitalWrite(SWITCH_PIN, LOW);
       break;
     case WRITE_DECREMENT_DEFAULT:
@@ -120,5 +117,19 @@ void switch_write() {
     default:
       break;
   }
-  switch_read();
+  send_switch_state(0);
+}
+
+/**
+ * Sends the switch state after a write. Once the server has enabled reliable
+ * states, it is sent again until the server acknowledges it.
+ * Also the retry function of the state message, so a retry sends the current state.
+ */
+void send_switch_state(uint8_t switchNum) {
+  SwitchStateMsg state;
+  state.switchNum = switchNum;
+  state.on = digitalRead(SWITCH_PIN) == HIGH;
+  device.messenger->sendReliableCmdStart(SwitchStateMsg::ID, send_switch_state, switchNum);
+  state.sendArgs(*device.messenger);
+  device.messenger->sendCmdEnd();
 }
@@ -1,12 +1,21 @@
 #include <Simulator.h>
 #include <Arduino.h>
 #include <stdlib.h>
+#include <CaretakerDevice.h>
 #include "../src/switch8.h"
 
+void setup();
+void loop();
+extern FIRMWARE_GLOBAL unsigned long beepCalmDownTime;
+
 class Switch8Simulator : public Simulator {
   friend class Switch8ArduinoHandler;
+public:
+  Switch8Simulator();
+
 private:
   bool relais[8];
+  unsigned long savedBeepCalmDownTime;
 
   void initDeviceState() {
     DeviceState state;
@@ -17,15 +26,23 @@ private:
     sendDeviceState(state);
   }
 
-  void updateDeviceState(DeviceState &state) {
-    for (int i = 0; i < 8; ++i) {
-      std::string key = "relais" + std::to_string(i);
-      if (state.find(key) != state.end()) {
-        relais[i] = state[key] == "1";
+  void updateDeviceState(const std::string &key, const std::string &value) {
+    if (key.length() == 7 && key.compare(0, 6, "relais") == 0) {
+      int i = key[6] - '0';
+      if (i >= 0 && i < 8) {
+        relais[i] = value == "1";
       }
     }
   }
 
+  void saveFirmwareState() {
+    savedBeepCalmDownTime = beepCalmDownTime;
+  }
+
+  void restoreFirmwareState() {
+    beepCalmDownTime = savedBeepCalmDownTime;
+  }
+
   int pinToIndex(uint8_t pin) {
     switch(pin) {
       case PIN_SWITCH0:
@@ -49,9 +66,12 @@ private:
   }
 };
 
-Switch8Simulator sim;
-
 class Switch8ArduinoHandler : public ArduinoHandler {
+  Switch8Simulator &sim;
+
+public:
+  Switch8ArduinoHandler(Switch8Simulator &sim) : sim(sim) {}
+
   uint8_t digitalRead(uint8_t pin) {
     int index = sim.pinToIndex(pin);
     if (index >= 0) {
@@ -70,9 +90,16 @@ class Switch8ArduinoHandler : public ArduinoHandler {
   }
 };
 
+Switch8Simulator::Switch8Simulator() {
+  savedBeepCalmDownTime = 0;
+  setArduinoHandler(new Switch8ArduinoHandler(*this));
+  setDeviceType(DEVICE_TYPE);
+  setFirmware(setup, loop);
+}
+
+#ifndef SIMULATOR_HOST
 int main(int argc, char* argv[]) {
-  Switch8ArduinoHandler arduinoHandler;
-  sim.setArduinoHandler(&arduinoHandler);
-  sim.setDeviceType(DEVICE_TYPE);
+  Switch8Simulator sim;
   return sim.run(argc, argv);
 }
+#endif
@@ -23,19 +23,25 @@ const uint8_t NUM_SWITCH_PINS = sizeof switchPins / sizeof switchPins[0];
 const int BEEP_DURATION = 100;
 
 /** When to switch off the buzzer (milli second timestamp) */
-unsigned long beepCalmDownTime = 0;
+FIRMWARE_GLOBAL unsigned long beepCalmDownTime = 0;
 
 /** Device information */
-DeviceDescriptor device;
+FIRMWARE_GLOBAL DeviceDescriptor device;
 
 void beep(int duration);
 void calmDownBeep();
 void sendServerRegisterParams();
-void registerMessageHandlers();
+SwitchStateMsg switchState(uint8_t switchNum);
 void sendSwitchState(int switchNum);
+void sendWrittenSwitchState(uint8_t switchNum);
 void switchRead();
 void switchWrite();
 
+// Device specific message handlers
+typedef MessengerDispatch<
+  MessengerHandler<MSG_SWITCH_WRITE, switchWrite>,
+  MessengerHandler<MSG_SWITCH_READ, switchRead> > MessageHandlers;
+
 /**
  * System setup.
  */
@@ -55,7 +61,7 @@ void setup()
   device.description = "8 port switch";
   device.ledPin = 0;
   device.buttonPin = 0;
-  device.registerMessageHandlers = registerMessageHandlers;
+  device.dispatchMessage = MessageHandlers::dispatch;
   device.sendServerRegisterParams = sendServerRegisterParams;
   deviceInit(device);
 }
@@ -109,11 +115,15 @@ void sendServerRegisterParams() {
 }
 
 /**
- * Register device specific message handlers.
+ * Return the state message of the specified switch.
+ *
+ * @param switchNum The switch number
  */
-void registerMessageHandlers() {
-  device.messenger->attach(MSG_SWITCH_WRITE, switchWrite);
-  device.messenger->attach(MSG_SWITCH_READ, switchRead);
+SwitchStateMsg switchState(uint8_t switchNum) {
+  SwitchStateMsg state;
+  state.switchNum = switchNum;
+  state.on = digitalRead(switchPins[switchNum]) == HIGH;
+  return state;
 }
 
 /**
@@ -122,50 +132,43 @@ void registerMessageHandlers() {
  * @param switchNum The switch number
  */
 void sendSwitchState(int switchNum) {
-  uint8_t switchPin = switchPins[switchNum];
-  device.messenger->sendCmdStart(MSG_SWITCH_STATE);
-  device.messenger->sendCmdArg(switchNum);
-  device.messenger->sendCmdArg(digitalRead(switchPin) == HIGH ? 1 : 0);
-  device.messenger->sendCmdEnd();
+  switchState(switchNum).send(*device.messenger);
 }
 
 /**
  * Called when a MSG_SWITCH_READ was received.
  */
 void switchRead() {
-  int switchNum = device.messenger->readIntArg();
-  if (switchNum < 0 || switchNum > 7) {
+  SwitchReadMsg read;
+  if (read.read(*device.messenger) != 0 || read.switchNum > 7) {
     return;
   }
-  sendSwitchState(switchNum);
+  sendSwitchState(read.switchNum);
 }
 
 /**
  * Called when a MSG_SWITCH_WRITE was received.
  */
 void switchWrite() {
-  int switchNum = device.messenger->readIntArg();
-  if (switchNum < 0 || switchNum > 7) {
+  SwitchWriteMsg write;
+  if (write.read(*device.messenger) != 0 || write.switchNum > 7) {
     return;
   }
-  uint8_t switchPin = switchPins[switchNum];
-  uint8_t mode = device.messenger->readIntArg();
-  switch (mode) {
+  uint8_t switchPin = switchPins[write.switchNum];
+  switch (write.mode) {
     case WRITE_DEFAULT:
       digitalWrite(switchPin, LOW);
       break;
     case WRITE_ABSOLUTE:
-      digitalWrite(switchPin, device.messenger->readIntArg() != 0 ? HIGH : LOW);
+      digitalWrite(switchPin, write.on ? HIGH : LOW);
       break;
     case WRITE_INCREMENT:
-      device.messenger->next(); // Ignore increment value
       digitalWrite(switchPin, HIGH);
       break;
     case WRITE_INCREMENT_DEFAULT:
       digitalWrite(switchPin, HIGH);
       break;
     case WRITE_DECREMENT:
-      device.messenger->next(); // Ignore decrement value
       digitalWrite(switchPin, LOW);
       break;
     case WRITE_DECREMENT_DEFAULT:
@@ -178,5 +181,18 @@ void switchWrite() {
       break;
   }
   beep();
-  sendSwitchState(switchNum);
+  sendWrittenSwitchState(write.switchNum);
+}
+
+/**
+ * Sends the state of a switch after a write. Once the server has enabled reliable
+ * states, it is sent again until the server acknowledges it.
+ * Also the retry function of the state message, so a retry sends the current state.
+ *
+ * @param switchNum The switch number
+ */
+void sendWrittenSwitchState(uint8_t switchNum) {
+  device.messenger->sendReliableCmdStart(SwitchStateMsg::ID, sendWrittenSwitchState, switchNum);
+  switchState(switchNum).sendArgs(*device.messenger);
+  device.messenger->sendCmdEnd();
 }
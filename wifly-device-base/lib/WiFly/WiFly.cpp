@@ -4,6 +4,15 @@
 
 WiFly *WiFly::instance;
 
+// States of the command started with startCommand()
+enum {
+    ASYNC_IDLE,
+    ASYNC_COMMAND_MODE,         // "$$$" sent, waiting for "CMD"
+    ASYNC_COMMAND_MODE_CHECK,   // "\r" sent, the module answers "ERR" if already in command mode
+    ASYNC_COMMAND,              // The command sent, waiting for its ack
+    ASYNC_SETTLE                // The command without ack sent, dropping its answer
+};
+
 WiFly::WiFly(Stream *serial)
 {
     instance = this;
@@ -14,6 +23,8 @@ WiFly::WiFly(Stream *serial)
     command_mode = false;
     associated = false;
     error_count = 0;
+    async_state = ASYNC_IDLE;
+    async_result = WIFLY_COMMAND_OK;
 }
 
 WiFly::WiFly(Stream &serial)
@@ -25,6 +36,8 @@ WiFly::WiFly(Stream &serial)
 
     command_mode = false;
     associated = false;
+    async_state = ASYNC_IDLE;
+    async_result = WIFLY_COMMAND_OK;
 }
 
 int WiFly::available()
@@ -334,6 +347,122 @@ boolean WiFly::sendCommand(const char *cmd, const char *ack, int timeout)
     return true;
 }
 
+/**
+ * Sends a command like sendCommand() but returns at once. The ack is matched
+ * against the received bytes by the following pollCommand() calls. The command
+ * is sent again retries times after a timeout. A command without ack is done
+ * when the module was quiet for SETTLE_TIME after it.
+ */
+void WiFly::startCommand(const char *cmd, const char *ack, int timeout, uint8_t retries, boolean leaveCommandMode)
+{
+    DBG("CMD: ");
+    DBG(cmd);
+    DBG("\r\n");
+    async_cmd = cmd;
+    async_ack = ack;
+    async_timeout = timeout;
+    async_retries = retries;
+    async_leave = leaveCommandMode;
+    restartCommand();
+}
+
+/**
+ * Processes the received bytes and timeouts of the command started with
+ * startCommand(). Returns WIFLY_COMMAND_PENDING until the ack was received or
+ * all tries timed out, then WIFLY_COMMAND_OK or WIFLY_COMMAND_FAILED.
+ */
+uint8_t WiFly::pollCommand()
+{
+    if (async_state == ASYNC_IDLE) {
+        return async_result;
+    }
+
+    // The answer of a command without ack would match the ack of the next command
+    if (async_state == ASYNC_SETTLE) {
+        if (available() > 0) {
+            discard();
+            expected_millis = millis();
+        } else if ((millis() - expected_millis) > SETTLE_TIME) {
+            finishCommand(WIFLY_COMMAND_OK);
+            return async_result;
+        }
+        return WIFLY_COMMAND_PENDING;
+    }
+
+    // The bytes after the answer are kept for the next one
+    while (expected != NULL && expected[expected_index] != '\0' && available() > 0) {
+        char c = read();
+        if (c == expected[expected_index]) {
+            expected_index++;
+        } else {
+            expected_index = (c == expected[0]) ? 1 : 0;
+        }
+    }
+
+    if (expected == NULL || expected[expected_index] == '\0') {
+        if (async_state == ASYNC_COMMAND) {
+            error_count = 0;
+            if (async_leave) {
+                command_mode = false;
+            }
+            if (expected == NULL) {
+                async_state = ASYNC_SETTLE;
+                return WIFLY_COMMAND_PENDING;
+            }
+            finishCommand(WIFLY_COMMAND_OK);
+            return async_result;
+        }
+        command_mode = true;
+        expect(async_cmd, async_ack, async_timeout, ASYNC_COMMAND);
+    } else if ((millis() - expected_millis) > (unsigned long) expected_timeout) {
+        if (async_state == ASYNC_COMMAND_MODE) {
+            expect("\r", "ERR", DEFAULT_WAIT_RESPONSE_TIME, ASYNC_COMMAND_MODE_CHECK);
+        } else {
+            DBG("Failed to run: ");
+            DBG(async_cmd);
+            DBG("\r\n");
+            error_count++;
+            if (async_retries > 0) {
+                async_retries--;
+                restartCommand();
+            } else {
+                finishCommand(WIFLY_COMMAND_FAILED);
+                return async_result;
+            }
+        }
+    }
+    return WIFLY_COMMAND_PENDING;
+}
+
+/**
+ * Sends the started command, after entering the command mode if needed
+ */
+void WiFly::restartCommand()
+{
+    discard();
+    if (command_mode && (error_count < 2)) {
+        expect(async_cmd, async_ack, async_timeout, ASYNC_COMMAND);
+    } else {
+        expect("$$$", "CMD", DEFAULT_WAIT_RESPONSE_TIME, ASYNC_COMMAND_MODE);
+    }
+}
+
+void WiFly::expect(const char *q, const char *a, int timeout, uint8_t state)
+{
+    send(q);
+    expected = a;
+    expected_index = 0;
+    expected_timeout = timeout;
+    expected_millis = millis();
+    async_state = state;
+}
+
+void WiFly::finishCommand(uint8_t result)
+{
+    async_state = ASYNC_IDLE;
+    async_result = result;
+}
+
 boolean WiFly::commandMode()
 {
     if (command_mode && (error_count < 2)) {
@@ -371,6 +500,16 @@ void WiFly::clear()
     }
 }
 
+/**
+ * Drops the received bytes without waiting for more like clear()
+ */
+void WiFly::discard()
+{
+    while (available() > 0) {
+        read();
+    }
+}
+
 void WiFly::version(char *buf, int buflen)
 {
     if (!sendCommand("ver\r", "Ver")) {
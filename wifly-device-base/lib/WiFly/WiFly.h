@@ -6,10 +6,16 @@
 #include <Stream.h>
 
 #define DEFAULT_WAIT_RESPONSE_TIME      1000        // 1000ms
+#define SETTLE_TIME                     50          // quiet time that ends a command without ack
 #define DEFAULT_BAUDRATE                9600
 #define MAX_CMD_LEN                     32
 #define MAX_TRY_JOIN                    3
 
+// Results of pollCommand()
+#define WIFLY_COMMAND_PENDING           0
+#define WIFLY_COMMAND_OK                1
+#define WIFLY_COMMAND_FAILED            2
+
 // Auth Modes for Network Authentication
 // See WiFly manual for details
 #define WIFLY_AUTH_OPEN        0    // Open (default)  
@@ -59,6 +65,11 @@ public:
     boolean ask(const char *q, const char *a, int timeout = DEFAULT_WAIT_RESPONSE_TIME);
     boolean sendCommand(const char *cmd, const char *ack = NULL, int timeout = DEFAULT_WAIT_RESPONSE_TIME);
 
+    // Non-blocking sendCommand(), cmd and ack must stay valid until pollCommand() returns a result
+    void startCommand(const char *cmd, const char *ack = NULL, int timeout = DEFAULT_WAIT_RESPONSE_TIME,
+                      uint8_t retries = 0, boolean leaveCommandMode = false);
+    uint8_t pollCommand();
+
     boolean commandMode();
     boolean dataMode();
 
@@ -76,6 +87,26 @@ private:
     uint8_t dhcp;
     uint8_t error_count;
 
+    // The command started with startCommand()
+    const char *async_cmd;
+    const char *async_ack;
+    int async_timeout;
+    uint8_t async_retries;
+    boolean async_leave;
+    uint8_t async_state;
+    uint8_t async_result;
+
+    // The answer that is being awaited
+    const char *expected;
+    uint8_t expected_index;
+    int expected_timeout;
+    unsigned long expected_millis;
+
+    void restartCommand();
+    void expect(const char *q, const char *a, int timeout, uint8_t state);
+    void finishCommand(uint8_t result);
+    void discard();
+
 };
 
 #endif // __WIFLY_H__
@@ -0,0 +1,181 @@
+#!/bin/env ruby
+
+require 'optparse'
+require 'yaml'
+require 'ostruct'
+
+LICENSE = <<EOS
+/**
+ * This file is part of the Caretaker Home Automation System
+ *
+ * Copyright 2011-2015 Dirk Grappendorf, www.grappendorf.net
+ *
+ * Licensed under the the MIT License
+ * You find a copy of license in the root directory of this project
+ */
+
+/* Generated by protocol/generate.rb from protocol/messages.yml, don't edit */
+EOS
+
+TYPES = {
+  'bool' => 'bool',
+  'uint8' => 'uint8_t',
+  'int' => 'int',
+  'long' => 'long',
+  'float' => 'float',
+  'string' => 'const char *'
+}
+
+def camel_case name
+  name.downcase.split('_').map(&:capitalize).join
+end
+
+def defines names_and_values
+  width = names_and_values.map { |name, _| name.length }.max + 2
+  names_and_values.map { |name, value| "#define #{name.ljust width}#{value}\n" }.join
+end
+
+def check_fields name, fields
+  optional = false
+  fields.each do |field|
+    raise "#{name}: field name #{field['name'].inspect} is not a string" unless field['name'].is_a? String
+    raise "#{name}.#{field['name']}: unknown type #{field['type']}" unless TYPES.key? field['type']
+    raise "#{name}.#{field['name']}: required field after an optional one" if optional && !field['optional']
+    optional ||= field['optional']
+  end
+end
+
+def messages_h schema
+  ids = schema['messages'].map { |message| ["MSG_#{message['name']}", message['id']] }
+  groups = schema['constants'].map do |group|
+    group['values'].each_key do |name|
+      raise "#{group['prefix']}#{name.inspect} is not a string" unless name.is_a? String
+    end
+    "/** #{group['comment']} */\n" + defines(group['values'].map { |name, value| [group['prefix'] + name, value] })
+  end
+  LICENSE + "\n#ifndef _MESSAGES_H\n#define _MESSAGES_H\n\n/** General messages */\n" + defines(ids) +
+    groups.map { |group| "\n" + group }.join + "\n#endif /* _MESSAGES_H */\n"
+end
+
+# The struct of a message (with an id) or a record (without)
+def struct name, entry, id
+  fields = entry['fields']
+  check_fields name, fields
+  names = fields.map { |field| field['name'] }
+  required = fields.count { |field| !field['optional'] }
+  messenger = fields.empty? ? 'Messenger &' : 'Messenger &messenger'
+  s = "/**\n"
+  s << " * #{id || name}" << (entry['comment'] ? ": #{entry['comment']}" : '') << "\n"
+  s << " * Followed by: #{entry['more']}\n" if entry['more']
+  s << " */\n"
+  s << "struct #{camel_case name}#{id ? 'Msg' : 'Args'} {\n"
+  s << "  static const uint8_t ID = #{id};\n" if id
+  fields.each do |field|
+    s << "  #{TYPES[field['type']]}#{field['type'] == 'string' ? '' : ' '}#{field['name']};\n"
+  end
+  s << "\n" unless fields.empty? && !id
+  s << "  template <class Messenger> void sendArgs(#{messenger}) const {\n"
+  names.each { |field| s << "    messenger.sendCmdArg(#{field});\n" }
+  s << "  }\n\n"
+  if id && entry['more']
+    s << "  template <class Messenger> void start(Messenger &messenger) const {\n"
+    s << "    messenger.sendCmdStart(ID);\n"
+    s << "    sendArgs(messenger);\n"
+    s << "  }\n\n"
+  end
+  if id
+    s << "  template <class Messenger> void send(Messenger &messenger) const {\n"
+    s << "    messenger.sendCmdStart(ID);\n"
+    s << "    sendArgs(messenger);\n"
+    s << "    messenger.sendCmdEnd();\n"
+    s << "  }\n\n"
+  end
+  s << "  template <class Messenger> uint8_t read(#{messenger}) {\n"
+  if fields.empty?
+    s << "    return 0;\n"
+  elsif required == fields.length
+    s << "    return messenger.read(#{names.join ', '});\n"
+  else
+    fields.drop(required).each { |field| s << "    #{field['name']} = 0;\n" }
+    s << "    uint8_t failed = messenger.read(#{names.join ', '});\n"
+    s << "    return failed > #{required} ? 0 : failed;\n"
+  end
+  s << "  }\n"
+  s << "};\n"
+end
+
+def protocol_h schema
+  structs = schema['messages'].select { |message| message['fields'] }.map do |message|
+    struct message['name'], message, "MSG_#{message['name']}"
+  end
+  structs += (schema['records'] || []).map { |record| struct record['name'], record, nil }
+  LICENSE + <<EOS + structs.map { |s| "\n" + s }.join + "\n#endif /* _PROTOCOL_H */\n"
+
+#ifndef _PROTOCOL_H
+#define _PROTOCOL_H
+
+#include <stdint.h>
+#include "messages.h"
+
+/**
+ * A struct per message and argument record. The templates work with every
+ * messenger with the CmdMessenger functions sendCmdStart(), sendCmdArg(),
+ * sendCmdEnd() and read(), e.g.
+ *
+ *   SwitchStateMsg state;
+ *   state.switchNum = 0;
+ *   state.on = true;
+ *   state.send(*device.messenger);
+ *
+ *   SwitchWriteMsg write;
+ *   if (write.read(*device.messenger) == 0) ...
+ *
+ * read() parses the arguments in one pass and returns 0 or the number of the
+ * first missing or malformed required field. Missing optional fields are 0.
+ * sendArgs() sends the arguments only, e.g. after sendReliableCmdStart(),
+ * start() of messages with more arguments doesn't end the command.
+ */
+EOS
+end
+
+options = OpenStruct.new
+options.check = false
+options.output = File.join File.dirname(__FILE__), '..', 'src'
+
+opt_parser = OptionParser.new do |opts|
+  opts.banner = 'Usage: generate.rb [schema_file]'
+
+  opts.on '-o <directory>', 'Write the headers to directory (default: ../src)' do |arg|
+    options.output = arg
+  end
+
+  opts.on '-c', '--check', 'Don\'t write, fail if the headers are not up to date' do
+    options.check = true
+  end
+
+  opts.on_tail '-h', '--help', 'Show this message' do
+    puts 'Caretaker Protocol Generator'
+    puts
+    puts 'Creates messages.h and protocol.h from the message schema (default: messages.yml)'
+    puts
+    puts opts
+    exit
+  end
+end
+
+opt_parser.parse! ARGV
+schema = YAML.load_file(ARGV.first || File.join(File.dirname(__FILE__), 'messages.yml'))
+
+outdated = false
+{'messages.h' => messages_h(schema), 'protocol.h' => protocol_h(schema)}.each do |file, content|
+  path = File.join options.output, file
+  next if File.exist?(path) && File.read(path) == content
+  if options.check
+    puts "#{path} is not up to date"
+    outdated = true
+  else
+    File.write path, content
+    puts "Wrote #{path}"
+  end
+end
+exit 1 if outdated
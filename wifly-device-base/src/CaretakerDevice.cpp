@@ -32,6 +32,7 @@ char deviceUuid[DEVICE_UUID_LEN + 1];
 char deviceName[DEVICE_NAME_MAX_LEN + 1];
 char ssid[SSID_MAX_LEN + 1];
 char phrase[PHRASE_MAX_LEN + 1];
+uint16_t wiflyDigest;
 
 #define EEPROM_SIZE EEPROMSizeATmega328
 
@@ -40,6 +41,7 @@ char phrase[PHRASE_MAX_LEN + 1];
 #define EEPROM_DEVICE_NAME_ADDR   (EEPROM_DEVICE_UUID_ADDR + sizeof(deviceUuid))
 #define EEPROM_SSID_ADDR          (EEPROM_DEVICE_NAME_ADDR + sizeof(deviceName))
 #define EEPROM_PHRASE_ADDR        (EEPROM_SSID_ADDR + sizeof(ssid))
+#define EEPROM_WIFLY_DIGEST_ADDR  (EEPROM_PHRASE_ADDR + sizeof(phrase))
 
 #ifdef WIFLY_SERIAL_HARDWARE
 HardwareSerial& wifly_serial = Serial;
@@ -62,6 +64,8 @@ static int* blinkPattern;
 #ifdef AUTO_CONFIG
 #define MAC_LEN 17
 static char mac[MAC_LEN + 1];
+#define MAC_ID_LEN 12
+static char macId[MAC_ID_LEN + 1];
 static int newDeviceBlinkPattern[] = { 1500, 100, 0 };
 static int discoveredBlinkPattern[] = { 500, 500, 0 };
 static int factoryResetBlinkPattern[] = { 50, 50, 0 };
@@ -70,8 +74,11 @@ static int factoryResetBlinkPattern[] = { 50, 50, 0 };
 #define WAIT_FOR_FACTORYRESET_TIMEOUT (3L * 1000L)
 #define WAIT_FOR_CONFIG_TIMEOUT (5 * 60L * 1000L)
 #define WAIT_FOR_REGISTRATION_TIMEOUT (20L * 1000L)
+#define WAIT_FOR_REUSED_CONFIG_REGISTRATION_TIMEOUT (2L * 1000L)
 #define PING_INTERVAL (5 * 60 * 1000L)
 
+#define WIFLY_COMMAND_RETRIES 2
+
 static unsigned long timeoutMillis;
 static unsigned long nextPingMillis;
 
@@ -82,6 +89,7 @@ enum State {
   STATE_REGISTER_WITH_SERVER,
   STATE_WAIT_FOR_REGISTER_WITH_SERVER_RESPONSE,
   STATE_OPERATIONAL,
+  STATE_WIFLY_COMMANDS,
 #ifdef AUTO_CONFIG
   STATE_NEW_DEVICE,
   STATE_WAIT_FOR_DISCOVERY,
@@ -97,8 +105,100 @@ enum State {
 
 static State state = STATE_INIT;
 
+#define WIFLY_STEP_LEAVE_COMMAND_MODE 0x01
+#define WIFLY_STEP_READ_MAC 0x02
+
+/**
+ * A WiFly command of a configuration sequence. cmd is a printf format with
+ * arg as its argument. The sequences end with a step without a command.
+ */
+typedef struct _WiflyStep {
+  const char* cmd;
+  const char* ack;
+  const char* arg;
+  int timeout;
+  uint8_t flags;
+} WiflyStep;
+
+#define WIFLY_STEP(cmd, ack) { cmd, ack, NULL, DEFAULT_WAIT_RESPONSE_TIME, 0 }
+#define WIFLY_STEP_ARG(cmd, ack, arg) { cmd, ack, arg, DEFAULT_WAIT_RESPONSE_TIME, 0 }
+#define WIFLY_STEP_FACTORY_RESET { "factory R\r", "Defaults", NULL, DEFAULT_WAIT_RESPONSE_TIME, 0 }
+#define WIFLY_STEP_SAVE { "save\r", "ring", NULL, DEFAULT_WAIT_RESPONSE_TIME, 0 }
+#define WIFLY_STEP_REBOOT { "reboot\r", NULL, NULL, DEFAULT_WAIT_RESPONSE_TIME, WIFLY_STEP_LEAVE_COMMAND_MODE }
+#define WIFLY_STEP_DATA_MODE { "exit\r", "EXIT", NULL, DEFAULT_WAIT_RESPONSE_TIME, WIFLY_STEP_LEAVE_COMMAND_MODE }
+#define WIFLY_STEP_END { NULL, NULL, NULL, 0, 0 }
+
+#ifdef AUTO_CONFIG
+// Open an access point the configuration app can connect to
+static const WiflyStep newDeviceSteps[] = {
+  WIFLY_STEP_FACTORY_RESET,
+  WIFLY_STEP("set u b " MAKE_STRING(WIFLY_BAUDRATE) "\r", NULL),
+  { "get m\r", "Mac Addr=", NULL, DEFAULT_WAIT_RESPONSE_TIME, WIFLY_STEP_READ_MAC },
+  WIFLY_STEP("set w j 7\r", "OK"), // Enable AP mode
+  WIFLY_STEP("set w c 6\r", "OK"),
+  WIFLY_STEP_ARG("set a s Caretaker-%s\r", "OK", macId),
+  WIFLY_STEP("set a p 0347342d\r", "OK"),
+  WIFLY_STEP("set i d 4\r", "OK"), // Enable DHCP server
+  WIFLY_STEP("set i a 192.168.0.1\r", "OK"),
+  WIFLY_STEP("set i n 255.255.255.0\r", "OK"),
+  WIFLY_STEP("set i g 192.168.0.1\r", "OK"),
+  WIFLY_STEP_SAVE,
+  WIFLY_STEP_REBOOT,
+  WIFLY_STEP_END
+};
+#endif
+
+// Connect to the configured WLAN and start sending broadcast messages
+static const WiflyStep connectWlanSteps[] = {
+  WIFLY_STEP_FACTORY_RESET,
+  WIFLY_STEP("set u b " MAKE_STRING(WIFLY_BAUDRATE) "\r", NULL),
+  WIFLY_STEP("set i h 0.0.0.0\r", "OK"), // UDP auto pairing
+  WIFLY_STEP("set i f 0x40\r", "OK"), // UDP auto pairing
+  WIFLY_STEP("set i d 1\r", "OK"), // DHCP client on
+  WIFLY_STEP("set i p 1\r", "OK"), // Use UDP
+  WIFLY_STEP("set b i 7\r", "OK"), // UDP broadcast interval 8 secs
+#ifdef BROADCAST_PORT
+  WIFLY_STEP("set b p " MAKE_STRING(BROADCAST_PORT) "\r", "OK"), // Set the broadcast port when debugging
+#endif
+  WIFLY_STEP("set w a 4\r", "OK"),
+  WIFLY_STEP("set w c 0\r", "OK"),
+  WIFLY_STEP("set w j 1\r", "OK"),
+  WIFLY_STEP_ARG("set w s %s\r", "OK", ssid),
+  WIFLY_STEP_ARG("set w p %s\r", "OK", phrase),
+  WIFLY_STEP_ARG("set o d %s\r", "OK", deviceName),
+  WIFLY_STEP_SAVE,
+  WIFLY_STEP_REBOOT,
+  WIFLY_STEP_END
+};
+
+// Send the UDP datagrams to the server that answered the broadcast
+static const WiflyStep connectServerSteps[] = {
+  WIFLY_STEP_ARG("set i h %s\r", "OK", serverAddress),
+  WIFLY_STEP("set b i 0\r", "OK"), // Disable UDP broadcast
+  WIFLY_STEP_SAVE,
+  WIFLY_STEP_DATA_MODE,
+  WIFLY_STEP_END
+};
+
+static const WiflyStep* wiflySteps;
+static uint8_t wiflyStepIndex;
+static State wiflyStepsNextState;
+static unsigned long wiflyStepMillis;
+static uint8_t wiflyFailures;
+static bool wiflyConfigReused;
+static bool wiflyReconfigure;
+static unsigned long reusedConfigDeadline;
+
 void onServerRegisterResponse();
 void onPing();
+void onBinaryMode();
+void onReliableMode();
+
+typedef MessengerDispatch<
+  MessengerHandler<MSG_REGISTER_RESPONSE, onServerRegisterResponse>,
+  MessengerHandler<MSG_PING, onPing>,
+  MessengerHandler<MSG_BINARY_MODE, onBinaryMode>,
+  MessengerHandler<MSG_RELIABLE_MODE, onReliableMode> > BaseMessageHandlers;
 
 #ifdef DEBUG
 void dumpConfigValues() {
@@ -171,6 +271,80 @@ void activateBlinkPattern(int* _blinkPattern) {
   }
 }
 
+/**
+ * Send the current step of the WiFly command sequence. The command is
+ * formatted into buf, which must not change until the step is done.
+ */
+void startWiflyStep() {
+  const WiflyStep& step = wiflySteps[wiflyStepIndex];
+  snprintf(buf, BUF_LEN, step.cmd, step.arg);
+  wiflyStepMillis = millis();
+  wifly.startCommand(buf, step.ack, step.timeout, WIFLY_COMMAND_RETRIES, step.flags & WIFLY_STEP_LEAVE_COMMAND_MODE);
+}
+
+/**
+ * Send a sequence of WiFly commands from the following deviceUpdate() calls,
+ * so that loop() keeps running while the module answers.
+ *
+ * @param steps The commands
+ * @param nextState The state after the last command
+ */
+void startWiflySteps(const WiflyStep* steps, State nextState) {
+  wiflySteps = steps;
+  wiflyStepIndex = 0;
+  wiflyStepsNextState = nextState;
+  state = STATE_WIFLY_COMMANDS;
+  startWiflyStep();
+}
+
+/**
+ * Compute a CRC-16 of the WLAN configuration commands, formatted with the
+ * current EEPROM values.
+ */
+uint16_t wiflyConfigDigest() {
+  uint16_t crc = 0xffff;
+  for (const WiflyStep* step = connectWlanSteps; step->cmd != NULL; ++step) {
+    snprintf(buf, BUF_LEN, step->cmd, step->arg);
+    for (const char* c = buf; *c != '\0'; ++c) {
+      crc ^= (uint16_t) (uint8_t) *c << 8;
+      for (uint8_t i = 0; i < 8; ++i) {
+        crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+      }
+    }
+  }
+  return crc;
+}
+
+#ifdef AUTO_CONFIG
+/**
+ * Read the MAC address that follows the "Mac Addr=" of the "get m" command.
+ * The module sends it right after the ack, so the blocking read is short.
+ */
+void readMac() {
+  wifly.receive((uint8_t *) mac, MAC_LEN);
+  mac[MAC_LEN] = '\0';
+  DEBUG_PRINT(F("- MAC: "))
+  DEBUG_PRINTLN(mac)
+  uint8_t j = 0;
+  for (uint8_t i = 0; i < MAC_LEN && j < MAC_ID_LEN; ++i) {
+    if (mac[i] != ':') {
+      macId[j++] = mac[i];
+    }
+  }
+  macId[j] = '\0';
+}
+#endif
+
+/**
+ * Dispatch the messages that all devices handle and the device specific messages.
+ *
+ * @param msgId The id of the received message
+ * @return True if the message was handled
+ */
+bool dispatchMessage(uint8_t msgId) {
+  return BaseMessageHandlers::dispatch(msgId) || (device->dispatchMessage && (*device->dispatchMessage)(msgId));
+}
+
 /**
  * Initialize the device.
  *
@@ -197,8 +371,7 @@ void deviceInit(DeviceDescriptor& descriptor) {
     digitalWrite(device->buttonPin, HIGH);
   }
 
-  messenger.attach(MSG_REGISTER_RESPONSE, onServerRegisterResponse);
-  messenger.attach(MSG_PING, onPing);
+  messenger.attach(dispatchMessage);
   if (device->registerMessageHandlers) {
     (*device->registerMessageHandlers)();
   }
@@ -304,27 +477,10 @@ void deviceUpdate() {
 
       DEBUG_PRINTLN_STATE(F("NEW_DEVICE"))
       activateBlinkPattern(newDeviceBlinkPattern);
-      wifly.reset();
-      wifly.sendCommand("set u b " MAKE_STRING(WIFLY_BAUDRATE) "\r");
-      wifly.sendCommand("get m\r", "Mac Addr=");
-      wifly.receive((uint8_t *) mac, 17);
-      mac[17] = '\0';
-      DEBUG_PRINT(F("- MAC: "))
-      DEBUG_PRINTLN(mac)
+      // The module is an access point now, whatever the stored digest says
+      wiflyReconfigure = true;
       DEBUG_PRINTLN(F("- Activate AP mode"))
-      wifly.sendCommand("set w j 7\r", "OK"); // Enable AP mode
-      wifly.sendCommand("set w c 6\r", "OK");
-      sprintf(buf, "set a s Caretaker-%c%c%c%c%c%c%c%c%c%c%c%c\r", mac[0], mac[1], mac[3], mac[4], mac[6], mac[7],
-          mac[9], mac[10], mac[12], mac[13], mac[15], mac[16]);
-      wifly.sendCommand(buf, "OK");
-      wifly.sendCommand("set a p 0347342d\r", "OK");
-      wifly.sendCommand("set i d 4\r", "OK"); // Enable DHCP server
-      wifly.sendCommand("set i a 192.168.0.1\r", "OK");
-      wifly.sendCommand("set i n 255.255.255.0\r", "OK");
-      wifly.sendCommand("set i g 192.168.0.1\r", "OK");
-      wifly.save();
-      wifly.reboot();
-      state = STATE_WAIT_FOR_DISCOVERY;
+      startWiflySteps(newDeviceSteps, STATE_WAIT_FOR_DISCOVERY);
       break;
 #endif
 
@@ -437,28 +593,52 @@ void deviceUpdate() {
       // Connect to the configured WLAN and start sending broadcast messages
 
       DEBUG_PRINTLN_STATE(F("CONNECT_WLAN"))
-      wifly.reset();
-      wifly.sendCommand("set u b " MAKE_STRING(WIFLY_BAUDRATE) "\r");
-      wifly.sendCommand("set i h 0.0.0.0\r", "OK"); // UDP auto pairing
-      wifly.sendCommand("set i f 0x40\r", "OK"); // UDP auto pairing
-      wifly.sendCommand("set i d 1\r", "OK"); // DHCP client on
-      wifly.sendCommand("set i p 1\r", "OK"); // Use UDP
-      wifly.sendCommand("set b i 7\r", "OK"); // UDP broadcast interval 8 secs
-#ifdef BROADCAST_PORT
-          wifly.sendCommand("set b p 44444\r", "OK"); // Set broadcast port to 44444 when debugging
+      wiflyDigest = wiflyConfigDigest();
+      if (!wiflyReconfigure && EEPROM.readInt(EEPROM_WIFLY_DIGEST_ADDR) == wiflyDigest) {
+        // The module has saved this configuration and the server address of
+        // the last boot, it joins the WLAN by itself
+        DEBUG_PRINTLN(F("- WiFly configuration unchanged"))
+        wiflyConfigReused = true;
+        reusedConfigDeadline = millis() + WAIT_FOR_REGISTRATION_TIMEOUT;
+        state = STATE_REGISTER_WITH_SERVER;
+        break;
+      }
+      wiflyConfigReused = false;
+      wiflyFailures = 0;
+      startWiflySteps(connectWlanSteps, STATE_WAIT_FOR_BROADCAST_RESPONSE);
+      break;
+
+    case STATE_WIFLY_COMMANDS:
+      // --------------------------------------------------------------------------------
+      // Wait for the ack of the current WiFly command, then send the next one
+
+      DEBUG_PRINTLN_STATE(F("WIFLY_COMMANDS"))
+      {
+        uint8_t result = wifly.pollCommand();
+        if (result == WIFLY_COMMAND_PENDING) {
+          break;
+        }
+        if (result == WIFLY_COMMAND_FAILED) {
+          ++wiflyFailures;
+        }
+        DEBUG_PRINT(F("- "))
+        DEBUG_PRINT(buf)
+        DEBUG_PRINT(result == WIFLY_COMMAND_OK ? F("  OK ") : F("  FAILED "))
+        DEBUG_PRINT(millis() - wiflyStepMillis)
+        DEBUG_PRINTLN(F(" ms"))
+#ifdef AUTO_CONFIG
+        if (result == WIFLY_COMMAND_OK && (wiflySteps[wiflyStepIndex].flags & WIFLY_STEP_READ_MAC)) {
+          readMac();
+        }
 #endif
-      wifly.sendCommand("set w a 4\r", "OK");
-      wifly.sendCommand("set w c 0\r", "OK");
-      wifly.sendCommand("set w j 1\r", "OK");
-      snprintf(buf, BUF_LEN, "set w s %s\r", ssid);
-      wifly.sendCommand(buf, "OK");
-      snprintf(buf, BUF_LEN, "set w p %s\r", phrase);
-      wifly.sendCommand(buf, "OK");
-      snprintf(buf, BUF_LEN, "set o d %s\r", deviceName);
-      wifly.sendCommand(buf, "OK");
-      wifly.save();
-      wifly.reboot();
-      state = STATE_WAIT_FOR_BROADCAST_RESPONSE;
+        // Like before, a failed command doesn't stop the sequence
+        ++wiflyStepIndex;
+        if (wiflySteps[wiflyStepIndex].cmd != NULL) {
+          startWiflyStep();
+        } else {
+          state = wiflyStepsNextState;
+        }
+      }
       break;
 
     case STATE_WAIT_FOR_BROADCAST_RESPONSE:
@@ -471,14 +651,7 @@ void deviceUpdate() {
         if (wiflyReadline(serverAddress, SERVER_ADDRESS_LEN)) {
           snprintf(buf, BUF_LEN, "- Broadcast response from server: %s", serverAddress);
           DEBUG_PRINTLN(buf);
-          // Set the server IP address for UDP transmissions
-          // Disable UDP broadcast
-          snprintf(buf, BUF_LEN, "set i h %s\r", serverAddress);
-          wifly.sendCommand(buf, "OK");
-          wifly.sendCommand("set b i 0\r", "OK");
-          wifly.save();
-          wifly.dataMode();
-          state = STATE_REGISTER_WITH_SERVER;
+          startWiflySteps(connectServerSteps, STATE_REGISTER_WITH_SERVER);
         }
       }
       break;
@@ -488,16 +661,25 @@ void deviceUpdate() {
       // Send a registration request to the server, containing all device information:
 
       DEBUG_PRINTLN_STATE(F("REGISTER_WITH_SERVER"))
-      messenger.sendCmdStart(MSG_REGISTER_REQUEST);
-      messenger.sendCmdArg(deviceUuid);
-      messenger.sendCmdArg(device->type);
-      messenger.sendCmdArg(deviceName);
-      messenger.sendCmdArg(device->description);
+      // The server switches to binary frames and reliable states again after the registration
+      messenger.sendBinaryFrames(false);
+      messenger.setAckCommands(0, 0);
+      {
+        RegisterRequestMsg request;
+        request.id = deviceUuid;
+        request.type = device->type;
+        request.name = deviceName;
+        request.description = device->description;
+        request.start(messenger);
+      }
       if (device->sendServerRegisterParams) {
         (*device->sendServerRegisterParams)();
       }
       messenger.sendCmdEnd();
-      timeoutMillis = millis() + WAIT_FOR_REGISTRATION_TIMEOUT;
+      // With a reused configuration, the requests sent before the module
+      // associated are lost, so they are repeated more often
+      timeoutMillis = millis() + (wiflyConfigReused ? WAIT_FOR_REUSED_CONFIG_REGISTRATION_TIMEOUT :
+          WAIT_FOR_REGISTRATION_TIMEOUT);
       state = STATE_WAIT_FOR_REGISTER_WITH_SERVER_RESPONSE;
       break;
 
@@ -507,7 +689,14 @@ void deviceUpdate() {
 
       DEBUG_PRINTLN_STATE(F("WAIT_FOR_REGISTER_WITH_SERVER_RESPONSE"))
       if (millis() > timeoutMillis) {
-        state = STATE_REGISTER_WITH_SERVER;
+        if (wiflyConfigReused && millis() > reusedConfigDeadline) {
+          // The server has moved or the module lost its configuration
+          DEBUG_PRINTLN(F("- No response, configure the WiFly module"))
+          wiflyReconfigure = true;
+          state = STATE_CONNECT_WLAN;
+        } else {
+          state = STATE_REGISTER_WITH_SERVER;
+        }
       } else {
         messenger.feedinSerialData();
       }
@@ -533,6 +722,14 @@ void deviceUpdate() {
 void onServerRegisterResponse() {
   DEBUG_PRINTLN(F("* ServerRegisterResponse"))
   if (state == STATE_WAIT_FOR_REGISTER_WITH_SERVER_RESPONSE) {
+    DEBUG_PRINT(F("- Operational after "))
+    DEBUG_PRINT(millis())
+    DEBUG_PRINTLN(F(" ms"))
+    if (!wiflyConfigReused && wiflyFailures == 0) {
+      // The configuration works, skip it at the next boot
+      EEPROM.updateInt(EEPROM_WIFLY_DIGEST_ADDR, wiflyDigest);
+    }
+    wiflyConfigReused = false;
     state = STATE_OPERATIONAL;
     if (device->operationalCallback) {
       (*device->operationalCallback)();
@@ -548,6 +745,40 @@ void onPing() {
   messenger.sendCmd(MSG_PING);
 }
 
+/**
+ * The server switches the device between text commands and binary frames.
+ * The answer is still sent in the previous format.
+ */
+void onBinaryMode() {
+  DEBUG_PRINTLN(F("* BinaryMode"))
+  BinaryModeMsg mode;
+  if (mode.read(messenger) != 0) {
+    return;
+  }
+  mode.send(messenger);
+  messenger.sendBinaryFrames(mode.enable);
+}
+
+/**
+ * The server lets the device send its states as reliable commands, until then
+ * they are sent plain. A device built without pending acks (MAXPENDINGACKS 0)
+ * answers that it keeps sending them plain.
+ */
+void onReliableMode() {
+  DEBUG_PRINTLN(F("* ReliableMode"))
+  ReliableModeMsg mode;
+  if (mode.read(messenger) != 0) {
+    return;
+  }
+  mode.enable = mode.enable && MAXPENDINGACKS > 0;
+  mode.send(messenger);
+  if (mode.enable) {
+    messenger.setAckCommands(MSG_RELIABLE, MSG_ACK);
+  } else {
+    messenger.setAckCommands(0, 0);
+  }
+}
+
 /**
  * Return true if the device is in STATE_OPERATIONAL.
  */
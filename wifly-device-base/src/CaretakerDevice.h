@@ -11,6 +11,7 @@
 #include <WiFly.h>
 #include <CmdMessenger.h>
 #include "messages.h"
+#include "protocol.h"
 
 #ifndef _DEVICE_H
 #define _DEVICE_H
@@ -48,6 +49,7 @@ typedef struct _DeviceDescriptor {
   int ledPin;
   int buttonPin;
   void (*registerMessageHandlers)();
+  bool (*dispatchMessage)(uint8_t msgId);
   void (*sendServerRegisterParams)();
   void (*operationalCallback)();
   CmdMessenger* messenger;
@@ -75,6 +77,10 @@ extern Stream& debug;
 #define DEBUG_DUMP_CONFIG_VALUES()
 #endif
 
+// Marks the mutable globals of a firmware. The simulator host keeps them per
+// thread, on the device they are plain globals.
+#define FIRMWARE_GLOBAL
+
 #define MAKE_STRING_PRE(x) #x
 #define MAKE_STRING(x) MAKE_STRING_PRE(x)
 
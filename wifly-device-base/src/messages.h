@@ -7,36 +7,42 @@
  * You find a copy of license in the root directory of this project
  */
 
+/* Generated by protocol/generate.rb from protocol/messages.yml, don't edit */
+
 #ifndef _MESSAGES_H
 #define _MESSAGES_H
 
 /** General messages */
-#define MSG_INVALID             0
-#define MSG_REGISTER_REQUEST    1
-#define MSG_REGISTER_RESPONSE   2
-#define MSG_PING                3
-#define MSG_SWITCH_WRITE        4
-#define MSG_SWITCH_READ         5
-#define MSG_SWITCH_STATE        6
-#define MSG_RGB_WRITE           7
-#define MSG_RGB_READ            8
-#define MSG_RGB_STATE           9
-#define MSG_PWM_WRITE           10
-#define MSG_PWM_READ            11
-#define MSG_PWM_STATE           12
-#define MSG_SENSOR_READ         13
-#define MSG_SENSOR_STATE        14
-#define MSG_SERVO_WRITE         15
-#define MSG_SERVO_READ          16
-#define MSG_SERVO_STATE         17
-#define MSG_REFLOW_OVEN_CMD     18
-#define MSG_REFLOW_OVEN_READ    19
-#define MSG_REFLOW_OVEN_STATE   20
-#define MSG_BUTTON_READ         21
-#define MSG_BUTTON_STATE        22
-#define MSG_ROTARY_READ         23
-#define MSG_ROTARY_WRITE        24
-#define MSG_ROTARY_STATE        25
+#define MSG_INVALID            0
+#define MSG_REGISTER_REQUEST   1
+#define MSG_REGISTER_RESPONSE  2
+#define MSG_PING               3
+#define MSG_SWITCH_WRITE       4
+#define MSG_SWITCH_READ        5
+#define MSG_SWITCH_STATE       6
+#define MSG_RGB_WRITE          7
+#define MSG_RGB_READ           8
+#define MSG_RGB_STATE          9
+#define MSG_PWM_WRITE          10
+#define MSG_PWM_READ           11
+#define MSG_PWM_STATE          12
+#define MSG_SENSOR_READ        13
+#define MSG_SENSOR_STATE       14
+#define MSG_SERVO_WRITE        15
+#define MSG_SERVO_READ         16
+#define MSG_SERVO_STATE        17
+#define MSG_REFLOW_OVEN_CMD    18
+#define MSG_REFLOW_OVEN_READ   19
+#define MSG_REFLOW_OVEN_STATE  20
+#define MSG_BUTTON_READ        21
+#define MSG_BUTTON_STATE       22
+#define MSG_ROTARY_READ        23
+#define MSG_ROTARY_WRITE       24
+#define MSG_ROTARY_STATE       25
+#define MSG_BINARY_MODE        26
+#define MSG_RELIABLE           27
+#define MSG_ACK                28
+#define MSG_RELIABLE_MODE      29
 
 /** Value write modes */
 #define WRITE_DEFAULT            0
@@ -48,16 +54,16 @@
 #define WRITE_TOGGLE             6
 
 /** Sensor types */
-#define SENSOR_ALL                 0
-#define SENSOR_TEMPERATURE         1
-#define SENSOR_BRIGHTNESS          2
-#define SENSOR_SERVO               3
-#define SENSOR_POWER_CONSUMPTION   4
+#define SENSOR_ALL                0
+#define SENSOR_TEMPERATURE        1
+#define SENSOR_BRIGHTNESS         2
+#define SENSOR_SERVO              3
+#define SENSOR_POWER_CONSUMPTION  4
 
 /** Servo types */
-#define SERVO_ALL      0
-#define SERVO_AZIMUTH  1
-#define SERVO_ALTITUDE 2
+#define SERVO_ALL       0
+#define SERVO_AZIMUTH   1
+#define SERVO_ALTITUDE  2
 
 /** Reflow oven commands */
 #define REFLOW_OVEN_CMD_OFF    0
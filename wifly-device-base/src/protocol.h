@@ -0,0 +1,680 @@
+/**
+ * This file is part of the Caretaker Home Automation System
+ *
+ * Copyright 2011-2015 Dirk Grappendorf, www.grappendorf.net
+ *
+ * Licensed under the the MIT License
+ * You find a copy of license in the root directory of this project
+ */
+
+/* Generated by protocol/generate.rb from protocol/messages.yml, don't edit */
+
+#ifndef _PROTOCOL_H
+#define _PROTOCOL_H
+
+#include <stdint.h>
+#include "messages.h"
+
+/**
+ * A struct per message and argument record. The templates work with every
+ * messenger with the CmdMessenger functions sendCmdStart(), sendCmdArg(),
+ * sendCmdEnd() and read(), e.g.
+ *
+ *   SwitchStateMsg state;
+ *   state.switchNum = 0;
+ *   state.on = true;
+ *   state.send(*device.messenger);
+ *
+ *   SwitchWriteMsg write;
+ *   if (write.read(*device.messenger) == 0) ...
+ *
+ * read() parses the arguments in one pass and returns 0 or the number of the
+ * first missing or malformed required field. Missing optional fields are 0.
+ * sendArgs() sends the arguments only, e.g. after sendReliableCmdStart(),
+ * start() of messages with more arguments doesn't end the command.
+ */
+
+/**
+ * MSG_REGISTER_REQUEST: Sent by the device until the server answers with a MSG_REGISTER_RESPONSE
+ * Followed by: Device specific parameters, e.g. the number of switches
+ */
+struct RegisterRequestMsg {
+  static const uint8_t ID = MSG_REGISTER_REQUEST;
+  const char *id;
+  const char *type;
+  const char *name;
+  const char *description;
+
+  template <class Messenger> void sendArgs(Messenger &messenger) const {
+    messenger.sendCmdArg(id);
+    messenger.sendCmdArg(type);
+    messenger.sendCmdArg(name);
+    messenger.sendCmdArg(description);
+  }
+
+  template <class Messenger> void start(Messenger &messenger) const {
+    messenger.sendCmdStart(ID);
+    sendArgs(messenger);
+  }
+
+  template <class Messenger> void send(Messenger &messenger) const {
+    messenger.sendCmdStart(ID);
+    sendArgs(messenger);
+    messenger.sendCmdEnd();
+  }
+
+  template <class Messenger> uint8_t read(Messenger &messenger) {
+    return messenger.read(id, type, name, description);
+  }
+};
+
+/**
+ * MSG_REGISTER_RESPONSE
+ */
+struct RegisterResponseMsg {
+  static const uint8_t ID = MSG_REGISTER_RESPONSE;
+
+  template <class Messenger> void sendArgs(Messenger &) const {
+  }
+
+  template <class Messenger> void send(Messenger &messenger) const {
+    messenger.sendCmdStart(ID);
+    sendArgs(messenger);
+    messenger.sendCmdEnd();
+  }
+
+  template <class Messenger> uint8_t read(Messenger &) {
+    return 0;
+  }
+};
+
+/**
+ * MSG_PING: Answered with a MSG_PING
+ */
+struct PingMsg {
+  static const uint8_t ID = MSG_PING;
+
+  template <class Messenger> void sendArgs(Messenger &) const {
+  }
+
+  template <class Messenger> void send(Messenger &messenger) const {
+    messenger.sendCmdStart(ID);
+    sendArgs(messenger);
+    messenger.sendCmdEnd();
+  }
+
+  template <class Messenger> uint8_t read(Messenger &) {
+    return 0;
+  }
+};
+
+/**
+ * MSG_SWITCH_WRITE
+ */
+struct SwitchWriteMsg {
+  static const uint8_t ID = MSG_SWITCH_WRITE;
+  uint8_t switchNum;
+  uint8_t mode;
+  bool on;
+
+  template <class Messenger> void sendArgs(Messenger &messenger) const {
+    messenger.sendCmdArg(switchNum);
+    messenger.sendCmdArg(mode);
+    messenger.sendCmdArg(on);
+  }
+
+  template <class Messenger> void send(Messenger &messenger) const {
+    messenger.sendCmdStart(ID);
+    sendArgs(messenger);
+    messenger.sendCmdEnd();
+  }
+
+  template <class Messenger> uint8_t read(Messenger &messenger) {
+    on = 0;
+    uint8_t failed = messenger.read(switchNum, mode, on);
+    return failed > 2 ? 0 : failed;
+  }
+};
+
+/**
+ * MSG_SWITCH_READ
+ */
+struct SwitchReadMsg {
+  static const uint8_t ID = MSG_SWITCH_READ;
+  uint8_t switchNum;
+
+  template <class Messenger> void sendArgs(Messenger &messenger) const {
+    messenger.sendCmdArg(switchNum);
+  }
+
+  template <class Messenger> void send(Messenger &messenger) const {
+    messenger.sendCmdStart(ID);
+    sendArgs(messenger);
+    messenger.sendCmdEnd();
+  }
+
+  template <class Messenger> uint8_t read(Messenger &messenger) {
+    switchNum = 0;
+    uint8_t failed = messenger.read(switchNum);
+    return failed > 0 ? 0 : failed;
+  }
+};
+
+/**
+ * MSG_SWITCH_STATE
+ */
+struct SwitchStateMsg {
+  static const uint8_t ID = MSG_SWITCH_STATE;
+  uint8_t switchNum;
+  bool on;
+
+  template <class Messenger> void sendArgs(Messenger &messenger) const {
+    messenger.sendCmdArg(switchNum);
+    messenger.sendCmdArg(on);
+  }
+
+  template <class Messenger> void send(Messenger &messenger) const {
+    messenger.sendCmdStart(ID);
+    sendArgs(messenger);
+    messenger.sendCmdEnd();
+  }
+
+  template <class Messenger> uint8_t read(Messenger &messenger) {
+    return messenger.read(switchNum, on);
+  }
+};
+
+/**
+ * MSG_RGB_WRITE
+ */
+struct RgbWriteMsg {
+  static const uint8_t ID = MSG_RGB_WRITE;
+  uint8_t mode;
+  uint8_t red;
+  uint8_t green;
+  uint8_t blue;
+
+  template <class Messenger> void sendArgs(Messenger &messenger) const {
+    messenger.sendCmdArg(mode);
+    messenger.sendCmdArg(red);
+    messenger.sendCmdArg(green);
+    messenger.sendCmdArg(blue);
+  }
+
+  template <class Messenger> void send(Messenger &messenger) const {
+    messenger.sendCmdStart(ID);
+    sendArgs(messenger);
+    messenger.sendCmdEnd();
+  }
+
+  template <class Messenger> uint8_t read(Messenger &messenger) {
+    red = 0;
+    green = 0;
+    blue = 0;
+    uint8_t failed = messenger.read(mode, red, green, blue);
+    return failed > 1 ? 0 : failed;
+  }
+};
+
+/**
+ * MSG_RGB_READ
+ */
+struct RgbReadMsg {
+  static const uint8_t ID = MSG_RGB_READ;
+
+  template <class Messenger> void sendArgs(Messenger &) const {
+  }
+
+  template <class Messenger> void send(Messenger &messenger) const {
+    messenger.sendCmdStart(ID);
+    sendArgs(messenger);
+    messenger.sendCmdEnd();
+  }
+
+  template <class Messenger> uint8_t read(Messenger &) {
+    return 0;
+  }
+};
+
+/**
+ * MSG_RGB_STATE
+ */
+struct RgbStateMsg {
+  static const uint8_t ID = MSG_RGB_STATE;
+  uint8_t red;
+  uint8_t green;
+  uint8_t blue;
+
+  template <class Messenger> void sendArgs(Messenger &messenger) const {
+    messenger.sendCmdArg(red);
+    messenger.sendCmdArg(green);
+    messenger.sendCmdArg(blue);
+  }
+
+  template <class Messenger> void send(Messenger &messenger) const {
+    messenger.sendCmdStart(ID);
+    sendArgs(messenger);
+    messenger.sendCmdEnd();
+  }
+
+  template <class Messenger> uint8_t read(Messenger &messenger) {
+    return messenger.read(red, green, blue);
+  }
+};
+
+/**
+ * MSG_PWM_WRITE
+ */
+struct PwmWriteMsg {
+  static const uint8_t ID = MSG_PWM_WRITE;
+  uint8_t mode;
+  int value;
+
+  template <class Messenger> void sendArgs(Messenger &messenger) const {
+    messenger.sendCmdArg(mode);
+    messenger.sendCmdArg(value);
+  }
+
+  template <class Messenger> void send(Messenger &messenger) const {
+    messenger.sendCmdStart(ID);
+    sendArgs(messenger);
+    messenger.sendCmdEnd();
+  }
+
+  template <class Messenger> uint8_t read(Messenger &messenger) {
+    value = 0;
+    uint8_t failed = messenger.read(mode, value);
+    return failed > 1 ? 0 : failed;
+  }
+};
+
+/**
+ * MSG_PWM_READ
+ */
+struct PwmReadMsg {
+  static const uint8_t ID = MSG_PWM_READ;
+
+  template <class Messenger> void sendArgs(Messenger &) const {
+  }
+
+  template <class Messenger> void send(Messenger &messenger) const {
+    messenger.sendCmdStart(ID);
+    sendArgs(messenger);
+    messenger.sendCmdEnd();
+  }
+
+  template <class Messenger> uint8_t read(Messenger &) {
+    return 0;
+  }
+};
+
+/**
+ * MSG_PWM_STATE
+ */
+struct PwmStateMsg {
+  static const uint8_t ID = MSG_PWM_STATE;
+  int value;
+
+  template <class Messenger> void sendArgs(Messenger &messenger) const {
+    messenger.sendCmdArg(value);
+  }
+
+  template <class Messenger> void send(Messenger &messenger) const {
+    messenger.sendCmdStart(ID);
+    sendArgs(messenger);
+    messenger.sendCmdEnd();
+  }
+
+  template <class Messenger> uint8_t read(Messenger &messenger) {
+    return messenger.read(value);
+  }
+};
+
+/**
+ * MSG_SENSOR_READ
+ */
+struct SensorReadMsg {
+  static const uint8_t ID = MSG_SENSOR_READ;
+
+  template <class Messenger> void sendArgs(Messenger &) const {
+  }
+
+  template <class Messenger> void send(Messenger &messenger) const {
+    messenger.sendCmdStart(ID);
+    sendArgs(messenger);
+    messenger.sendCmdEnd();
+  }
+
+  template <class Messenger> uint8_t read(Messenger &) {
+    return 0;
+  }
+};
+
+/**
+ * MSG_SENSOR_STATE
+ * Followed by: Further sensor and value pairs
+ */
+struct SensorStateMsg {
+  static const uint8_t ID = MSG_SENSOR_STATE;
+  uint8_t sensor;
+  float value;
+
+  template <class Messenger> void sendArgs(Messenger &messenger) const {
+    messenger.sendCmdArg(sensor);
+    messenger.sendCmdArg(value);
+  }
+
+  template <class Messenger> void start(Messenger &messenger) const {
+    messenger.sendCmdStart(ID);
+    sendArgs(messenger);
+  }
+
+  template <class Messenger> void send(Messenger &messenger) const {
+    messenger.sendCmdStart(ID);
+    sendArgs(messenger);
+    messenger.sendCmdEnd();
+  }
+
+  template <class Messenger> uint8_t read(Messenger &messenger) {
+    return messenger.read(sensor, value);
+  }
+};
+
+/**
+ * MSG_REFLOW_OVEN_CMD
+ */
+struct ReflowOvenCmdMsg {
+  static const uint8_t ID = MSG_REFLOW_OVEN_CMD;
+  uint8_t command;
+
+  template <class Messenger> void sendArgs(Messenger &messenger) const {
+    messenger.sendCmdArg(command);
+  }
+
+  template <class Messenger> void send(Messenger &messenger) const {
+    messenger.sendCmdStart(ID);
+    sendArgs(messenger);
+    messenger.sendCmdEnd();
+  }
+
+  template <class Messenger> uint8_t read(Messenger &messenger) {
+    return messenger.read(command);
+  }
+};
+
+/**
+ * MSG_REFLOW_OVEN_READ
+ */
+struct ReflowOvenReadMsg {
+  static const uint8_t ID = MSG_REFLOW_OVEN_READ;
+
+  template <class Messenger> void sendArgs(Messenger &) const {
+  }
+
+  template <class Messenger> void send(Messenger &messenger) const {
+    messenger.sendCmdStart(ID);
+    sendArgs(messenger);
+    messenger.sendCmdEnd();
+  }
+
+  template <class Messenger> uint8_t read(Messenger &) {
+    return 0;
+  }
+};
+
+/**
+ * MSG_REFLOW_OVEN_STATE
+ */
+struct ReflowOvenStateMsg {
+  static const uint8_t ID = MSG_REFLOW_OVEN_STATE;
+  uint8_t mode;
+  uint8_t state;
+  bool heaterOn;
+  bool fanOn;
+
+  template <class Messenger> void sendArgs(Messenger &messenger) const {
+    messenger.sendCmdArg(mode);
+    messenger.sendCmdArg(state);
+    messenger.sendCmdArg(heaterOn);
+    messenger.sendCmdArg(fanOn);
+  }
+
+  template <class Messenger> void send(Messenger &messenger) const {
+    messenger.sendCmdStart(ID);
+    sendArgs(messenger);
+    messenger.sendCmdEnd();
+  }
+
+  template <class Messenger> uint8_t read(Messenger &messenger) {
+    return messenger.read(mode, state, heaterOn, fanOn);
+  }
+};
+
+/**
+ * MSG_BUTTON_READ
+ */
+struct ButtonReadMsg {
+  static const uint8_t ID = MSG_BUTTON_READ;
+
+  template <class Messenger> void sendArgs(Messenger &) const {
+  }
+
+  template <class Messenger> void send(Messenger &messenger) const {
+    messenger.sendCmdStart(ID);
+    sendArgs(messenger);
+    messenger.sendCmdEnd();
+  }
+
+  template <class Messenger> uint8_t read(Messenger &) {
+    return 0;
+  }
+};
+
+/**
+ * MSG_BUTTON_STATE
+ */
+struct ButtonStateMsg {
+  static const uint8_t ID = MSG_BUTTON_STATE;
+  uint8_t button;
+  uint8_t state;
+
+  template <class Messenger> void sendArgs(Messenger &messenger) const {
+    messenger.sendCmdArg(button);
+    messenger.sendCmdArg(state);
+  }
+
+  template <class Messenger> void send(Messenger &messenger) const {
+    messenger.sendCmdStart(ID);
+    sendArgs(messenger);
+    messenger.sendCmdEnd();
+  }
+
+  template <class Messenger> uint8_t read(Messenger &messenger) {
+    return messenger.read(button, state);
+  }
+};
+
+/**
+ * MSG_ROTARY_READ
+ */
+struct RotaryReadMsg {
+  static const uint8_t ID = MSG_ROTARY_READ;
+
+  template <class Messenger> void sendArgs(Messenger &) const {
+  }
+
+  template <class Messenger> void send(Messenger &messenger) const {
+    messenger.sendCmdStart(ID);
+    sendArgs(messenger);
+    messenger.sendCmdEnd();
+  }
+
+  template <class Messenger> uint8_t read(Messenger &) {
+    return 0;
+  }
+};
+
+/**
+ * MSG_ROTARY_WRITE
+ */
+struct RotaryWriteMsg {
+  static const uint8_t ID = MSG_ROTARY_WRITE;
+  uint8_t mode;
+  int value;
+
+  template <class Messenger> void sendArgs(Messenger &messenger) const {
+    messenger.sendCmdArg(mode);
+    messenger.sendCmdArg(value);
+  }
+
+  template <class Messenger> void send(Messenger &messenger) const {
+    messenger.sendCmdStart(ID);
+    sendArgs(messenger);
+    messenger.sendCmdEnd();
+  }
+
+  template <class Messenger> uint8_t read(Messenger &messenger) {
+    value = 0;
+    uint8_t failed = messenger.read(mode, value);
+    return failed > 1 ? 0 : failed;
+  }
+};
+
+/**
+ * MSG_ROTARY_STATE
+ */
+struct RotaryStateMsg {
+  static const uint8_t ID = MSG_ROTARY_STATE;
+  int value;
+
+  template <class Messenger> void sendArgs(Messenger &messenger) const {
+    messenger.sendCmdArg(value);
+  }
+
+  template <class Messenger> void send(Messenger &messenger) const {
+    messenger.sendCmdStart(ID);
+    sendArgs(messenger);
+    messenger.sendCmdEnd();
+  }
+
+  template <class Messenger> uint8_t read(Messenger &messenger) {
+    return messenger.read(value);
+  }
+};
+
+/**
+ * MSG_BINARY_MODE: Switches the sent commands to binary frames, answered in the previous format
+ */
+struct BinaryModeMsg {
+  static const uint8_t ID = MSG_BINARY_MODE;
+  bool enable;
+
+  template <class Messenger> void sendArgs(Messenger &messenger) const {
+    messenger.sendCmdArg(enable);
+  }
+
+  template <class Messenger> void send(Messenger &messenger) const {
+    messenger.sendCmdStart(ID);
+    sendArgs(messenger);
+    messenger.sendCmdEnd();
+  }
+
+  template <class Messenger> uint8_t read(Messenger &messenger) {
+    return messenger.read(enable);
+  }
+};
+
+/**
+ * MSG_RELIABLE: Wraps a command that is answered with a MSG_ACK, see CmdMessenger::sendReliableCmdStart(), only sent after MSG_RELIABLE_MODE
+ * Followed by: The arguments of the wrapped command
+ */
+struct ReliableMsg {
+  static const uint8_t ID = MSG_RELIABLE;
+  uint8_t sequence;
+  uint8_t command;
+
+  template <class Messenger> void sendArgs(Messenger &messenger) const {
+    messenger.sendCmdArg(sequence);
+    messenger.sendCmdArg(command);
+  }
+
+  template <class Messenger> void start(Messenger &messenger) const {
+    messenger.sendCmdStart(ID);
+    sendArgs(messenger);
+  }
+
+  template <class Messenger> void send(Messenger &messenger) const {
+    messenger.sendCmdStart(ID);
+    sendArgs(messenger);
+    messenger.sendCmdEnd();
+  }
+
+  template <class Messenger> uint8_t read(Messenger &messenger) {
+    return messenger.read(sequence, command);
+  }
+};
+
+/**
+ * MSG_ACK
+ */
+struct AckMsg {
+  static const uint8_t ID = MSG_ACK;
+  uint8_t sequence;
+
+  template <class Messenger> void sendArgs(Messenger &messenger) const {
+    messenger.sendCmdArg(sequence);
+  }
+
+  template <class Messenger> void send(Messenger &messenger) const {
+    messenger.sendCmdStart(ID);
+    sendArgs(messenger);
+    messenger.sendCmdEnd();
+  }
+
+  template <class Messenger> uint8_t read(Messenger &messenger) {
+    return messenger.read(sequence);
+  }
+};
+
+/**
+ * MSG_RELIABLE_MODE: Lets the device send its states as MSG_RELIABLE, answered with the mode the device supports
+ */
+struct ReliableModeMsg {
+  static const uint8_t ID = MSG_RELIABLE_MODE;
+  bool enable;
+
+  template <class Messenger> void sendArgs(Messenger &messenger) const {
+    messenger.sendCmdArg(enable);
+  }
+
+  template <class Messenger> void send(Messenger &messenger) const {
+    messenger.sendCmdStart(ID);
+    sendArgs(messenger);
+    messenger.sendCmdEnd();
+  }
+
+  template <class Messenger> uint8_t read(Messenger &messenger) {
+    return messenger.read(enable);
+  }
+};
+
+/**
+ * SENSOR_RANGE: Registration parameter of the sensor device, follows the number of sensors
+ */
+struct SensorRangeArgs {
+  uint8_t sensor;
+  int min;
+  int max;
+
+  template <class Messenger> void sendArgs(Messenger &messenger) const {
+    messenger.sendCmdArg(sensor);
+    messenger.sendCmdArg(min);
+    messenger.sendCmdArg(max);
+  }
+
+  template <class Messenger> uint8_t read(Messenger &messenger) {
+    return messenger.read(sensor, min, max);
+  }
+};
+
+#endif /* _PROTOCOL_H */